@@ -0,0 +1,99 @@
+#pragma once
+
+#include <core/def.h>
+#include <core/datatable.h>
+#include <core/vector.h>
+
+#include <chrono>
+#include <functional>
+
+// Tiny benchmark harness {{{
+BEGIN_JOYFLOW_NAMESPACE
+namespace bench {
+
+/// handed to every benchmark, times what is given to `measure`
+class Bench
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Config
+  {
+    double minSeconds    = 0.5; //< keep repeating until this much time was measured ...
+    size_t minIterations = 5;   //< ... and at least this many repetitions were made
+    size_t maxIterations = 1000000;
+  };
+
+private:
+  Config         config_;
+  Vector<double> samples_; // seconds per repetition
+  size_t         items_ = 0;
+
+public:
+  explicit Bench(Config const& config) : config_(config) {}
+
+  /// time `body`, repeated until time budget is used up,
+  /// `setup` runs before every repetition and is not timed
+  template<class Setup, class Body>
+  void measure(Setup&& setup, Body&& body)
+  {
+    // one warm up run, not recorded
+    setup();
+    body();
+    double total = 0;
+    while (samples_.size() < config_.maxIterations &&
+           (total < config_.minSeconds || samples_.size() < config_.minIterations)) {
+      setup();
+      auto const start = clock::now();
+      body();
+      double const seconds = std::chrono::duration<double>(clock::now() - start).count();
+      samples_.push_back(seconds);
+      total += seconds;
+    }
+  }
+
+  template<class Body>
+  void measure(Body&& body)
+  {
+    measure([] {}, std::forward<Body>(body));
+  }
+
+  /// items processed by one repetition, reported as throughput
+  void setItems(size_t n) { items_ = n; }
+
+  Vector<double> const& samples() const { return samples_; }
+  size_t                items() const { return items_; }
+};
+
+using BenchFunc = std::function<void(Bench&)>;
+
+/// returns true so it can initialize a static
+bool registerBench(char const* group, char const* name, BenchFunc func);
+
+/// data size benchmarks should work with, unless they are about size
+size_t defaultRows();
+
+/// keeps the compiler from dropping a computation whose result is otherwise unused
+inline void keep(real value)
+{
+  static volatile real s_sink;
+  s_sink = value;
+}
+
+/// `tables` tables of `rows` rows with columns "P" (vec3), "id" (int32) and "name" (string of digits),
+/// filled from a fixed seed so every run sees the same data
+DataCollectionPtr makeTestData(size_t rows, sint tables = 1, uint32_t seed = 42);
+
+/// registers "bench_source", serving `makeTestData` of its "rows", "tables" and "seed" arguments
+void registerBenchOps();
+
+} // namespace bench
+END_JOYFLOW_NAMESPACE
+
+/// BENCHMARK("group", "name") { bench.measure(...); }
+#define BENCHMARK(group, name)                                                       \
+  static void CONCATENATE(benchFunc_, __LINE__)(::joyflow::bench::Bench & bench);    \
+  static bool CONCATENATE(benchRegistered_, __LINE__) =                              \
+      ::joyflow::bench::registerBench(group, name, CONCATENATE(benchFunc_, __LINE__)); \
+  static void CONCATENATE(benchFunc_, __LINE__)(::joyflow::bench::Bench & bench)
+// }}}
@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include <glm/glm.hpp>
+#include <fmt/format.h>
+
+#include <random>
+
+BEGIN_JOYFLOW_NAMESPACE
+namespace bench {
+
+DataCollectionPtr makeTestData(size_t rows, sint tables, uint32_t seed)
+{
+  std::mt19937                         rng(seed);
+  std::uniform_real_distribution<real> unit(-1, 1);
+
+  auto dc = newDataCollection();
+  for (sint t = 0; t < tables; ++t) {
+    auto* table = dc->getTable(dc->addTable());
+    auto* pos   = table->createColumn("P", vec3(0));
+    auto* id    = table->createColumn<int32_t>("id", 0);
+    auto* name  = table->createColumn<String>("name");
+    CellIndex idx = table->addRows(rows);
+    for (size_t i = 0; i < rows; ++i, ++idx) {
+      pos->set(idx, vec3(unit(rng), unit(rng), unit(rng)));
+      id->set<int32_t>(idx, int32_t(rng() % rows));
+      name->set<String>(idx, fmt::format("{}", i % 1024));
+    }
+  }
+  return dc;
+}
+
+} // namespace bench
+END_JOYFLOW_NAMESPACE
+
+using namespace joyflow;
+
+BENCHMARK("datatable", "get")
+{
+  auto  data  = bench::makeTestData(bench::defaultRows());
+  auto* table = data->getTable(0);
+  auto* pos   = table->getColumn("P");
+  bench.setItems(table->numRows());
+  bench.measure([&] {
+    real sum = 0;
+    for (CellIndex i(0); i < table->numIndices(); ++i)
+      sum += pos->get<vec3>(i).y;
+    bench::keep(sum);
+  });
+}
+
+BENCHMARK("datatable", "set")
+{
+  auto  data  = bench::makeTestData(bench::defaultRows());
+  auto* table = data->getTable(0);
+  auto* pos   = table->getColumn("P");
+  bench.setItems(table->numRows());
+  bench.measure([&] {
+    for (CellIndex i(0); i < table->numIndices(); ++i)
+      pos->set(i, vec3(real(i.value())));
+  });
+}
+
+BENCHMARK("datatable", "addRows")
+{
+  DataCollectionPtr data;
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] { data = bench::makeTestData(0); },
+                [&] { data->getTable(0)->addRows(bench::defaultRows()); });
+}
+
+BENCHMARK("datatable", "join")
+{
+  auto const        a = bench::makeTestData(bench::defaultRows(), 1, 1);
+  auto const        b = bench::makeTestData(bench::defaultRows(), 1, 2);
+  DataCollectionPtr target;
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] { target = a->share(); }, [&] { target->join(b.get()); });
+}
+
+BENCHMARK("datatable", "join 4 partitions")
+{
+  size_t const                  rows  = bench::defaultRows() / 4;
+  auto const                    first = bench::makeTestData(rows, 1, 1);
+  Vector<DataCollectionPtr>     parts;
+  Vector<DataCollection const*> others;
+  for (int i = 2; i <= 4; ++i)
+    others.push_back(parts.emplace_back(bench::makeTestData(rows, 1, i)).get());
+  DataCollectionPtr             target;
+  bench.setItems(rows * 4);
+  bench.measure([&] { target = first->share(); }, [&] { target->join(others); });
+}
+
+BENCHMARK("datatable", "defragment")
+{
+  auto const        source = bench::makeTestData(bench::defaultRows());
+  DataCollectionPtr data;
+  bench.setItems(bench::defaultRows() / 2);
+  bench.measure(
+      [&] {
+        data        = source->share();
+        auto* table = data->getTable(0);
+        table->makeUnique();
+        for (sint row = 0, n = table->numRows(); row < n; row += 2)
+          table->markRemoval(row);
+        table->applyRemoval();
+      },
+      [&] { data->defragment(); });
+}
+
+BENCHMARK("datatable", "markRemoval+applyRemoval")
+{
+  auto const        source = bench::makeTestData(bench::defaultRows());
+  DataCollectionPtr data;
+  bench.setItems(bench::defaultRows());
+  bench.measure(
+      [&] {
+        data = source->share();
+        data->getTable(0)->makeUnique();
+      },
+      [&] {
+        auto* table = data->getTable(0);
+        for (sint row = 0, n = table->numRows(); row < n; row += 3)
+          table->markRemoval(row);
+        table->applyRemoval();
+      });
+}
+
+BENCHMARK("datatable", "makeUnique")
+{
+  auto const        source = bench::makeTestData(bench::defaultRows());
+  DataCollectionPtr data;
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] { data = source->share(); },
+                [&] {
+                  auto* table = data->getTable(0);
+                  table->makeUnique();
+                  for (auto const& name : table->columnNames())
+                    table->getColumn(name)->makeUnique();
+                });
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+
+#include <core/opcontext.h>
+#include <core/opgraph.h>
+#include <core/oparg.h>
+
+#include <memory>
+
+BEGIN_JOYFLOW_NAMESPACE
+namespace bench {
+
+/// nodes of the synthetic graphs
+static constexpr sint GRAPH_NODES = 10000;
+
+/// "bench_source" followed by a chain of `length` noops, returns name of the last one
+static String buildChain(OpGraph* graph, sint length)
+{
+  auto source = graph->addNode("bench_source", "source");
+  graph->node(source)->mutArg("rows").setInt(16);
+  String prev = source;
+  for (sint i = 0; i < length; ++i) {
+    auto name = graph->addNode("noop", "noop");
+    graph->link(prev, 0, name, 0);
+    prev = name;
+  }
+  return prev;
+}
+
+/// evaluate a long chain bit by bit, each step only goes as deep as the last cached output
+static void warmChain(OpGraph* graph, sint step)
+{
+  auto const& names = graph->childNames();
+  for (sint i = step; i < names.ssize(); i += step)
+    graph->evalNode(names[i]);
+}
+
+} // namespace bench
+END_JOYFLOW_NAMESPACE
+
+using namespace joyflow;
+
+BENCHMARK("graph", "build 10k chain")
+{
+  std::unique_ptr<OpGraph> graph;
+  bench.setItems(bench::GRAPH_NODES);
+  bench.measure([&] { graph.reset(newGraph("bench")); },
+                [&] { bench::buildChain(graph.get(), bench::GRAPH_NODES); });
+}
+
+// nothing is dirty, what's left is prepareEvaluation walking the graph
+BENCHMARK("graph", "prepare 10k chain")
+{
+  std::unique_ptr<OpGraph> graph(newGraph("bench"));
+  auto tail = bench::buildChain(graph.get(), bench::GRAPH_NODES);
+  bench::warmChain(graph.get(), 500);
+  bench.setItems(bench::GRAPH_NODES);
+  bench.measure([&] { graph->evalNode(tail); });
+}
+
+// changing the source re-evaluates every node, tiny tables show the per node overhead
+BENCHMARK("graph", "eval 1k chain")
+{
+  std::unique_ptr<OpGraph> graph(newGraph("bench"));
+  auto tail = bench::buildChain(graph.get(), bench::GRAPH_NODES / 10);
+  graph->evalNode(tail);
+  sint seed = 0;
+  bench.setItems(bench::GRAPH_NODES / 10);
+  bench.measure([&] { graph->node("source")->mutArg("seed").setInt(++seed); },
+                [&] { graph->evalNode(tail); });
+}
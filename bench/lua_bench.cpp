@@ -0,0 +1,113 @@
+#include "bench.h"
+
+#include <core/error.h>
+#include <core/luabinding.h>
+
+#include <sol/sol.hpp>
+
+using namespace joyflow;
+
+BENCHMARK("lua", "foreach read")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function sum(t)
+      local s = 0
+      t:foreach(function(row) s = s + row.id end)
+      return s
+    end
+  )");
+  auto data   = bench::makeTestData(bench::defaultRows());
+  auto sumfun = lua.get<sol::protected_function>("sum");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] { bench::keep(sumfun(data->getTable(0)).get<real>()); });
+}
+
+BENCHMARK("lua", "foreach write")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function bump(t)
+      t:foreach(function(row) row.id = row.id + 1 end)
+    end
+  )");
+  auto data    = bench::makeTestData(bench::defaultRows());
+  auto bumpfun = lua.get<sol::protected_function>("bump");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] {
+    auto result = bumpfun(data->getTable(0));
+    RUNTIME_CHECK(result.valid(), "lua: {}", result.get<sol::error>().what());
+  });
+}
+
+BENCHMARK("lua", "parallel foreach write")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function bump(t)
+      t:parallel_foreach(function(row) row.id = row.id + 1 end, {'id'})
+    end
+  )");
+  auto data    = bench::makeTestData(bench::defaultRows());
+  auto bumpfun = lua.get<sol::protected_function>("bump");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] {
+    auto result = bumpfun(data->getTable(0));
+    RUNTIME_CHECK(result.valid(), "lua: {}", result.get<sol::error>().what());
+  });
+}
+
+BENCHMARK("lua", "array sum")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function sum(t)
+      return t:array('id'):sum()
+    end
+  )");
+  auto data   = bench::makeTestData(bench::defaultRows());
+  auto sumfun = lua.get<sol::protected_function>("sum");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] { bench::keep(sumfun(data->getTable(0)).get<real>()); });
+}
+
+BENCHMARK("lua", "array loop write")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function bump(t)
+      local ids = t:mutArray('id')
+      for i = 0, #ids - 1 do ids[i] = ids[i] + 1 end
+    end
+  )");
+  auto data    = bench::makeTestData(bench::defaultRows());
+  auto bumpfun = lua.get<sol::protected_function>("bump");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] {
+    auto result = bumpfun(data->getTable(0));
+    RUNTIME_CHECK(result.valid(), "lua: {}", result.get<sol::error>().what());
+  });
+}
+
+BENCHMARK("lua", "array add")
+{
+  sol::state lua;
+  bindLuaTypes(lua);
+  lua.safe_script(R"(
+    function bump(t)
+      t:mutArray('id'):add(1)
+    end
+  )");
+  auto data    = bench::makeTestData(bench::defaultRows());
+  auto bumpfun = lua.get<sol::protected_function>("bump");
+  bench.setItems(bench::defaultRows());
+  bench.measure([&] {
+    auto result = bumpfun(data->getTable(0));
+    RUNTIME_CHECK(result.valid(), "lua: {}", result.get<sol::error>().what());
+  });
+}
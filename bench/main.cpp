@@ -0,0 +1,215 @@
+#include "bench.h"
+
+#include <core/log.h>
+#include <core/opbuiltin.h>
+#include <core/oplib.h>
+#include <core/version.h>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <tuple>
+
+BEGIN_JOYFLOW_NAMESPACE
+namespace bench {
+
+struct BenchEntry
+{
+  String    group;
+  String    name;
+  BenchFunc func;
+};
+
+static Vector<BenchEntry>& registry()
+{
+  static Vector<BenchEntry> s_registry;
+  return s_registry;
+}
+
+static size_t s_defaultRows = 100000;
+
+bool registerBench(char const* group, char const* name, BenchFunc func)
+{
+  registry().push_back({group, name, std::move(func)});
+  return true;
+}
+
+size_t defaultRows() { return s_defaultRows; }
+
+static char const* buildType()
+{
+#if defined(SANITIZE)
+  return "sanitize";
+#elif defined(PROFILE)
+  return "profile";
+#elif defined(DEBUG)
+  return "debug";
+#else
+  return "release";
+#endif
+}
+
+static String compilerName()
+{
+#if defined(__clang__)
+  return fmt::format("clang {}.{}.{}", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+  return fmt::format("gcc {}.{}.{}", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#elif defined(_MSC_VER)
+  return fmt::format("msvc {}", _MSC_VER);
+#else
+  return "unknown";
+#endif
+}
+
+static void usage(char const* exe)
+{
+  printf("usage: %s [options]\n"
+         "  --filter <text>   only run benchmarks whose \"group/name\" contains text\n"
+         "  --json <file>     write results as json to file (\"-\" for stdout)\n"
+         "  --min-time <sec>  measure each benchmark at least this long (default: 0.5)\n"
+         "  --min-iters <n>   repeat each benchmark at least n times (default: 5)\n"
+         "  --rows <n>        rows of generated tables (default: 100000)\n"
+         "  --list            list benchmarks and exit\n",
+         exe);
+}
+
+} // namespace bench
+END_JOYFLOW_NAMESPACE
+
+int main(int argc, char** argv)
+{
+  using namespace joyflow;
+  using namespace joyflow::bench;
+
+  auto logger = spdlog::stderr_color_mt("bench");
+  logger->set_level(spdlog::level::warn);
+  setLogger(logger);
+
+  Bench::Config config;
+  String        filter, jsonPath;
+  bool          listOnly = false;
+  for (int i = 1; i < argc; ++i) {
+    String const arg     = argv[i];
+    bool const   hasNext = i + 1 < argc;
+    if (arg == "--filter" && hasNext)
+      filter = argv[++i];
+    else if (arg == "--json" && hasNext)
+      jsonPath = argv[++i];
+    else if (arg == "--min-time" && hasNext)
+      config.minSeconds = std::atof(argv[++i]);
+    else if (arg == "--min-iters" && hasNext)
+      config.minIterations = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--rows" && hasNext)
+      s_defaultRows = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--list")
+      listOnly = true;
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+
+  registerBuiltinOps();
+  registerBenchOps();
+#ifndef JFCORE_STATIC
+  String const oplibPath = defaultOpDir() +
+#ifdef _WIN32
+    "\\oplib.dll";
+#else
+    "/liboplib.so";
+#endif
+  if (!openOpLib(oplibPath))
+    spdlog::warn("cannot load {}, csv benchmarks will be skipped", oplibPath);
+#endif
+
+  auto entries = registry();
+  std::sort(entries.begin(), entries.end(), [](BenchEntry const& a, BenchEntry const& b) {
+    return std::tie(a.group, a.name) < std::tie(b.group, b.name);
+  });
+
+  // json on stdout keeps the table out of its way
+  FILE* report  = jsonPath == "-" ? stderr : stdout;
+  Json  results = Json::array();
+  if (!listOnly)
+    fprintf(report, "%-40s %10s %12s %12s %12s %14s\n", "benchmark", "iters", "min(ms)", "median(ms)", "stddev(ms)", "items/s");
+  for (auto const& entry : entries) {
+    String const fullname = entry.group + "/" + entry.name;
+    if (!filter.empty() && fullname.find(filter) == String::npos)
+      continue;
+    if (listOnly) {
+      printf("%s\n", fullname.c_str());
+      continue;
+    }
+
+    Bench bench(config);
+    try {
+      entry.func(bench);
+    } catch (std::exception const& e) {
+      fprintf(stderr, "%s failed: %s\n", fullname.c_str(), e.what());
+      continue;
+    }
+    auto samples = bench.samples();
+    if (samples.empty()) // skipped
+      continue;
+    std::sort(samples.begin(), samples.end());
+    double const n      = double(samples.size());
+    double const median = samples[samples.size() / 2];
+    double       mean   = 0;
+    for (double s : samples)
+      mean += s / n;
+    double var = 0;
+    for (double s : samples)
+      var += (s - mean) * (s - mean) / n;
+    double const stddev     = std::sqrt(var);
+    double const throughput = bench.items() > 0 && median > 0 ? bench.items() / median : 0;
+
+    fprintf(report, "%-40s %10zu %12.4f %12.4f %12.4f %14.0f\n", fullname.c_str(), samples.size(), samples.front() * 1e3,
+            median * 1e3, stddev * 1e3, throughput);
+    fflush(report);
+    results.push_back({
+        {"group", entry.group},
+        {"name", entry.name},
+        {"iterations", samples.size()},
+        {"min_ns", samples.front() * 1e9},
+        {"median_ns", median * 1e9},
+        {"mean_ns", mean * 1e9},
+        {"max_ns", samples.back() * 1e9},
+        {"stddev_ns", stddev * 1e9},
+        {"items", bench.items()},
+        {"items_per_second", throughput},
+    });
+  }
+  if (listOnly || jsonPath.empty())
+    return 0;
+
+  Json doc = {
+      {"version", DF_CORE_VERSION_STRING},
+      {"build", buildType()},
+      {"compiler", compilerName()},
+      {"threads", std::thread::hardware_concurrency()},
+      {"timestamp", std::time(nullptr)},
+      {"rows", s_defaultRows},
+      {"min_seconds", config.minSeconds},
+      {"benchmarks", std::move(results)},
+  };
+  if (jsonPath == "-") {
+    std::cout << doc.dump(2) << std::endl;
+  } else {
+    std::ofstream os(jsonPath);
+    if (!(os << doc.dump(2) << std::endl)) {
+      fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include "bench.h"
+
+#include <core/opcontext.h>
+#include <core/opdesc.h>
+#include <core/opgraph.h>
+#include <core/oparg.h>
+#include <core/ophelper.h>
+
+#include <fmt/format.h>
+
+#include <filesystem>
+#include <memory>
+
+BEGIN_JOYFLOW_NAMESPACE
+namespace bench {
+
+// Source {{{
+class BenchSource : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<BenchSource>("bench_source")
+      .numRequiredInput(0)
+      .argDescs({
+          ArgDescBuilder("rows").type(ArgType::INT).defaultExpression(0, "1024"),
+          ArgDescBuilder("tables").type(ArgType::INT).defaultExpression(0, "1"),
+          ArgDescBuilder("seed").type(ArgType::INT).defaultExpression(0, "42"),
+      });
+  }
+
+  void eval(OpContext& ctx) const override
+  {
+    ctx.setOutputData(0, makeTestData(size_t(ctx.arg("rows").asInt()),
+                                      ctx.arg("tables").asInt(),
+                                      uint32_t(ctx.arg("seed").asInt())));
+  }
+};
+// }}}
+
+void registerBenchOps()
+{
+  OpRegistry::instance().add(BenchSource::desc());
+}
+
+/// a graph with one "bench_source" node, ops under test are appended to it
+struct OpFixture
+{
+  std::unique_ptr<OpGraph> graph;
+  String                   source;
+
+  OpFixture(size_t rows, sint tables = 1) : graph(newGraph("bench"))
+  {
+    source = graph->addNode("bench_source", "source");
+    graph->node(source)->mutArg("rows").setInt(sint(rows));
+    graph->node(source)->mutArg("tables").setInt(tables);
+  }
+
+  String add(String const& optype, String const& upstream)
+  {
+    auto name = graph->addNode(optype, optype);
+    graph->link(upstream, 0, name, 0);
+    return name;
+  }
+
+  /// re-evaluate `name` once per repetition, its upstream stays cached
+  void measure(Bench& bench, String const& name)
+  {
+    graph->evalNode(name); // creates the contexts
+    bench.measure([&] { graph->node(name)->context()->markDirty(true); },
+                  [&] { graph->evalNode(name); });
+  }
+};
+
+} // namespace bench
+END_JOYFLOW_NAMESPACE
+
+using namespace joyflow;
+
+BENCHMARK("op", "sort")
+{
+  bench::OpFixture fixture(bench::defaultRows());
+  auto sort = fixture.add("sort", fixture.source);
+  fixture.graph->node(sort)->mutArg("key").setString("id");
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, sort);
+}
+
+BENCHMARK("op", "sort strings")
+{
+  bench::OpFixture fixture(bench::defaultRows());
+  auto sort = fixture.add("sort", fixture.source);
+  fixture.graph->node(sort)->mutArg("key").setString("name");
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, sort);
+}
+
+BENCHMARK("op", "split")
+{
+  bench::OpFixture fixture(bench::defaultRows());
+  auto split = fixture.add("split", fixture.source);
+  fixture.graph->node(split)->mutArg("condition").setString(fmt::format("${{id}}<{}", bench::defaultRows() / 2));
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, split);
+}
+
+BENCHMARK("op", "match")
+{
+  bench::OpFixture fixture(bench::defaultRows(), 2);
+  auto  match = fixture.add("match", fixture.source);
+  auto* node  = fixture.graph->node(match);
+  node->mutArg("dsttable").setMenu(0);
+  node->mutArg("srctable").setMenu(1);
+  node->mutArg("dstcolmatch").setString("id");
+  node->mutArg("srccolmatch").setString("id");
+  node->mutArg("colimport").setString("P");
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, match);
+}
+
+BENCHMARK("op", "string_cast")
+{
+  bench::OpFixture fixture(bench::defaultRows());
+  auto cast = fixture.add("string_cast", fixture.source);
+  fixture.graph->node(cast)->mutArg("dst_type").setMenu("int32");
+  fixture.graph->node(cast)->mutArg("columns").setStringList({"name"});
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, cast);
+}
+
+static String benchCSVPath()
+{
+  return (std::filesystem::temp_directory_path() / "joyflow_bench.csv").string();
+}
+
+BENCHMARK("op", "csv_writer")
+{
+  if (!OpRegistry::instance().get("csv_writer"))
+    return;
+  bench::OpFixture fixture(bench::defaultRows());
+  auto writer = fixture.add("csv_writer", fixture.source);
+  fixture.graph->node(writer)->mutArg("file").setString(benchCSVPath());
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, writer);
+}
+
+BENCHMARK("op", "csv_reader")
+{
+  if (!OpRegistry::instance().get("csv_reader") || !OpRegistry::instance().get("csv_writer"))
+    return;
+  bench::OpFixture fixture(bench::defaultRows());
+  auto writer = fixture.add("csv_writer", fixture.source);
+  auto path   = benchCSVPath();
+  fixture.graph->node(writer)->mutArg("file").setString(path);
+  fixture.graph->evalNode(writer);
+
+  auto reader = fixture.graph->addNode("csv_reader", "csv_reader");
+  fixture.graph->node(reader)->mutArg("file").setString(path);
+  bench.setItems(bench::defaultRows());
+  fixture.measure(bench, reader);
+  std::filesystem::remove(path);
+}
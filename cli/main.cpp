@@ -0,0 +1,387 @@
+// joyflow-run: evaluate a graph without the editor
+#include <core/log.h>
+#include <core/opbuiltin.h>
+#include <core/opcontext.h>
+#include <core/oparg.h>
+#include <core/opgraph.h>
+#include <core/oplib.h>
+#include <core/scheduler.h>
+#include <core/tracer.h>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace joyflow;
+
+static void usage(char const* exe)
+{
+  printf("usage: %s <graph.json> [options] [--<node>.<arg> <value> ...]\n"
+         "  --output <node>     evaluate this node, can be repeated (default: all nodes without downstream)\n"
+         "  --oplib <path>      load an op library, can be repeated (default: the ones in op dir)\n"
+         "  --threads <n>       worker threads (default: $JOYFLOW_WORKER_THREADS or one per core)\n"
+         "  --affinity <cpus>   cpus worker threads may run on, e.g. 0-3,8 (default: $JOYFLOW_CPU_AFFINITY)\n"
+         "  --repeat <n>        evaluate n times from scratch, report timing (default: 1)\n"
+         "  --trace <file>      write Chrome trace of the evaluation\n"
+         "  --no-progress       do not show progress of running nodes (shown when stderr is a terminal)\n"
+         "  --verbose           log more\n"
+         "  --help-args         list arguments of the graph's nodes, which can be set as\n"
+         "                      --<node>.<arg> <value>, tuple components separated by ','\n",
+         exe);
+}
+
+static Vector<String> splitString(String const& str, char sep)
+{
+  Vector<String> parts;
+  size_t         begin = 0;
+  for (size_t end; (end = str.find(sep, begin)) != String::npos; begin = end + 1)
+    parts.push_back(str.substr(begin, end - begin));
+  parts.push_back(str.substr(begin));
+  return parts;
+}
+
+static bool startsWith(String const& str, char const* prefix)
+{
+  return str.rfind(prefix, 0) == 0;
+}
+
+static size_t peakResidentBytes()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize;
+  return 0;
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static OpNode* findNode(OpGraph* graph, String const& path)
+{
+  OpNode* node = graph;
+  for (auto const& part : splitString(path, '/')) {
+    auto* g = dynamic_cast<OpGraph*>(node);
+    if (!g || !(node = g->node(part)))
+      return nullptr;
+  }
+  return node == graph ? nullptr : node;
+}
+
+static char const* argTypeName(ArgType type)
+{
+  static char const* names[] = {"real", "int", "bool", "color", "menu", "multi menu", "string", "code",
+                                "dir", "file", "file", "node", "button", "toggle"};
+  return type < ArgType::COUNT ? names[int(type)] : "?";
+}
+
+static void listArgs(OpGraph* graph, String const& prefix)
+{
+  for (auto const& name : graph->childNames()) {
+    auto* node = graph->node(name);
+    auto  path = prefix.empty() ? name : prefix + "/" + name;
+    printf("%s (%s)\n", path.c_str(), node->optype().c_str());
+    for (size_t i = 0, n = node->argCount(); i < n; ++i) {
+      auto const& desc = node->arg(sint(i)).desc();
+      if (desc.type == ArgType::BUTTON)
+        continue;
+      String value;
+      for (int e = 0; e < desc.tupleSize; ++e)
+        value += (e ? "," : "") + node->arg(sint(i)).getRawExpr(e);
+      printf("  --%s.%s <%s%s>  = %s%s%s\n", path.c_str(), desc.name.c_str(), argTypeName(desc.type),
+             desc.tupleSize > 1 ? fmt::format("[{}]", desc.tupleSize).c_str() : "", value.c_str(),
+             desc.description.empty() ? "" : "  # ", desc.description.c_str());
+    }
+    if (auto* subgraph = dynamic_cast<OpGraph*>(node))
+      listArgs(subgraph, path);
+  }
+}
+
+/// from scratch: every node evaluates again
+static void markAllDirty(OpGraph* graph)
+{
+  for (auto const& name : graph->childNames()) {
+    auto* node = graph->node(name);
+    if (auto* ctx = node->context())
+      ctx->markDirty(true);
+    if (auto* subgraph = dynamic_cast<OpGraph*>(node))
+      markAllDirty(subgraph);
+  }
+}
+
+static bool stderrIsTerminal()
+{
+#ifdef _WIN32
+  return _isatty(_fileno(stderr));
+#else
+  return isatty(fileno(stderr));
+#endif
+}
+
+/// polls progress of running nodes and shows it as one line on stderr, until destroyed
+class ProgressLine
+{
+  Vector<Pair<String, OpContext*>> contexts_;
+  std::atomic<bool>                stop_{false};
+  std::thread                      thread_;
+
+public:
+  /// contexts are created up front, evaluation then keeps them in place while polled
+  explicit ProgressLine(OpGraph* graph)
+  {
+    for (auto const& name : graph->childNames()) {
+      auto* node = graph->node(name);
+      if (!node->context())
+        node->newContext();
+      contexts_.push_back({name, node->context()});
+    }
+    thread_ = std::thread([this] { run(); });
+  }
+  ~ProgressLine()
+  {
+    stop_.store(true);
+    thread_.join();
+  }
+
+private:
+  void run()
+  {
+    size_t shown = 0;
+    while (!stop_.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      String line;
+      for (auto const& [name, ctx] : contexts_) {
+        real const fraction = ctx->progress();
+        if (fraction <= 0 || fraction >= 1)
+          continue;
+        auto const message = ctx->progressMessage();
+        line += fmt::format("{}{}: {:.0f}%{}{}", line.empty() ? "" : "  ", name, fraction * 100,
+                            message.empty() ? "" : " ", message);
+      }
+      if (line.size() > 120)
+        line = line.substr(0, 117) + "...";
+      fprintf(stderr, "\r%-*s", int(shown), line.c_str());
+      shown = line.size();
+    }
+    fprintf(stderr, "\r%-*s\r", int(shown), "");
+  }
+};
+
+/// `--node.arg value`, value is taken as expression, like what's stored in graph files
+static bool overrideArg(OpGraph* graph, String const& key, String const& value)
+{
+  auto const dot = key.rfind('.');
+  if (dot == String::npos)
+    return false;
+  auto* node = findNode(graph, key.substr(0, dot));
+  if (!node) {
+    spdlog::error("no node named \"{}\"", key.substr(0, dot));
+    return false;
+  }
+  auto const argname = key.substr(dot + 1);
+  if (node->argIndex(argname) < 0) {
+    spdlog::error("node \"{}\" has no argument named \"{}\"", node->name(), argname);
+    return false;
+  }
+  auto& arg  = node->mutArg(argname);
+  auto  type = arg.desc().type;
+  if (type == ArgType::MULTI_MENU) {
+    arg.setStringList(splitString(value, ','));
+  } else if (arg.desc().tupleSize > 1) {
+    auto parts = splitString(value, ',');
+    for (int e = 0; e < std::min(int(parts.size()), arg.desc().tupleSize); ++e)
+      arg.setRawExpr(parts[e], e);
+  } else {
+    arg.setRawExpr(value);
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  auto logger = spdlog::stderr_color_mt("joyflow");
+  logger->set_level(spdlog::level::warn);
+  setLogger(logger);
+
+  String                            graphPath, tracePath;
+  Vector<String>                    outputs, oplibs;
+  Vector<std::pair<String, String>> overrides;
+  SchedulerConfig                   schedulerConfig = Scheduler::config();
+  sint                              repeat   = 1;
+  bool                              helpArgs = false;
+  bool                              progress = stderrIsTerminal();
+  for (int i = 1; i < argc; ++i) {
+    String const arg     = argv[i];
+    bool const   hasNext = i + 1 < argc;
+    if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else if (arg == "--output" && hasNext) {
+      outputs.push_back(argv[++i]);
+    } else if (arg == "--oplib" && hasNext) {
+      oplibs.push_back(argv[++i]);
+    } else if (arg == "--threads" && hasNext) {
+      schedulerConfig.workerThreads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--affinity" && hasNext) {
+      try {
+        schedulerConfig.affinity = Scheduler::parseCpuList(argv[++i]);
+      } catch (std::exception const& e) {
+        spdlog::error("bad --affinity: {}", e.what());
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (arg == "--repeat" && hasNext) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--trace" && hasNext) {
+      tracePath = argv[++i];
+    } else if (arg == "--no-progress") {
+      progress = false;
+    } else if (arg == "--verbose") {
+      logger->set_level(spdlog::level::info);
+    } else if (arg == "--help-args") {
+      helpArgs = true;
+    } else if (startsWith(arg, "--") && arg.find('.') != String::npos) {
+      if (auto eq = arg.find('='); eq != String::npos)
+        overrides.emplace_back(arg.substr(2, eq - 2), arg.substr(eq + 1));
+      else if (hasNext)
+        overrides.emplace_back(arg.substr(2), argv[++i]);
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (graphPath.empty() && !startsWith(arg, "-")) {
+      graphPath = arg;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (graphPath.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Scheduler::configure(schedulerConfig);
+  registerBuiltinOps();
+  if (oplibs.empty()) {
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(defaultOpDir(), ec)) {
+      auto const ext = entry.path().extension().string();
+      if (ext == ".so" || ext == ".dll" || ext == ".dylib")
+        oplibs.push_back(entry.path().string());
+    }
+  }
+  for (auto const& lib : oplibs)
+    if (!openOpLib(lib))
+      spdlog::warn("failed to load op library {}", lib);
+
+  std::unique_ptr<OpGraph> graph(newGraph("root"));
+  graph->newContext();
+  try {
+    std::ifstream file(graphPath);
+    if (!file) {
+      spdlog::error("cannot open {}", graphPath);
+      return 1;
+    }
+    if (!graph->load(Json::parse(file))) {
+      spdlog::error("failed to load graph from {}", graphPath);
+      return 1;
+    }
+  } catch (std::exception const& e) {
+    spdlog::error("failed to load graph from {}: {}", graphPath, e.what());
+    return 1;
+  }
+
+  if (helpArgs) {
+    listArgs(graph.get(), "");
+    return 0;
+  }
+  for (auto const& [key, value] : overrides)
+    if (!overrideArg(graph.get(), key, value))
+      return 1;
+
+  if (outputs.empty()) {
+    for (auto const& name : graph->childNames()) {
+      bool hasDownstream = false;
+      for (auto const& pinset : graph->node(name)->downstreams())
+        hasDownstream |= !pinset.empty();
+      if (!hasDownstream)
+        outputs.push_back(name);
+    }
+  }
+  for (auto const& name : outputs) {
+    if (!graph->node(name)) {
+      spdlog::error("no node named \"{}\"", name);
+      return 1;
+    }
+  }
+
+  Tracer::setEnabled(!tracePath.empty());
+  int    failures = 0;
+  sint   runs     = 0;
+  double total    = 0;
+  for (sint rep = 0; rep < repeat; ++rep, ++runs) {
+    markAllDirty(graph.get());
+
+    auto const start = std::chrono::steady_clock::now();
+    for (auto const& name : outputs) {
+      DataCollectionPtr result;
+      {
+        std::unique_ptr<ProgressLine> progressLine(progress ? new ProgressLine(graph.get()) : nullptr);
+        result = graph->evalNode(name);
+      }
+      auto* ctx   = graph->node(name)->context();
+      if (ctx && ctx->lastError() >= OpErrorLevel::ERROR) {
+        fprintf(stderr, "%s: %s\n", name.c_str(), ctx->errorMessage().c_str());
+        ++failures;
+      } else if (rep == 0) {
+        size_t rows = 0;
+        for (sint t = 0, nt = result ? result->numTables() : 0; t < nt; ++t)
+          rows += result->numRows(t);
+        printf("%s: %zd tables, %zu rows\n", name.c_str(), result ? result->numTables() : 0, rows);
+      }
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    total += seconds;
+    if (repeat > 1)
+      printf("run %zd: %.3f ms\n", rep + 1, seconds * 1e3);
+    if (failures) {
+      ++runs;
+      break;
+    }
+  }
+
+  if (repeat > 1 || logger->should_log(spdlog::level::info)) {
+    printf("\n%s", metricsReport(graph.get()).c_str());
+    printf("\nmean %.3f ms per run, peak memory %.1f MB\n", total / std::max<sint>(runs, 1) * 1e3,
+           peakResidentBytes() / (1024.0 * 1024.0));
+  }
+  if (!tracePath.empty() && !Tracer::dump(tracePath))
+    spdlog::error("cannot write trace to {}", tracePath);
+  return failures ? 2 : 0;
+}
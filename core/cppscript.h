@@ -0,0 +1,43 @@
+#pragma once
+
+#include "def.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+class OpKernel;
+
+struct CppScriptConfig
+{
+  String compiler;  //< gcc / clang style command line compiler
+  String flags;     //< appended to the compiler's command line
+  String sourceDir; //< joyflow source tree, headers are included from there
+  String cacheDir;  //< compiled scripts are kept here
+};
+
+/// Compilation of `cpp` script ops
+///
+/// The code block of a `cpp` node becomes the body of a kernel's `eval(OpContext& ctx)`,
+/// with `DataCollection* data` prepared like in `lua` nodes. It is compiled into a
+/// shared library with the system compiler and loaded as an op library, libraries
+/// are cached by hash of source and command line and stay loaded until exit.
+/// Initial config comes from environment:
+///   JOYFLOW_CXX=<compiler>      default: the compiler joyflow was built with
+///   JOYFLOW_CXXFLAGS=<flags>
+///   JOYFLOW_SOURCE_DIR=<dir>    default: the tree joyflow was built from
+///   JOYFLOW_CPP_CACHE=<dir>     default: <temp dir>/joyflow-cpp
+class CORE_API CppScript
+{
+public:
+  static void            configure(CppScriptConfig const& config);
+  static CppScriptConfig config();
+
+  /// the library source `code` is wrapped in
+  static String source(String const& code);
+  /// path of the library built from `code`, compiled unless found in cache,
+  /// throws ExecutionError with the compiler's output when compilation fails
+  static String build(String const& code);
+  /// new kernel from the library built from `code`, owned by the caller
+  static OpKernel* newKernel(String const& code);
+};
+
+END_JOYFLOW_NAMESPACE
@@ -790,6 +790,8 @@ public:
 
   /// reserve space for `length` objects
   virtual void                     reserve(size_t length) = 0;
+  /// allocate room for `length` objects without filling it, for growing in steps
+  virtual void                     reserveCapacity(size_t length) { (void)length; }
 
   virtual NumericDataInterface*    asNumericData() { return nullptr; }
   virtual FixSizedDataInterface*   asFixSizedData() { return nullptr; }
@@ -871,6 +873,9 @@ public:
 
   /// memory statistics
   virtual void countMemory(size_t& sharedBytes, size_t& unsharedBytes) const = 0;
+  /// bytes of storage not in `counted` yet, which gets it added,
+  /// so storage shared by several columns is counted once
+  virtual size_t countMemory(HashSet<void const*>& counted) const = 0;
 
 public:
   /// preview data
@@ -1011,6 +1016,10 @@ public:
   virtual DataColumn* getColumn(String const& name) = 0;
   virtual DataColumn const* getColumn(String const& name) const = 0;
 
+  /// column to be written: makes this table and the column unique,
+  /// returns nullptr if no such column
+  virtual DataColumn* mutColumn(String const& name) = 0;
+
   virtual DataColumn* setColumn(String const& name, DataColumn* col) = 0;
   
   virtual DataColumn* createColumn(String const& name,
@@ -1144,6 +1153,10 @@ public:
 
   virtual size_t numIndices() const = 0;
 
+  /// changes whenever rows or columns of this table are added, removed, renamed or reordered,
+  /// when the table gets shared or copied, or when a column's storage is copied by `mutColumn`
+  virtual size_t structureVersion() const = 0;
+
   /// defragment: remove holes and make data packed dense
   virtual void defragment() = 0;
 
@@ -1179,9 +1192,13 @@ public:
   /// join two tables together, `this` before that
   /// `this` should be unique
   virtual void join(DataTable const* that) = 0;
+  /// join all of them after `this`, in order; columns are joined in parallel
+  virtual void join(Vector<DataTable const*> const& those) = 0;
 
   /// memory statistics
   virtual void countMemory(size_t& sharedBytes, size_t& unsharedBytes) const = 0;
+  /// bytes not in `counted` yet, see `DataColumn::countMemory(counted)`
+  virtual size_t countMemory(HashSet<void const*>& counted) const = 0;
 
   /// meta
   virtual HashMap<String, std::any> const& vars() const = 0;
@@ -1228,8 +1245,12 @@ public:
   virtual DataCollectionPtr share() = 0;
 
   virtual void join(DataCollection const* that) = 0;
+  /// join all of them after `this`, in order, table by table
+  virtual void join(Vector<DataCollection const*> const& those) = 0;
 
   virtual void countMemory(size_t& sharedBytes, size_t& unsharedBytes) const = 0;
+  /// bytes not in `counted` yet, see `DataColumn::countMemory(counted)`
+  virtual size_t countMemory(HashSet<void const*>& counted) const = 0;
 
   // easy accessors {{{
 
@@ -0,0 +1,270 @@
+#include "../cppscript.h"
+#include "../error.h"
+#include "../opkernel.h"
+#include "../oplib.h"
+#include "../profiler.h"
+
+#include "evalscope.h"
+
+#include <marl/blocking_call.h>
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#define JOYFLOW_GETPID _getpid
+#else
+#include <unistd.h>
+#define JOYFLOW_GETPID getpid
+#endif
+
+BEGIN_JOYFLOW_NAMESPACE
+
+#ifndef JOYFLOW_SOURCE_DIR
+#define JOYFLOW_SOURCE_DIR ""
+#endif
+
+#if defined(__clang__)
+static constexpr char const* DEFAULT_CXX = "clang++";
+#elif defined(__GNUC__)
+static constexpr char const* DEFAULT_CXX = "g++";
+#else
+static constexpr char const* DEFAULT_CXX = "c++";
+#endif
+
+#ifdef _WIN32
+static constexpr char const* LIB_SUFFIX = ".dll";
+#elif defined(__APPLE__)
+static constexpr char const* LIB_SUFFIX = ".dylib";
+#else
+static constexpr char const* LIB_SUFFIX = ".so";
+#endif
+
+/// what joyflow itself was built with, `openOpLib` refuses libraries of other build types
+static char const* buildFlags()
+{
+#if defined SANITIZE
+  return "-g -DDEBUG -DSANITIZE -fsanitize=address";
+#elif defined PROFILE
+  return "-O2 -g -DNDEBUG -DPROFILE";
+#elif defined NDEBUG
+  return "-O2 -DNDEBUG";
+#else
+  return "-g -DDEBUG -D_DEBUG";
+#endif
+}
+
+static CppScriptConfig configFromEnvironment()
+{
+  CppScriptConfig config;
+  auto const* cxx = std::getenv("JOYFLOW_CXX");
+  config.compiler = cxx ? cxx : DEFAULT_CXX;
+  if (auto const* flags = std::getenv("JOYFLOW_CXXFLAGS"))
+    config.flags = flags;
+  auto const* srcdir = std::getenv("JOYFLOW_SOURCE_DIR");
+  config.sourceDir   = srcdir ? srcdir : JOYFLOW_SOURCE_DIR;
+  if (auto const* cache = std::getenv("JOYFLOW_CPP_CACHE")) {
+    config.cacheDir = cache;
+  } else {
+    std::error_code ec;
+    auto const      tmp = std::filesystem::temp_directory_path(ec);
+    config.cacheDir     = ec ? "joyflow-cpp" : (tmp / "joyflow-cpp").string();
+  }
+  return config;
+}
+
+static std::mutex s_cppScriptMutex; // guards config, build locks and loaded libraries
+
+static CppScriptConfig& cppScriptConfig()
+{
+  static CppScriptConfig config = configFromEnvironment();
+  return config;
+}
+
+static std::set<String>& loadedScriptLibs()
+{
+  static std::set<String> libs;
+  return libs;
+}
+
+/// one lock per library, builds of different scripts run side by side
+static std::shared_ptr<std::mutex> buildLock(uint64_t key)
+{
+  static HashMap<uint64_t, std::shared_ptr<std::mutex>> locks;
+  std::lock_guard lock(s_cppScriptMutex);
+  auto& mutex = locks[key];
+  if (!mutex)
+    mutex = std::make_shared<std::mutex>();
+  return mutex;
+}
+
+static String compileCommand(CppScriptConfig const& config, String const& source, String const& output)
+{
+  String includes;
+  if (!config.sourceDir.empty()) {
+    auto const root = std::filesystem::path(config.sourceDir);
+    for (auto const* dir : {"core", "deps/fmt/include", "deps/glm", "deps/json", "deps/mimalloc/include",
+                            "deps/spdlog/include", "deps/hedley", "deps/tracy", "deps/optick/src"})
+      includes += fmt::format(" -I\"{}\"", (root / dir).string());
+  }
+  return fmt::format("{} -std=c++17 -shared -fPIC {} -DSPDLOG_COMPILED_LIB -DSPDLOG_FMT_EXTERNAL -DFMT_SHARED{}{} {} "
+                     "-o \"{}\" \"{}\"",
+                     config.compiler, buildFlags(), includes,
+#ifdef __APPLE__
+                     " -undefined dynamic_lookup",
+#else
+                     "",
+#endif
+                     config.flags, output, source);
+}
+
+/// compiles `src` to `libpath` unless some other build got there first
+static void compileScript(CppScriptConfig const& config, String const& src, std::filesystem::path const& base,
+                          String const& libpath)
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (fs::exists(libpath, ec))
+    return;
+  fs::create_directories(config.cacheDir, ec);
+  if (ec)
+    throw ExecutionError(fmt::format("cpp: cannot create cache directory \"{}\": {}", config.cacheDir, ec.message()));
+  auto const srcpath = base.string() + ".cpp";
+  auto const logpath = base.string() + ".log";
+  // other processes may be building the same script, only a finished library gets the final name
+  auto const tmppath = fmt::format("{}.{}{}", base.string(), JOYFLOW_GETPID(), LIB_SUFFIX);
+  {
+    std::ofstream file(srcpath, std::ios::binary);
+    file << src;
+    if (!file)
+      throw ExecutionError(fmt::format("cpp: cannot write \"{}\"", srcpath));
+  }
+  auto const cmdline = fmt::format("{} > \"{}\" 2>&1", compileCommand(config, srcpath, tmppath), logpath);
+  spdlog::info("cpp: {}", cmdline);
+  if (std::system(cmdline.c_str()) != 0) {
+    std::ifstream     log(logpath, std::ios::binary);
+    std::stringstream output;
+    output << log.rdbuf();
+    fs::remove(tmppath, ec);
+    throw ExecutionError(fmt::format("cpp: compilation failed\n{}", output.str()));
+  }
+  fs::rename(tmppath, libpath, ec);
+  if (ec)
+    throw ExecutionError(fmt::format("cpp: cannot move \"{}\" to \"{}\": {}", tmppath, libpath, ec.message()));
+}
+
+void CppScript::configure(CppScriptConfig const& config)
+{
+  std::lock_guard lock(s_cppScriptMutex);
+  cppScriptConfig() = config;
+}
+
+CppScriptConfig CppScript::config()
+{
+  std::lock_guard lock(s_cppScriptMutex);
+  return cppScriptConfig();
+}
+
+String CppScript::source(String const& code)
+{
+  return fmt::format(R"(// generated from a `cpp` node
+#include <oplib.h>
+#include <ophelper.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace joyflow;
+
+DECL_OPLIB();
+IMPL_OPLIB();
+
+namespace {{
+class CppScriptKernel : public OpKernel
+{{
+public:
+  void eval(OpContext& ctx) const override
+  {{
+    DataCollection* in   = ctx.hasInput(0) ? ctx.fetchInputData(0) : nullptr;
+    DataCollection* data = nullptr;
+    if (in) {{
+      data = ctx.copyInputToOutput(0, 0);
+      for (sint i = 0, n = data->numTables(); i < n; ++i)
+        data->getTable(i)->makeUnique();
+    }} else {{
+      data = ctx.reallocOutput(0);
+    }}
+    (void)data;
+#line 1 "cpp"
+{}
+  }}
+}};
+}} // namespace
+
+OPLIB_API void openLib() {{}}
+OPLIB_API void closeLib() {{}}
+OPLIB_API OpKernel* newCppScriptKernel() {{ return new CppScriptKernel; }}
+)",
+                     code);
+}
+
+String CppScript::build(String const& code)
+{
+#ifdef _MSC_VER
+  throw Unimplemented("cpp scripts need a gcc or clang style compiler");
+#endif
+  PROFILER_SCOPE("cpp build", 0xA8D8EA);
+  auto const config  = CppScript::config();
+  auto const src     = source(code);
+  auto const command = compileCommand(config, "", "");
+  auto const key     = XXH64(src.data(), src.size(), XXH64(command.data(), command.size(), DF_CORE_VERSION));
+
+  namespace fs = std::filesystem;
+  auto const base    = fs::path(config.cacheDir) / fmt::format("{:016x}", key);
+  auto const libpath = base.string() + LIB_SUFFIX;
+  std::error_code ec;
+  if (fs::exists(libpath, ec))
+    return libpath;
+
+  // the compiler runs for seconds: on a thread of its own, not on a worker of the scheduler
+  auto const keyLock = buildLock(key);
+  detail::EvalSuspendScope suspend;
+  auto const failure = marl::blocking_call([&]() -> std::exception_ptr {
+    try {
+      std::lock_guard lock(*keyLock);
+      compileScript(config, src, base, libpath);
+      return nullptr;
+    } catch (...) { // must not leave the thread
+      return std::current_exception();
+    }
+  });
+  if (failure)
+    std::rethrow_exception(failure);
+  return libpath;
+}
+
+OpKernel* CppScript::newKernel(String const& code)
+{
+  auto const libpath = build(code);
+  std::lock_guard lock(s_cppScriptMutex);
+  if (!loadedScriptLibs().count(libpath)) {
+    if (!openOpLib(libpath))
+      throw ExecutionError(fmt::format("cpp: cannot load \"{}\"", libpath));
+    loadedScriptLibs().insert(libpath);
+  }
+  auto* factory = reinterpret_cast<OpKernel* (*)()>(opLibSymbol(libpath, "newCppScriptKernel"));
+  if (!factory)
+    throw ExecutionError(fmt::format("cpp: \"{}\" has no kernel", libpath));
+  return factory();
+}
+
+END_JOYFLOW_NAMESPACE
@@ -98,6 +98,17 @@ public:
     }
   }
 
+  size_t countMemory(HashSet<void const*>& counted) const
+  {
+    if (!counted.insert(this).second)
+      return 0;
+    size_t bytes = sizeof(blobs_) + blobs_.keys().capacity() * (sizeof(String)+sizeof(SharedBlobPtr));
+    for (auto const& b: blobs_)
+      if (b && counted.insert(b.get()).second)
+        bytes += b->size;
+    return bytes;
+  }
+
 protected:
   struct KeyHash
   {
@@ -303,6 +314,12 @@ public:
 
   size_t length() const override { return idsInsideStorage_->size(); }
 
+  void reserveCapacity(size_t length) override
+  {
+    ASSERT(isUnique());
+    idsInsideStorage_->reserve(length);
+  }
+
   void reserve(size_t length) override
   {
     ASSERT(isUnique());
@@ -436,6 +453,10 @@ public:
     PROFILER_SCOPE_DEFAULT();
     storage_          = new BlobStorage(*storage_);
     idsInsideStorage_ = new SharedVector<size_t>(*idsInsideStorage_);
+    // blobs themselves are shared, SharedVector counts the ids
+    size_t sharedBytes = 0, copiedBytes = 0;
+    storage_->countMemory(sharedBytes, copiedBytes);
+    Stats::addCopiedBytes(copiedBytes);
   }
 
   bool isUnique() const override { return idsInsideStorage_->refcnt() == 1; }
@@ -489,6 +510,14 @@ public:
     }
   }
 
+  size_t countMemory(HashSet<void const*>& counted) const override
+  {
+    size_t bytes = sizeof(*this) + storage_->countMemory(counted);
+    if (counted.insert(idsInsideStorage_.get()).second)
+      bytes += idsInsideStorage_->capacity() * sizeof(size_t);
+    return bytes;
+  }
+
 protected:
   bool setBlobData(CellIndex index, void const* data, size_t size) override
   {
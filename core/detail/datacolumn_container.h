@@ -250,6 +250,15 @@ public:
       sharedBytes += datasize;
   }
 
+  size_t countMemory(HashSet<void const*>& counted) const override
+  {
+    size_t bytes = sizeof(*this);
+    if (counted.insert(lists_.get()).second)
+      for (auto const& v: *lists_)
+        bytes += v.capacity();
+    return bytes;
+  }
+
 protected:
   IntrusivePtr<SharedVector<Vector<byte>>> lists_;
   ContainerDataInterfaceImpl               interface_;
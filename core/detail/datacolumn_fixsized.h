@@ -292,6 +292,14 @@ public:
       sharedBytes += datasize;
   }
 
+  size_t countMemory(HashSet<void const*>& counted) const override
+  {
+    size_t bytes = sizeof(*this) + desc_.elemSize;
+    if (counted.insert(objects_.get()).second)
+      bytes += objects_->size();
+    return bytes;
+  }
+
 protected:
   StructuredDataColumnImpl(StructuredDataColumnImpl const& that)
       : DataColumn(that.name(), that.desc())
@@ -440,6 +440,15 @@ public:
     length_ = length;
   }
 
+  void reserveCapacity(size_t length) override
+  {
+    RUNTIME_CHECK(isUnique(), "Trying to modify shared column \"{}\", refcnt = {}", name_, storage_->refcnt());
+    storage_->reserve(length * tupleSize());
+  }
+
+  /// objects fitting in allocated storage
+  size_t capacity() const { return storage_->capacity() / desc_.tupleSize; }
+
   void resize(size_t length)
   {
     RUNTIME_CHECK(isUnique(), "Trying to modify shared column \"{}\", refcnt = {}", name_, storage_->refcnt());
@@ -679,6 +688,7 @@ public:
         default:
           throw TypeError("got unconvertable format at column join");
         }
+        wd->reserveCapacity(std::max(newlength, capacity())); // keep room for joins to come
         wd->reserve(newlength);
         convertAndCopyContent(wd, 0, this, 0, length());
       } else {
@@ -736,6 +746,14 @@ public:
       sharedBytes += datasize;
   }
 
+  size_t countMemory(HashSet<void const*>& counted) const override
+  {
+    size_t bytes = sizeof(*this);
+    if (counted.insert(storage_.get()).second)
+      bytes += storage_->capacity() * sizeof(T);
+    return bytes;
+  }
+
 protected:
   NumericDataColumnImpl(NumericDataColumnImpl const& that)
       : DataColumn(that.name(), that.desc())
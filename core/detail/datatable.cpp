@@ -3,6 +3,8 @@
 #include "datacolumn_fixsized.h"
 #include "datacolumn_container.h"
 #include "datacolumn_blob.h"
+#include "runtime.h"
+#include "../tracer.h"
 
 BEGIN_JOYFLOW_NAMESPACE
 
@@ -299,6 +301,7 @@ CellIndex DataTableImpl::addRow()
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   size_t size = numIndices();
   for (auto col : *columns_) {
     col->makeUnique();
@@ -311,6 +314,7 @@ CellIndex DataTableImpl::addRows(size_t n)
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   size_t size = numIndices();
   for (auto col : *columns_) {
     col->makeUnique();
@@ -323,6 +327,7 @@ void DataTableImpl::markRemoval(sint row)
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   indexMap_->markRemoval(row);
 }
 
@@ -330,6 +335,7 @@ void DataTableImpl::applyRemoval()
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   indexMap_->applyRemoval();
 }
 
@@ -337,6 +343,7 @@ void DataTableImpl::removeRow(sint row)
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   indexMap_->removeRow(row);
 }
 
@@ -344,14 +351,17 @@ size_t DataTableImpl::removeRows(sint row, size_t n)
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   return indexMap_->removeRows(row, n);
 }
 
 void DataTableImpl::defragment()
 {
   PROFILER_SCOPE("defragment", 0xf9723d);
+  TRACE_SCOPE("defragment");
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   DefragmentInfo defrag;
   if (indexMap_->defragment(defrag))
     for (auto column : *columns_) {
@@ -366,6 +376,7 @@ DataColumn* DataTableImpl::createColumn(String const& name,
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   RUNTIME_CHECK(desc.isValid(), "invalid column desc");
   DataColumn* column = nullptr;
   if (!overwriteExisting) {
@@ -415,6 +426,7 @@ bool DataTableImpl::renameColumn(String const& oldName, String const& newName, b
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   auto* colptr = columns_->find(oldName);
   if (colptr == nullptr)
     return false;
@@ -434,6 +446,7 @@ bool DataTableImpl::removeColumn(String const& name)
 {
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
+  ++structureVersion_;
   if (columns_->find(name) == nullptr)
     return false;
   columns_->remove(name);
@@ -442,47 +455,89 @@ bool DataTableImpl::removeColumn(String const& name)
 }
 
 void DataTableImpl::join(DataTable const* that)
+{
+  join(Vector<DataTable const*>{that});
+}
+
+void DataTableImpl::join(Vector<DataTable const*> const& those)
 {
   PROFILER_SCOPE_DEFAULT();
   // RUNTIME_CHECK(isUnique(), "try to modify a shared table");
   makeUnique();
-  DataTableImpl const* their = static_cast<DataTableImpl const*>(that);
-  size_t const oldlength = numIndices();
-
-  // first process columns in our table
-  for (size_t i=0, n=columns_->size(); i<n; ++i) {
-    String const& key = columns_->key(i);
-    (*columns_)[i]->makeUnique();
-    if (auto* c=their->getColumn(key)) {
-      (*columns_)[i] = (*columns_)[i]->join(c);
-    } else {
-      (*columns_)[i]->reserve(oldlength+their->numIndices());
-    }
-  }
+  ++structureVersion_;
+  Vector<DataTableImpl const*> theirs;
+  Vector<size_t>               lengthBefore; // our length before joining each of them
+  size_t                       total = numIndices();
+  for (auto const* that : those) {
+    if (!that)
+      continue;
+    theirs.push_back(static_cast<DataTableImpl const*>(that));
+    lengthBefore.push_back(total);
+    total += that->numIndices();
+  }
+  if (theirs.empty())
+    return;
 
-  // then merge columns that doesn't exist in our table
-  for (size_t i=0, n=their->columns_->size(); i<n; ++i) {
-    String const& key = their->columns_->key(i);
-    if (auto* c=getColumn(key)) {
-      // already processed above, now pass
-    } else {
-      // create a new column that matches them
-      auto theirClone = their->getColumn(key)->clone();
-      theirClone->reserve(oldlength+their->numIndices());
-      theirClone->move(CellIndex(oldlength), CellIndex(0), their->numIndices());
-      columns_->insert(key, theirClone);
-    }
-  }
-  indexMap_->join(*static_cast<DataTableImpl const*>(their)->indexMap_);
-  for (auto const& kv : *their->varMap_) {
-    if (varMap_->find(kv.first) == varMap_->end()) {
-      varMap_->insert(kv);
+  // our columns first, then theirs that we don't have, in order of appearance
+  Vector<String> keys;
+  for (size_t i = 0, n = columns_->size(); i < n; ++i)
+    if ((*columns_)[i])
+      keys.push_back(columns_->key(i));
+  for (auto const* their : theirs)
+    for (size_t i = 0, n = their->columns_->size(); i < n; ++i)
+      if (auto const& key = their->columns_->key(i); std::find(keys.begin(), keys.end(), key) == keys.end())
+        keys.push_back(key);
+
+  // columns are independent, each is joined with all of theirs by one job,
+  // allocating the final size once
+  Vector<DataColumnPtr> joined(keys.size(), nullptr);
+  TaskContext::instance().parallelFor(
+    keys.size(), CostModel::instance().history("datatable.join.column"), real(total - numIndices()),
+    [&](size_t k) {
+      auto const&   key    = keys[k];
+      DataColumnPtr column = nullptr;
+      if (auto* ours = columns_->find(key)) {
+        column = *ours;
+        column->makeUnique();
+        column->reserveCapacity(total);
+      }
+      for (size_t j = 0; j < theirs.size(); ++j) {
+        size_t const lengthAfter = lengthBefore[j] + theirs[j]->numIndices();
+        auto const*  c           = theirs[j]->getColumn(key);
+        if (column && c) {
+          column = column->join(c);
+        } else if (column) {
+          column->reserve(lengthAfter);
+        } else if (c) {
+          // create a new column that matches them
+          column = c->clone();
+          column->reserveCapacity(total);
+          column->reserve(lengthAfter);
+          column->move(CellIndex(lengthBefore[j]), CellIndex(0), theirs[j]->numIndices());
+        }
+      }
+      joined[k] = column;
+    });
+
+  for (size_t k = 0; k < keys.size(); ++k) {
+    if (auto* ours = columns_->find(keys[k]))
+      *ours = joined[k];
+    else
+      columns_->insert(keys[k], joined[k]);
+  }
+  for (auto const* their : theirs) {
+    indexMap_->join(*their->indexMap_);
+    for (auto const& kv : *their->varMap_) {
+      if (varMap_->find(kv.first) == varMap_->end()) {
+        varMap_->insert(kv);
+      }
     }
   }
 }
 
 DataTablePtr DataTableImpl::share()
 {
+  ++structureVersion_; // storage is no longer ours alone
   auto *tb = new DataTableImpl;
   tb->columns_ = columns_;
   tb->indexMap_ = indexMap_;
@@ -507,12 +562,15 @@ void DataTableImpl::makeUnique()
   if (isUnique())
     return;
   PROFILER_SCOPE("MakeUnique", 0xb14b28);
+  TRACE_SCOPE("makeUnique");
+  ++structureVersion_;
   columns_ = std::make_shared<LinearMap<String, DataColumnPtr>>(*columns_);
   for (auto& column: *columns_) {
     column = column->share();
   }
   indexMap_ = std::make_shared<IndexMap>(*indexMap_);
   varMap_ = std::make_shared<HashMap<String, std::any>>(*varMap_);
+  Stats::addCopiedBytes(indexMap_->countMemory());
 }
 
 void DataTableImpl::countMemory(size_t& sharedBytes, size_t& unsharedBytes) const
@@ -536,6 +594,20 @@ void DataTableImpl::countMemory(size_t& sharedBytes, size_t& unsharedBytes) cons
     sharedBytes += indexMap_->countMemory();
   }
 }
+
+size_t DataTableImpl::countMemory(HashSet<void const*>& counted) const
+{
+  size_t bytes = sizeof(*this);
+  if (counted.insert(columns_.get()).second) {
+    bytes += (sizeof(String)+sizeof(DataColumnPtr))*columns_->keys().capacity();
+    for (auto column: *columns_)
+      if (counted.insert(column.get()).second)
+        bytes += column->countMemory(counted);
+  }
+  if (counted.insert(indexMap_.get()).second)
+    bytes += indexMap_->countMemory();
+  return bytes;
+}
 // DataTable Impl }}}
 
 // DataCollection Impl {{{
@@ -598,9 +670,22 @@ DataCollectionImpl::~DataCollectionImpl()
 
 void DataCollectionImpl::join(DataCollection const* that)
 {
-  for (size_t i=0, n=std::min(numTables(), that->numTables()); i<n; ++i) {
-    tables_[i]->join(that->getTable(i));
-  }
+  join(Vector<DataCollection const*>{that});
+}
+
+void DataCollectionImpl::join(Vector<DataCollection const*> const& those)
+{
+  PROFILER_SCOPE_DEFAULT();
+  // tables are independent too, their columns fan out further
+  TaskContext::instance().parallelFor(
+    tables_.size(), CostModel::instance().history("datacollection.join.table"), real(tables_.size()),
+    [&](size_t i) {
+      Vector<DataTable const*> theirs;
+      for (auto const* that : those)
+        if (that && sint(i) < that->numTables())
+          theirs.push_back(that->getTable(sint(i)));
+      tables_[i]->join(theirs);
+    });
 }
 
 void DataCollectionImpl::countMemory(size_t& sharedBytes, size_t& unsharedBytes) const
@@ -618,6 +703,17 @@ void DataCollectionImpl::countMemory(size_t& sharedBytes, size_t& unsharedBytes)
     }
   }
 }
+
+size_t DataCollectionImpl::countMemory(HashSet<void const*>& counted) const
+{
+  if (!counted.insert(this).second)
+    return 0;
+  size_t bytes = sizeof(*this);
+  for (auto const& tb: tables_)
+    if (counted.insert(tb.get()).second)
+      bytes += tb->countMemory(counted);
+  return bytes;
+}
 // }}}
 
 // Object Inspectors for stats {{{
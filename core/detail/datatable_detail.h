@@ -112,6 +112,7 @@ protected:
   std::shared_ptr<LinearMap<String, DataColumnPtr>> columns_;
   std::shared_ptr<IndexMap>                         indexMap_;
   std::shared_ptr<HashMap<String, std::any>>        varMap_;
+  size_t                                            structureVersion_ = 0;
 
   friend class DataCollectionImpl;
 
@@ -146,10 +147,22 @@ public:
     return col->get();
   }
 
+  DataColumn* mutColumn(String const& name) override
+  {
+    makeUnique();
+    auto* col = getColumn(name);
+    if (col && !col->isUnique()) {
+      ++structureVersion_; // storage gets copied
+      col->makeUnique();
+    }
+    return col;
+  }
+
   DataColumn* setColumn(String const& name, DataColumn* col) override
   {
     RUNTIME_CHECK(col->refcnt() <= 1,  "DataTable::setColumn: don't pass me a shared column ptr");
     makeUnique();
+    ++structureVersion_;
     if (col->length() != numIndices()) {
       col->makeUnique();
       col->reserve(numIndices());
@@ -181,6 +194,7 @@ public:
   {
     PROFILER_SCOPE("Sort", 0xf9d367);
     RUNTIME_CHECK(isUnique(), "try to modify a shared table");
+    ++structureVersion_;
     indexMap_->sort(order);
   }
 
@@ -194,6 +208,8 @@ public:
 
   size_t numIndices() const override { return indexMap_->numIndices(); }
 
+  size_t structureVersion() const override { return structureVersion_; }
+
   DataTablePtr share() override;
 
   bool isUnique() const override;
@@ -203,8 +219,10 @@ public:
   void makeUnique() override;
 
   void join(DataTable const* that) override;
+  void join(Vector<DataTable const*> const& those) override;
 
   void countMemory(size_t& sharedBytes, size_t& unsharedBytes) const override;
+  size_t countMemory(HashSet<void const*>& counted) const override;
 
   HashMap<String, std::any> const& vars() const override { return *varMap_; }
   void setVariable(String const& key, std::any const& val) override
@@ -266,8 +284,10 @@ public:
   DataCollectionPtr share() override;
 
   void join(DataCollection const*) override;
+  void join(Vector<DataCollection const*> const& those) override;
 
   void countMemory(size_t& sharedBytes, size_t& unsharedBytes) const override;
+  size_t countMemory(HashSet<void const*>& counted) const override;
 };
 
 // }}} DataCollectionImpl
@@ -285,7 +305,10 @@ public:
   SharedVector(size_t sz) : ReferenceCounted<SharedVector<T>>(), Vector<T>(sz) {}
   SharedVector(SharedVector const& that)
       : ReferenceCounted<SharedVector<T>>(that), Vector<T>(static_cast<Vector<T> const&>(that))
-  {}
+  {
+    // only copied by copy-on-write
+    Stats::addCopiedBytes(this->size() * sizeof(T));
+  }
   OVERRIDE_NEW_DELETE;
 };
 
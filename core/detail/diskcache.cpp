@@ -0,0 +1,514 @@
+#include "diskcache_detail.h"
+#include "opcontext_detail.h"
+
+#include "../datatable.h"
+#include "../opdesc.h"
+#include "../opgraph.h"
+#include "../oparg.h"
+#include "../profiler.h"
+#include "../version.h"
+
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+static constexpr uint32_t DISKCACHE_MAGIC   = 0x4344464A; // "JFDC"
+static constexpr uint32_t DISKCACHE_VERSION = 1;
+
+// Binary IO helpers {{{
+class BinaryWriter
+{
+  std::ostream& os_;
+
+public:
+  BinaryWriter(std::ostream& os) : os_(os) {}
+
+  template<class T>
+  void pod(T const& v)
+  {
+    static_assert(std::is_trivial<T>::value, "only POD can be written");
+    os_.write(reinterpret_cast<char const*>(&v), sizeof(T));
+  }
+  void bytes(void const* data, size_t size)
+  {
+    pod<uint64_t>(size);
+    if (size)
+      os_.write(static_cast<char const*>(data), size);
+  }
+  void raw(void const* data, size_t size)
+  {
+    if (size)
+      os_.write(static_cast<char const*>(data), size);
+  }
+  bool good() const { return os_.good(); }
+};
+
+class BinaryReader
+{
+  std::istream& is_;
+
+public:
+  BinaryReader(std::istream& is) : is_(is) {}
+
+  template<class T>
+  T pod()
+  {
+    static_assert(std::is_trivial<T>::value, "only POD can be read");
+    T v{};
+    raw(&v, sizeof(T));
+    return v;
+  }
+  void raw(void* data, size_t size)
+  {
+    if (size)
+      is_.read(static_cast<char*>(data), size);
+    if (!is_.good())
+      throw ExecutionError("unexpected end of cache file");
+  }
+  void bytes(Vector<byte>& buf)
+  {
+    buf.resize(pod<uint64_t>());
+    raw(buf.data(), buf.size());
+  }
+  String string()
+  {
+    String str(pod<uint64_t>(), '\0');
+    raw(str.data(), str.size());
+    return str;
+  }
+};
+
+static bool getNumericArray(NumericDataInterface const* ni, void* dst, size_t offset, size_t count)
+{
+  size_t len = 0;
+  switch (ni->dataType()) {
+  case DataType::INT32:
+  case DataType::UINT32:
+    return ni->getInt32Array(static_cast<int32_t*>(dst), len, offset, count);
+  case DataType::INT64:
+  case DataType::UINT64:
+    return ni->getInt64Array(static_cast<int64_t*>(dst), len, offset, count);
+  case DataType::FLOAT:
+    return ni->getFloatArray(static_cast<float*>(dst), len, offset, count);
+  case DataType::DOUBLE:
+    return ni->getDoubleArray(static_cast<double*>(dst), len, offset, count);
+  default:
+    return false;
+  }
+}
+
+static bool setNumericArray(NumericDataInterface* ni, void const* src, size_t offset, size_t count)
+{
+  switch (ni->dataType()) {
+  case DataType::INT32:
+  case DataType::UINT32:
+    ni->setInt32Array(static_cast<int32_t const*>(src), offset, count);
+    return true;
+  case DataType::INT64:
+  case DataType::UINT64:
+    ni->setInt64Array(static_cast<int64_t const*>(src), offset, count);
+    return true;
+  case DataType::FLOAT:
+    ni->setFloatArray(static_cast<float const*>(src), offset, count);
+    return true;
+  case DataType::DOUBLE:
+    ni->setDoubleArray(static_cast<double const*>(src), offset, count);
+    return true;
+  default:
+    return false;
+  }
+}
+// }}}
+
+// Serialization {{{
+static bool serializable(DataCollection const* dc)
+{
+  for (sint t = 0, nt = dc->numTables(); t < nt; ++t) {
+    auto const* table = dc->getTable(t);
+    if (!table->vars().empty())
+      return false;
+    for (auto const& name : table->columnNames()) {
+      auto const* column = table->getColumn(name);
+      auto const& desc   = column->desc();
+      if (desc.objCallback)
+        return false;
+      if (desc.container ? !column->asVectorData()
+          : !desc.fixSized ? !column->asStringData() && !column->asBlobData()
+          : desc.dataType == DataType::STRUCTURE ? !column->asFixSizedData()
+          : !column->asNumericData())
+        return false;
+    }
+  }
+  return true;
+}
+
+bool writeDataCollection(std::ostream& os, DataCollection const* dc)
+{
+  if (!serializable(dc))
+    return false;
+  BinaryWriter w(os);
+  Vector<byte> buf;
+  w.pod<int64_t>(dc->numTables());
+  for (sint t = 0, nt = dc->numTables(); t < nt; ++t) {
+    auto const* table = dc->getTable(t);
+    auto const  names = table->columnNames();
+    size_t const nrows = table->numRows();
+    w.pod<uint64_t>(nrows);
+    w.pod<uint64_t>(names.size());
+    for (auto const& name : names) {
+      auto const* column = table->getColumn(name);
+      auto const& desc   = column->desc();
+      w.bytes(name.data(), name.size());
+      w.pod<int16_t>(static_cast<int16_t>(desc.dataType));
+      w.pod<int64_t>(desc.tupleSize);
+      w.pod<uint64_t>(desc.elemSize);
+      w.pod<uint8_t>(desc.dense);
+      w.pod<uint8_t>(desc.fixSized);
+      w.pod<uint8_t>(desc.container);
+      w.bytes(desc.defaultValue.data(), desc.defaultValue.size());
+
+      if (desc.container) {
+        auto const* vi = column->asVectorData();
+        for (size_t row = 0; row < nrows; ++row) {
+          auto const* vec = vi->rawVectorPtr(table->getIndex(row));
+          w.bytes(vec ? vec->data() : nullptr, vec ? vec->size() : 0);
+        }
+      } else if (!desc.fixSized) {
+        if (auto const* si = column->asStringData()) {
+          for (size_t row = 0; row < nrows; ++row) {
+            auto const str = si->getString(table->getIndex(row));
+            w.bytes(str.data(), str.size());
+          }
+        } else {
+          auto const* bi = column->asBlobData();
+          for (size_t row = 0; row < nrows; ++row) {
+            auto const blob = bi->getBlob(table->getIndex(row));
+            w.bytes(blob ? blob->data : nullptr, blob ? blob->size : 0);
+          }
+        }
+      } else {
+        // fix sized: columns are stored as one block, copied in runs of continuous indices
+        auto const* ni = column->asNumericData();
+        auto const* fi = ni ? nullptr : column->asFixSizedData();
+        size_t const ts       = ni ? column->tupleSize() : 1;
+        size_t const itemSize = ni ? dataTypeSize(ni->dataType()) * ts : fi->itemSize();
+        for (size_t row = 0; row < nrows;) {
+          auto const start = table->getIndex(row);
+          size_t     run   = 1;
+          while (row + run < nrows && table->getIndex(row + run) == start.value() + run)
+            ++run;
+          buf.resize(run * itemSize);
+          size_t got = 0;
+          bool const ok = ni ? getNumericArray(ni, buf.data(), start.value() * ts, run * ts)
+                             : fi->getItems(buf.data(), got, start, run);
+          if (!ok)
+            return false;
+          w.raw(buf.data(), buf.size());
+          row += run;
+        }
+      }
+    }
+  }
+  return w.good();
+}
+
+DataCollectionPtr readDataCollection(std::istream& is)
+{
+  BinaryReader r(is);
+  Vector<byte> buf;
+  auto dc = newDataCollection();
+  auto const ntables = r.pod<int64_t>();
+  RUNTIME_CHECK(ntables >= 0, "corrupted cache file: {} tables", ntables);
+  dc->reserveTables(ntables);
+  for (int64_t t = 0; t < ntables; ++t) {
+    auto* table = dc->getTable(dc->addTable());
+    auto const nrows = r.pod<uint64_t>();
+    auto const ncols = r.pod<uint64_t>();
+    CellIndex first = nrows ? table->addRows(nrows) : CellIndex(0);
+    for (uint64_t c = 0; c < ncols; ++c) {
+      auto const     name = r.string();
+      DataColumnDesc desc;
+      desc.dataType  = static_cast<DataType>(r.pod<int16_t>());
+      desc.tupleSize = r.pod<int64_t>();
+      desc.elemSize  = r.pod<uint64_t>();
+      desc.dense     = !!r.pod<uint8_t>();
+      desc.fixSized  = !!r.pod<uint8_t>();
+      desc.container = !!r.pod<uint8_t>();
+      r.bytes(desc.defaultValue);
+      RUNTIME_CHECK(desc.isValid(), "corrupted cache file: invalid desc of column \"{}\"", name);
+      auto* column = table->createColumn(name, desc, true);
+
+      if (desc.container) {
+        auto* vi = column->asVectorData();
+        RUNTIME_CHECK(vi, "column \"{}\" has no vector interface", name);
+        for (uint64_t row = 0; row < nrows; ++row)
+          r.bytes(*vi->rawVectorPtr(first + row));
+      } else if (!desc.fixSized) {
+        auto* si = column->asStringData();
+        auto* bi = column->asBlobData();
+        RUNTIME_CHECK(si || bi, "column \"{}\" has no string / blob interface", name);
+        for (uint64_t row = 0; row < nrows; ++row) {
+          r.bytes(buf);
+          if (si)
+            si->setString(first + row, StringView(reinterpret_cast<char const*>(buf.data()), buf.size()));
+          else if (!buf.empty())
+            bi->setBlobData(first + row, buf.data(), buf.size());
+        }
+      } else {
+        auto* ni = column->asNumericData();
+        auto* fi = ni ? nullptr : column->asFixSizedData();
+        RUNTIME_CHECK(ni || fi, "column \"{}\" has no numeric / fix-sized interface", name);
+        size_t const ts       = ni ? column->tupleSize() : 1;
+        size_t const itemSize = ni ? dataTypeSize(ni->dataType()) * ts : fi->itemSize();
+        buf.resize(nrows * itemSize);
+        r.raw(buf.data(), buf.size());
+        if (nrows) {
+          bool const ok = ni ? setNumericArray(ni, buf.data(), first.value() * ts, nrows * ts)
+                             : fi->setItems(buf.data(), first, nrows);
+          RUNTIME_CHECK(ok, "failed to fill column \"{}\"", name);
+        }
+      }
+    }
+  }
+  return dc;
+}
+// Serialization }}}
+
+// Cache Keys {{{
+static void hashString(String& material, StringView const& str)
+{
+  uint64_t const size = str.size();
+  material.append(reinterpret_cast<char const*>(&size), sizeof(size));
+  material.append(str.data(), str.size());
+}
+
+template<class T>
+static void hashPod(String& material, T const& v)
+{
+  material.append(reinterpret_cast<char const*>(&v), sizeof(T));
+}
+
+uint64_t DiskCacheDetail::keyOf(OpContextImpl const& ctx) const
+{
+  auto const* desc = ctx.desc_;
+  auto const* node = ctx.node_;
+  if (!enabled() || !desc || !node || ctx.imFork_ || ctx.bypassed_)
+    return 0;
+  if (!(desc->flags & OpFlag::DISK_CACHEABLE) || !!(desc->flags & OpFlag::ALLOW_LOOP))
+    return 0;
+
+  String material;
+  hashPod(material, DISKCACHE_VERSION);
+  // ops change their results with the code, not only with their args
+  hashPod(material, uint64_t(DF_CORE_VERSION));
+  hashPod(material, desc->libVersion);
+  hashString(material, desc->name);
+  hashPod(material, desc->numOutputs);
+  for (sint i = 0, n = static_cast<sint>(node->argCount()); i < n; ++i) {
+    auto const& argv = node->arg(i);
+    hashString(material, node->argName(i));
+    hashPod(material, argv.desc().type);
+    for (auto const& str : argv.asStringList())
+      hashString(material, str);
+    auto const rv = argv.asReal4();
+    auto const iv = argv.asInt4();
+    for (int c = 0; c < 4; ++c) {
+      hashPod(material, rv[c]);
+      hashPod(material, iv[c]);
+    }
+    // readers depend on file content, not only on the path
+    if (argv.desc().type == ArgType::FILEPATH_OPEN || argv.desc().type == ArgType::DIRPATH) {
+      std::error_code ec;
+      std::filesystem::path path(argv.asString());
+      int64_t mtime = 0;
+      uint64_t size = 0;
+      if (std::filesystem::exists(path, ec)) {
+        mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        if (std::filesystem::is_regular_file(path, ec))
+          size = std::filesystem::file_size(path, ec);
+      }
+      hashPod(material, mtime);
+      hashPod(material, size);
+    }
+  }
+  for (sint i = 0, n = ctx.getNumInputs(); i < n; ++i) {
+    if (!ctx.hasInput(i)) {
+      hashPod(material, uint64_t(0));
+      continue;
+    }
+    auto const upstreamKey = ctx.inputContexts_[i]->diskCacheKey_;
+    if (upstreamKey == 0) // upstream content is unknown
+      return 0;
+    hashPod(material, upstreamKey);
+    hashPod(material, ctx.inputPinInfo_[i].pin);
+  }
+  uint64_t const key = XXH64(material.data(), material.size(), 0);
+  return key ? key : 1;
+}
+// Cache Keys }}}
+
+// DiskCacheDetail {{{
+DiskCacheDetail& DiskCacheDetail::instance()
+{
+  static DiskCacheDetail instance_;
+  return instance_;
+}
+
+void DiskCacheDetail::setDirectory(String const& path)
+{
+  std::lock_guard lock(mutex_);
+  directory_ = path;
+  if (!path.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    if (ec) {
+      spdlog::error("disk cache: cannot create directory \"{}\": {}", path, ec.message());
+      directory_.clear();
+    }
+  }
+  enabled_.store(!directory_.empty());
+}
+
+String DiskCacheDetail::directory() const
+{
+  std::lock_guard lock(mutex_);
+  return directory_;
+}
+
+String DiskCacheDetail::pathOf(uint64_t key) const
+{
+  std::lock_guard lock(mutex_);
+  return (std::filesystem::path(directory_) / fmt::format("{:016x}.jfc", key)).string();
+}
+
+size_t DiskCacheDetail::clear()
+{
+  auto const dir = directory();
+  if (dir.empty())
+    return 0;
+  size_t removed = 0;
+  std::error_code ec;
+  for (auto const& entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.path().extension() == ".jfc" && std::filesystem::remove(entry.path(), ec))
+      ++removed;
+  }
+  return removed;
+}
+
+bool DiskCacheDetail::load(uint64_t key, Vector<DataCollectionPtr>& outputs)
+{
+  if (!enabled() || key == 0)
+    return false;
+  PROFILER_SCOPE("DiskCache::load", 0x6B8E23);
+  auto const path = pathOf(key);
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    ++misses_;
+    return false;
+  }
+  try {
+    BinaryReader r(file);
+    RUNTIME_CHECK(r.pod<uint32_t>() == DISKCACHE_MAGIC, "not a cache file");
+    RUNTIME_CHECK(r.pod<uint32_t>() == DISKCACHE_VERSION, "cache file version mismatch");
+    RUNTIME_CHECK(r.pod<uint64_t>() == key, "cache key mismatch");
+    auto const noutputs = r.pod<int64_t>();
+    RUNTIME_CHECK(noutputs == outputs.ssize(), "expected {} outputs, got {}", outputs.size(), noutputs);
+    Vector<DataCollectionPtr> loaded(outputs.size(), nullptr);
+    for (auto& dc : loaded) {
+      if (r.pod<uint8_t>())
+        dc = readDataCollection(file);
+    }
+    outputs = std::move(loaded);
+  } catch (std::exception const& e) {
+    spdlog::warn("disk cache: failed to load \"{}\": {}", path, e.what());
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  return true;
+}
+
+bool DiskCacheDetail::store(uint64_t key, Vector<DataCollectionPtr> const& outputs)
+{
+  if (!enabled() || key == 0)
+    return false;
+  PROFILER_SCOPE("DiskCache::store", 0x6B8E23);
+  auto const path = pathOf(key);
+  std::error_code ec;
+  if (std::filesystem::exists(path, ec))
+    return true;
+  // write aside then rename, concurrent readers never see partial files
+  static std::atomic<uint64_t> tmpCounter = 0;
+  auto const tmppath = fmt::format("{}.{}.tmp", path, tmpCounter.fetch_add(1));
+  bool succeed = true;
+  {
+    std::ofstream file(tmppath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      spdlog::warn("disk cache: cannot write \"{}\"", tmppath);
+      return false;
+    }
+    BinaryWriter w(file);
+    w.pod(DISKCACHE_MAGIC);
+    w.pod(DISKCACHE_VERSION);
+    w.pod(key);
+    w.pod<int64_t>(outputs.size());
+    for (auto const& dc : outputs) {
+      w.pod<uint8_t>(!!dc);
+      if (dc && !writeDataCollection(file, dc.get())) {
+        succeed = false;
+        break;
+      }
+    }
+    succeed = succeed && w.good();
+  }
+  if (succeed)
+    std::filesystem::rename(tmppath, path, ec);
+  if (!succeed || ec) {
+    spdlog::debug("disk cache: outputs of key {:016x} not stored", key);
+    std::filesystem::remove(tmppath, ec);
+    return false;
+  }
+  return true;
+}
+// }}}
+
+} // namespace detail
+
+void DiskCache::setDirectory(String const& path)
+{
+  detail::DiskCacheDetail::instance().setDirectory(path);
+}
+
+String DiskCache::directory()
+{
+  return detail::DiskCacheDetail::instance().directory();
+}
+
+bool DiskCache::enabled()
+{
+  return detail::DiskCacheDetail::instance().enabled();
+}
+
+size_t DiskCache::hits()
+{
+  return detail::DiskCacheDetail::instance().hits();
+}
+
+size_t DiskCache::misses()
+{
+  return detail::DiskCacheDetail::instance().misses();
+}
+
+size_t DiskCache::clear()
+{
+  return detail::DiskCacheDetail::instance().clear();
+}
+
+END_JOYFLOW_NAMESPACE
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../diskcache.h"
+#include "../def.h"
+#include "../vector.h"
+#include "../datatable.h"
+
+#include <atomic>
+#include <iosfwd>
+#include <mutex>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+class OpContextImpl;
+
+class DiskCacheDetail
+{
+  mutable std::mutex  mutex_;
+  String              directory_;
+  std::atomic<bool>   enabled_ = false;
+  std::atomic<size_t> hits_    = 0;
+  std::atomic<size_t> misses_  = 0;
+
+  String pathOf(uint64_t key) const;
+
+public:
+  static DiskCacheDetail& instance();
+
+  void   setDirectory(String const& path);
+  String directory() const;
+  bool   enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  size_t hits() const { return hits_.load(); }
+  size_t misses() const { return misses_.load(); }
+  size_t clear();
+
+  /// key of the context's outputs, 0 if it cannot be cached
+  /// upstream keys should have been calculated before
+  uint64_t keyOf(OpContextImpl const& ctx) const;
+
+  /// load outputs stored under `key`, returns false on miss
+  bool load(uint64_t key, Vector<DataCollectionPtr>& outputs);
+  /// store outputs under `key`, returns false if they cannot be serialized
+  bool store(uint64_t key, Vector<DataCollectionPtr> const& outputs);
+};
+
+/// binary columnar (de)serialization of data collections
+/// tables are written in row order, so holes are not preserved
+/// returns false if something cannot be serialized (table variables, non-POD columns)
+bool writeDataCollection(std::ostream& os, DataCollection const* dc);
+DataCollectionPtr readDataCollection(std::istream& is);
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
@@ -0,0 +1,27 @@
+#pragma once
+#include "../def.h"
+#include "../scheduler.h"
+#include "../stats.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+/// Held while an evaluation blocks: other tasks may run on this thread meanwhile,
+/// their copies must not be accounted to the one waiting, nor may their priority stick to it
+class EvalSuspendScope
+{
+  CopySinkScope copySink_{nullptr};
+  TaskPriority  priority_;
+
+public:
+  EvalSuspendScope() : priority_(Scheduler::threadPriority()) {}
+  ~EvalSuspendScope() { Scheduler::setThreadPriority(priority_); }
+
+  EvalSuspendScope(EvalSuspendScope const&) = delete;
+  EvalSuspendScope& operator=(EvalSuspendScope const&) = delete;
+};
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
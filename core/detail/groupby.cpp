@@ -0,0 +1,530 @@
+#include "groupby.h"
+#include "runtime.h"
+#include "../datatable.h"
+#include "../error.h"
+#include "../profiler.h"
+#include "../traits.h"
+
+#include <phmap.h>
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <regex>
+#include <sstream>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+// Aggregate Specs {{{
+static Pair<char const*, Aggregate> const AGGREGATE_NAMES[] = {
+  {"sum", Aggregate::SUM},     {"min", Aggregate::MIN},   {"max", Aggregate::MAX},     {"mean", Aggregate::MEAN},
+  {"var", Aggregate::VAR},     {"count", Aggregate::COUNT}, {"first", Aggregate::FIRST}, {"last", Aggregate::LAST}};
+
+Vector<AggregateSpec> parseAggregates(String const& code)
+{
+  static std::regex const pattern(R"(^\s*(?:([^=\s]+)\s*=\s*)?(\w+)\s*\(\s*([^()]*?)\s*\)\s*$)");
+  Vector<AggregateSpec>   specs;
+  std::istringstream      lines(code);
+  String                  text;
+  for (sint line = 1; std::getline(lines, text); ++line) {
+    if (auto const comment = text.find('#'); comment != String::npos)
+      text.resize(comment);
+    if (std::all_of(text.begin(), text.end(), [](char c) { return std::isspace(uint8_t(c)); }))
+      continue;
+    std::smatch match;
+    RUNTIME_CHECK(std::regex_match(text, match, pattern), "reduce: line {}: expecting `output = func(column)`, got \"{}\"",
+                  line, text);
+    String const func = match[2];
+    auto const*  name = std::find_if(std::begin(AGGREGATE_NAMES), std::end(AGGREGATE_NAMES),
+                                     [&func](auto const& n) { return func == n.first; });
+    RUNTIME_CHECK(name != std::end(AGGREGATE_NAMES), "reduce: line {}: unknown aggregate {}()", line, func);
+    AggregateSpec spec;
+    spec.func   = name->second;
+    spec.column = match[3];
+    RUNTIME_CHECK((spec.func == Aggregate::COUNT) == spec.column.empty(), "reduce: line {}: {}() takes {}", line, func,
+                  spec.func == Aggregate::COUNT ? "no column" : "a column");
+    if (match[1].matched)
+      spec.output = match[1];
+    else
+      spec.output = spec.func == Aggregate::COUNT ? func : fmt::format("{}_{}", spec.column, func);
+    specs.push_back(std::move(spec));
+  }
+  return specs;
+}
+// Aggregate Specs }}}
+
+// Grouping {{{
+namespace {
+
+/// rows read per step of a job
+constexpr sint GROUP_BATCH = 1024;
+/// integer keys spanning up to this many values are grouped by a plain array
+constexpr int64_t DENSE_KEY_RANGE = 65536;
+
+struct GroupKey
+{
+  uint64_t hash;
+  size_t   index; //< first cell of the group
+};
+
+struct GroupKeyHash
+{
+  size_t operator()(GroupKey const& key) const { return size_t(key.hash); }
+};
+
+struct GroupKeyEq
+{
+  Vector<CompareInterface const*> const* keys = nullptr; //< null when hashes are the keys
+
+  bool operator()(GroupKey const& a, GroupKey const& b) const
+  {
+    if (a.hash != b.hash)
+      return false;
+    if (keys)
+      for (auto const* key : *keys)
+        if (key->compare(CellIndex(a.index), CellIndex(b.index)) != 0)
+          return false;
+    return true;
+  }
+};
+
+using GroupMap = phmap::flat_hash_map<GroupKey, sint, GroupKeyHash, GroupKeyEq>;
+
+struct Group
+{
+  uint64_t hash       = 0;
+  sint     first      = 0; //< rows
+  sint     last       = 0;
+  sint     count      = 0;
+  size_t   firstIndex = 0;
+};
+
+struct Accumulator
+{
+  real sum  = 0;
+  real min  = std::numeric_limits<real>::infinity();
+  real max  = -std::numeric_limits<real>::infinity();
+  real mean = 0;
+  real m2   = 0; //< sum of squared differences from mean
+
+  void add(real x, sint n) // n: count including x
+  {
+    sum += x;
+    min = std::min(min, x);
+    max = std::max(max, x);
+    real const delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+  }
+
+  void merge(Accumulator const& that, sint n, sint m) // counts of this and that
+  {
+    real const delta = that.mean - mean;
+    sum += that.sum;
+    min = std::min(min, that.min);
+    max = std::max(max, that.max);
+    mean += delta * m / (n + m);
+    m2 += that.m2 + delta * delta * real(n) * m / (n + m);
+  }
+};
+
+/// groups of one row range
+struct Partial
+{
+  Vector<Group>        groups;
+  Vector<Accumulator>  accs;        //< numAccs per group
+  Vector<Vector<sint>> byPartition; //< groups to merge by each partition
+};
+
+/// numeric column read as `real`s
+struct NumericSource
+{
+  DataColumn* column    = nullptr;
+  DataType    type      = DataType::UNKNOWN;
+  sint        tupleSize = 1;
+  void const* cdata     = nullptr; //< null if storage was not filled up yet
+  sint        accOffset = 0;
+};
+
+template<class F>
+static void visitNumeric(DataType type, F&& f)
+{
+  switch (type) {
+  case DataType::INT32:  f(int32_t{}); break;
+  case DataType::UINT32: f(uint32_t{}); break;
+  case DataType::INT64:  f(int64_t{}); break;
+  case DataType::UINT64: f(uint64_t{}); break;
+  case DataType::FLOAT:  f(float{}); break;
+  case DataType::DOUBLE: f(double{}); break;
+  default:
+    throw TypeError(fmt::format("{} is not a numeric type", dataTypeName(type)));
+  }
+}
+
+static NumericSource numericSource(DataColumn* column, size_t numIndices)
+{
+  NumericSource source;
+  source.column    = column;
+  source.type      = column->dataType();
+  source.tupleSize = column->tupleSize();
+  if (numIndices > 0)
+    source.cdata = column->asNumericData()->getRawBufferRO(0, numIndices * source.tupleSize, source.type);
+  return source;
+}
+
+/// components of cells `indices` into `out`, tuple after tuple
+static void readValues(NumericSource const& source, size_t const* indices, sint n, real* out)
+{
+  sint const ts = source.tupleSize;
+  if (!source.cdata) {
+    size_t len = 0;
+    for (sint i = 0; i < n; ++i)
+      source.column->asNumericData()->getDoubleArray(out + i * ts, len, indices[i] * ts, ts);
+    return;
+  }
+  visitNumeric(source.type, [&](auto zero) {
+    using T          = decltype(zero);
+    auto const* data = static_cast<T const*>(source.cdata);
+    for (sint i = 0; i < n; ++i)
+      for (sint c = 0; c < ts; ++c)
+        out[i * ts + c] = real(data[indices[i] * ts + c]);
+  });
+}
+
+struct KeySource
+{
+  DataColumn*          column  = nullptr;
+  StringDataInterface* strings = nullptr;
+  char const*          bytes   = nullptr; //< raw numeric storage, if filled up
+  size_t               stride  = 0;       //< bytes per cell
+};
+
+static Vector<KeySource> keySourcesOf(DataTable* input, Vector<String> const& keys, Vector<CompareInterface const*>& compare)
+{
+  Vector<KeySource> sources;
+  HashSet<String>   names;
+  for (auto const& key : keys) {
+    auto* col = input->getColumn(key);
+    RUNTIME_CHECK(col, "key column \"{}\" does not exist", key);
+    RUNTIME_CHECK(names.insert(key).second, "key column \"{}\" appears twice", key);
+    KeySource source;
+    source.column = col;
+    if (col->dataType() == DataType::STRING) {
+      source.strings = col->asStringData();
+    } else {
+      RUNTIME_CHECK(isNumeric(col->dataType()) && !col->desc().container,
+                    "cannot group by column \"{}\" of type {}", key, dataTypeName(col->dataType()));
+      auto const numeric = numericSource(col, input->numIndices());
+      source.bytes       = static_cast<char const*>(numeric.cdata);
+      source.stride      = col->desc().elemSize;
+    }
+    sources.push_back(source);
+    compare.push_back(col->compareInterface());
+  }
+  return sources;
+}
+
+/// XXH64 of the key cells of `indices`, equal keys hash the same
+static void hashKeys(Vector<KeySource> const& keys, size_t const* indices, sint n, uint64_t* hashes)
+{
+  std::fill(hashes, hashes + n, 0);
+  for (auto const& key : keys) {
+    if (key.strings) {
+      for (sint i = 0; i < n; ++i) {
+        auto const sv = key.strings->getString(CellIndex(indices[i]));
+        hashes[i]     = XXH64(sv.data(), sv.size(), hashes[i]);
+      }
+    } else if (key.bytes) {
+      for (sint i = 0; i < n; ++i)
+        hashes[i] = XXH64(key.bytes + indices[i] * key.stride, key.stride, hashes[i]);
+    } else {
+      real   value[MAX_TUPLE_SIZE];
+      size_t len = 0;
+      sint   ts  = key.column->tupleSize();
+      for (sint i = 0; i < n; ++i) {
+        key.column->asNumericData()->getDoubleArray(value, len, indices[i] * ts, ts);
+        hashes[i] = XXH64(value, sizeof(real) * ts, hashes[i]);
+      }
+    }
+  }
+}
+
+} // namespace
+
+Vector<sint> groupRows(DataTable* input, Vector<String> const& keys, sint& numGroups)
+{
+  PROFILER_SCOPE("group rows", 0xB39DDB);
+  Vector<CompareInterface const*> keyCompare;
+  auto const   sources = keySourcesOf(input, keys, keyCompare);
+  sint const   numRows = sint(input->numRows());
+  GroupMap     groupOf(0, GroupKeyHash{}, GroupKeyEq{&keyCompare});
+  Vector<sint> groups(numRows);
+  size_t       indices[GROUP_BATCH];
+  uint64_t     hashes[GROUP_BATCH];
+  numGroups = 0;
+  for (sint row0 = 0; row0 < numRows; row0 += GROUP_BATCH) {
+    sint const n = std::min(GROUP_BATCH, numRows - row0);
+    for (sint i = 0; i < n; ++i)
+      indices[i] = input->getIndex(row0 + i).value();
+    hashKeys(sources, indices, n, hashes);
+    for (sint i = 0; i < n; ++i) {
+      auto const [itr, inserted] = groupOf.try_emplace(GroupKey{hashes[i], indices[i]}, numGroups);
+      numGroups += inserted;
+      groups[row0 + i] = itr->second;
+    }
+  }
+  return groups;
+}
+
+void groupBy(DataTable* input, Vector<String> const& keys, Vector<AggregateSpec> const& aggregates, DataTable* output)
+{
+  PROFILER_SCOPE("group by", 0xB39DDB);
+  size_t const numIndices = input->numIndices();
+  sint const   numRows    = sint(input->numRows());
+
+  // columns {{{
+  Vector<CompareInterface const*> keyCompare;
+  auto const                      keySources = keySourcesOf(input, keys, keyCompare);
+  HashSet<String>                 outputNames(keys.begin(), keys.end());
+
+  Vector<NumericSource> valueSources;
+  Vector<sint>          sourceOfAggregate(aggregates.size(), -1);
+  sint                  numAccs = 0;
+  for (size_t a = 0; a < aggregates.size(); ++a) {
+    auto const& spec = aggregates[a];
+    RUNTIME_CHECK(outputNames.insert(spec.output).second, "reduce: column \"{}\" appears twice", spec.output);
+    if (spec.func == Aggregate::COUNT)
+      continue;
+    auto* col = input->getColumn(spec.column);
+    RUNTIME_CHECK(col, "reduce: column \"{}\" does not exist", spec.column);
+    if (spec.func == Aggregate::FIRST || spec.func == Aggregate::LAST) {
+      RUNTIME_CHECK(col->copyInterface(), "reduce: column \"{}\" cannot be copied", spec.column);
+      continue;
+    }
+    RUNTIME_CHECK(isNumeric(col->dataType()) && !col->desc().container && col->tupleSize() <= 4,
+                  "reduce: cannot aggregate column \"{}\" of type {}", spec.column, dataTypeName(col->dataType()));
+    auto source      = numericSource(col, numIndices);
+    source.accOffset = numAccs;
+    numAccs += source.tupleSize;
+    sourceOfAggregate[a] = sint(valueSources.size());
+    valueSources.push_back(source);
+  }
+  // columns }}}
+
+  // a single integer key of small range indexes groups directly
+  int64_t keyMin = 0, keyRange = 0;
+  bool    dense  = false;
+  if (keySources.size() == 1 && keySources[0].bytes && keySources[0].column->tupleSize() == 1 &&
+      keySources[0].column->dataType() != DataType::FLOAT && keySources[0].column->dataType() != DataType::DOUBLE &&
+      numRows > 0) {
+    int64_t lo = std::numeric_limits<int64_t>::max(), hi = std::numeric_limits<int64_t>::min();
+    visitNumeric(keySources[0].column->dataType(), [&](auto zero) {
+      using T          = decltype(zero);
+      auto const* data = reinterpret_cast<T const*>(keySources[0].bytes);
+      for (sint row = 0; row < numRows; ++row) {
+        auto const v = int64_t(data[input->getIndex(row).value()]);
+        lo           = std::min(lo, v);
+        hi           = std::max(hi, v);
+      }
+    });
+    dense = uint64_t(hi) - uint64_t(lo) < uint64_t(std::min<int64_t>(DENSE_KEY_RANGE, std::max<int64_t>(GROUP_BATCH, numRows)));
+    if (dense) {
+      keyMin   = lo;
+      keyRange = hi - lo + 1;
+    }
+  }
+
+  // pre-aggregation {{{
+  auto&      tasks   = TaskContext::instance();
+  sint const numJobs = std::max<sint>(1, std::min<sint>(numRows / (4 * GROUP_BATCH), tasks.scheduler.config().workerThread.count));
+  Vector<Partial> partials(numJobs);
+  tasks.parallelFor(size_t(numJobs), CostModel::instance().history("reduce.row"), real(numRows) / numJobs,
+                    [&](size_t job) {
+    PROFILER_SCOPE("group rows", 0xB39DDB);
+    auto&        partial = partials[job];
+    GroupMap     groupOf(0, GroupKeyHash{}, GroupKeyEq{&keyCompare});
+    Vector<sint> slotGroup(dense ? size_t(keyRange) : 0, -1);
+    size_t       indices[GROUP_BATCH];
+    uint64_t     hashes[GROUP_BATCH];
+    sint         gids[GROUP_BATCH];
+    Vector<real> values(GROUP_BATCH * 4);
+    for (sint row0 = numRows * sint(job) / numJobs, end = numRows * sint(job + 1) / numJobs; row0 < end; row0 += GROUP_BATCH) {
+      sint const n = std::min(GROUP_BATCH, end - row0);
+      for (sint i = 0; i < n; ++i)
+        indices[i] = input->getIndex(row0 + i).value();
+      if (dense) {
+        visitNumeric(keySources[0].column->dataType(), [&](auto zero) {
+          using T          = decltype(zero);
+          auto const* data = reinterpret_cast<T const*>(keySources[0].bytes);
+          for (sint i = 0; i < n; ++i)
+            hashes[i] = uint64_t(int64_t(data[indices[i]]) - keyMin);
+        });
+      } else {
+        hashKeys(keySources, indices, n, hashes);
+      }
+
+      for (sint i = 0; i < n; ++i) {
+        sint gid = -1;
+        if (dense) {
+          gid = slotGroup[hashes[i]];
+          if (gid < 0)
+            gid = slotGroup[hashes[i]] = sint(partial.groups.size());
+        } else {
+          gid = groupOf.try_emplace(GroupKey{hashes[i], indices[i]}, sint(partial.groups.size())).first->second;
+        }
+        if (gid == sint(partial.groups.size())) {
+          Group group;
+          group.hash       = hashes[i];
+          group.first      = row0 + i;
+          group.firstIndex = indices[i];
+          partial.groups.push_back(group);
+          partial.accs.resize(partial.accs.size() + numAccs);
+        }
+        auto& group = partial.groups[gid];
+        group.last  = row0 + i;
+        ++group.count;
+        gids[i] = gid;
+      }
+
+      // counts have all rows of this batch now, replay them for the running means
+      for (auto const& source : valueSources) {
+        sint const ts = source.tupleSize;
+        readValues(source, indices, n, values.data());
+        for (sint i = n - 1; i >= 0; --i)
+          --partial.groups[gids[i]].count;
+        for (sint i = 0; i < n; ++i) {
+          sint const count = ++partial.groups[gids[i]].count;
+          auto*      acc   = &partial.accs[size_t(gids[i]) * numAccs + source.accOffset];
+          for (sint c = 0; c < ts; ++c)
+            acc[c].add(values[i * ts + c], count);
+        }
+      }
+    }
+    partial.byPartition.resize(numJobs);
+    for (sint g = 0, n = sint(partial.groups.size()); g < n; ++g)
+      partial.byPartition[partial.groups[g].hash % numJobs].push_back(g);
+  });
+  // pre-aggregation }}}
+
+  // merge {{{
+  Vector<Partial> merged(numJobs);
+  tasks.parallelFor(size_t(numJobs), CostModel::instance().history("reduce.group"), real(numRows) / numJobs,
+                    [&](size_t p) {
+    PROFILER_SCOPE("merge groups", 0xB39DDB);
+    auto&    result = merged[p];
+    GroupMap groupOf(0, GroupKeyHash{}, GroupKeyEq{dense ? nullptr : &keyCompare});
+    for (auto const& partial : partials) { // in row order
+      for (sint g : partial.byPartition[p]) {
+        auto const& group = partial.groups[g];
+        auto const* accs  = &partial.accs[size_t(g) * numAccs];
+        auto const [it, inserted] =
+          groupOf.try_emplace(GroupKey{group.hash, group.firstIndex}, sint(result.groups.size()));
+        if (inserted) {
+          result.groups.push_back(group);
+          for (sint a = 0; a < numAccs; ++a)
+            result.accs.push_back(accs[a]);
+          continue;
+        }
+        auto& into = result.groups[it->second];
+        for (sint a = 0; a < numAccs; ++a)
+          result.accs[size_t(it->second) * numAccs + a].merge(accs[a], into.count, group.count);
+        into.count += group.count;
+        into.last = std::max(into.last, group.last);
+      }
+    }
+  });
+
+  Vector<Pair<Group const*, Accumulator const*>> groups;
+  for (auto const& result : merged)
+    for (size_t g = 0; g < result.groups.size(); ++g)
+      groups.push_back({&result.groups[g], result.accs.data() + g * numAccs});
+  std::sort(groups.begin(), groups.end(), [](auto const& a, auto const& b) { return a.first->first < b.first->first; });
+  // merge }}}
+
+  // output {{{
+  PROFILER_SCOPE("write groups", 0xB39DDB);
+  sint const numGroups = sint(groups.size());
+  auto const created   = [&](String const& name, DataColumn* col) {
+    RUNTIME_CHECK(col, "reduce: cannot create column \"{}\"", name);
+    return col;
+  };
+  Vector<DataColumn*> keyColumns, aggColumns;
+  for (size_t k = 0; k < keys.size(); ++k)
+    keyColumns.push_back(created(keys[k], output->createColumn(keys[k], keySources[k].column->desc())));
+  for (size_t a = 0; a < aggregates.size(); ++a) {
+    auto const& spec = aggregates[a];
+    DataColumn* col  = nullptr;
+    if (spec.func == Aggregate::COUNT)
+      col = output->createColumn<int64_t>(spec.output, 0);
+    else if (spec.func == Aggregate::FIRST || spec.func == Aggregate::LAST)
+      col = output->createColumn(spec.output, input->getColumn(spec.column)->desc());
+    else
+      switch (valueSources[sourceOfAggregate[a]].tupleSize) {
+      case 1:  col = output->createColumn<real>(spec.output, 0.0); break;
+      case 2:  col = output->createColumn<vec2>(spec.output, vec2()); break;
+      case 3:  col = output->createColumn<vec3>(spec.output, vec3()); break;
+      default: col = output->createColumn<vec4>(spec.output, vec4()); break;
+      }
+    aggColumns.push_back(created(spec.output, col));
+  }
+  if (numGroups == 0)
+    return;
+  output->addRows(size_t(numGroups));
+
+  for (size_t k = 0; k < keys.size(); ++k)
+    for (sint g = 0; g < numGroups; ++g)
+      keyColumns[k]->copyInterface()->copy(CellIndex(g), keySources[k].column, CellIndex(groups[g].first->firstIndex));
+  for (size_t a = 0; a < aggregates.size(); ++a) {
+    auto const& spec = aggregates[a];
+    auto*       col  = aggColumns[a];
+    switch (spec.func) {
+    case Aggregate::COUNT: {
+      Vector<int64_t> counts(numGroups);
+      for (sint g = 0; g < numGroups; ++g)
+        counts[g] = groups[g].first->count;
+      col->asNumericData()->setInt64Array(counts.data(), 0, counts.size());
+      break;
+    }
+    case Aggregate::FIRST:
+    case Aggregate::LAST: {
+      auto const* src = input->getColumn(spec.column);
+      for (sint g = 0; g < numGroups; ++g) {
+        auto const& group = *groups[g].first;
+        auto const  index = spec.func == Aggregate::FIRST ? CellIndex(group.firstIndex) : input->getIndex(group.last);
+        col->copyInterface()->copy(CellIndex(g), src, index);
+      }
+      break;
+    }
+    default: {
+      auto const&  source = valueSources[sourceOfAggregate[a]];
+      sint const   ts     = source.tupleSize;
+      Vector<real> values(size_t(numGroups) * ts);
+      for (sint g = 0; g < numGroups; ++g) {
+        sint const count = groups[g].first->count;
+        for (sint c = 0; c < ts; ++c) {
+          auto const& acc = groups[g].second[source.accOffset + c];
+          real&       out = values[size_t(g) * ts + c];
+          switch (spec.func) {
+          case Aggregate::SUM:  out = acc.sum; break;
+          case Aggregate::MIN:  out = acc.min; break;
+          case Aggregate::MAX:  out = acc.max; break;
+          case Aggregate::MEAN: out = acc.mean; break;
+          default:              out = count > 1 ? acc.m2 / (count - 1) : 0; break;
+          }
+        }
+      }
+      col->asNumericData()->setDoubleArray(values.data(), 0, values.size());
+      break;
+    }
+    }
+  }
+  // output }}}
+}
+// Grouping }}}
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
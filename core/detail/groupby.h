@@ -0,0 +1,50 @@
+#pragma once
+#include "../def.h"
+#include "../vector.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+class DataTable;
+
+namespace detail {
+
+enum class Aggregate : uint8_t
+{
+  SUM,
+  MIN,
+  MAX,
+  MEAN,
+  VAR,   //< sample variance
+  COUNT,
+  FIRST, //< any column type
+  LAST,  //< any column type
+};
+
+struct AggregateSpec
+{
+  String    output;
+  Aggregate func = Aggregate::COUNT;
+  String    column; //< empty for COUNT
+};
+
+/// parses one `output = func(column)` per line, `output` defaults to
+/// `column_func`, or `count` for `count()`; throws CheckFailure naming the line
+Vector<AggregateSpec> parseAggregates(String const& code);
+
+/// One row per distinct combination of `keys` in `input`, in order of first
+/// appearance, with the key columns and one column per aggregate, into empty
+/// `output`; no keys make one group of all rows.
+///
+/// Row ranges are pre-aggregated in parallel, each into a hash table of its own
+/// keyed by XXH64 of the key cells, or into a dense array when the only key is
+/// an integer column of small range. Groups are then merged in parallel, each
+/// partition of the hash space by one task.
+void groupBy(DataTable* input, Vector<String> const& keys, Vector<AggregateSpec> const& aggregates,
+             DataTable* output);
+
+/// group of each row of `input` by `keys`, groups numbered in order of first appearance
+Vector<sint> groupRows(DataTable* input, Vector<String> const& keys, sint& numGroups);
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
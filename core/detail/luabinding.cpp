@@ -4,6 +4,9 @@
 #include "opgraph.h"
 #include "oparg.h"
 #include "profiler.h"
+#include "scheduler.h"
+#include "luapool.h"
+#include "runtime.h"
 
 #include <spdlog/spdlog.h>
 #include <glm/glm.hpp>
@@ -12,6 +15,11 @@
 #include <lauxlib.h>
 #include <lualib.h>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
 BEGIN_JOYFLOW_NAMESPACE
 
 
@@ -303,10 +311,12 @@ static int lua_DataTable_set(lua_State* L)
 
   if (sol::stack::check<const char*>(L, 2)) {
     colname = sol::stack::get<const char*>(L, 2);
-    col = table->getColumn(colname);
+    col = table->mutColumn(colname);
   } else if (sol::stack::check<DataColumn*>(L, 2)) {
     col = sol::stack::get<DataColumn*>(L, 2);
     colname = col->name();
+    if (table->getColumn(colname) == col)
+      col = table->mutColumn(colname);
   }
 
   if (!col) {
@@ -422,8 +432,9 @@ static int lua_DataTable_addColumn(lua_State *L)
 
 struct TableRowAccessor
 {
-  DataTable* table;
-  CellIndex  cindex;
+  DataTable*                 table;
+  CellIndex                  cindex;
+  Vector<DataColumn*> const* writable = nullptr; //< when set, only these columns can be assigned
 
   static int __index(lua_State* L)
   {
@@ -470,7 +481,12 @@ struct TableRowAccessor
       colname = col->name();
     } else if (sol::stack::check<const char*>(L, 2)) {
       colname = sol::stack::get<const char*>(L, 2);
-      col = self.table->getColumn(colname);
+      // columns of parallel_foreach were made unique before the jobs started
+      col = self.writable ? self.table->getColumn(colname) : self.table->mutColumn(colname);
+    }
+    if (self.writable) {
+      RUNTIME_CHECK(col && std::find(self.writable->begin(), self.writable->end(), col) != self.writable->end(),
+                    "column \"{}\" was not declared writable", colname);
     }
     // create an new column if column does not exist yet
     if (col == nullptr && lua_gettop(L) == 3) {
@@ -496,6 +512,421 @@ struct TableRowAccessor
   }
 };
 
+// Column Arrays {{{
+/// Typed view of a numeric column's storage, indexed by row from 0 like `table:get`,
+/// so scripts can walk whole columns without a name lookup and a virtual call per cell.
+/// Layout and storage are validated once when made; anything that could move them
+/// (rows or columns changed, table shared or copied, column storage copied) bumps
+/// `structureVersion()` of the table, so later accesses only compare that.
+struct LuaColumnArray
+{
+  DataTablePtr          table     = nullptr;
+  DataColumnPtr         column    = nullptr;
+  size_t                version   = 0;     // structure version of the table when made
+  DataType              type      = DataType::UNKNOWN;
+  sint                  tupleSize = 1;
+  size_t                numRows   = 0;
+  size_t                count     = 0;     // components in storage
+  void*                 data      = nullptr; // null if read-only
+  void const*           cdata     = nullptr;
+  Vector<sint>          rowToIndex;          // empty when rows are indices
+  std::shared_ptr<void> snapshot;            // read-only copy, if storage was not filled up yet
+
+  bool writable() const { return data != nullptr; }
+
+  template<class T> T const* get() const { return static_cast<T const*>(cdata); }
+  template<class T> T*       mut() const { return static_cast<T*>(data); }
+
+  void checkWritable() const
+  {
+    RUNTIME_CHECK(writable(), "array of column \"{}\" is read-only, get it by table:mutArray()", column->name());
+  }
+
+  /// layout and storage are still the ones this array was made from
+  void checkValid() const
+  {
+    RUNTIME_CHECK(table->structureVersion() == version,
+                  "array of column \"{}\" is stale, its table has changed since - get it again", column->name());
+  }
+
+  void checkRow(sint row) const
+  {
+    RUNTIME_CHECK(row >= 0 && size_t(row) < numRows, "row {} out of range [0, {})", row, numRows);
+  }
+
+  /// storage offset of row's first component
+  size_t base(sint row) const { return size_t(rowToIndex.empty() ? row : rowToIndex[row]) * tupleSize; }
+
+  /// f(base) for each row, in row order
+  template<class F>
+  void forEachRow(F&& f) const
+  {
+    if (rowToIndex.empty()) {
+      for (size_t b = 0, e = numRows * tupleSize; b < e; b += tupleSize)
+        f(b);
+    } else {
+      for (auto index : rowToIndex)
+        f(size_t(index) * tupleSize);
+    }
+  }
+};
+
+template<class F>
+static decltype(auto) visitNumericType(DataType type, F&& f)
+{
+  switch (type) {
+  case DataType::INT32:  return f(int32_t{});
+  case DataType::UINT32: return f(uint32_t{});
+  case DataType::INT64:  return f(int64_t{});
+  case DataType::UINT64: return f(uint64_t{});
+  case DataType::FLOAT:  return f(float{});
+  case DataType::DOUBLE: return f(double{});
+  default:
+    throw TypeError(fmt::format("{} is not a numeric type", dataTypeName(type)));
+  }
+}
+
+template<class T>
+static void pushLuaNumber(lua_State* L, T value)
+{
+  if constexpr (std::is_floating_point<T>::value)
+    lua_pushnumber(L, lua_Number(value));
+  else
+    lua_pushinteger(L, lua_Integer(value));
+}
+
+template<class T>
+static T toLuaNumber(lua_State* L, int stk)
+{
+  if constexpr (std::is_floating_point<T>::value)
+    return T(luaL_checknumber(L, stk));
+  else
+    return lua_isinteger(L, stk) ? T(lua_tointeger(L, stk)) : T(luaL_checknumber(L, stk));
+}
+
+template<class V2, class V3, class V4, class T>
+static void pushLuaVector(lua_State* L, T const* v, sint n)
+{
+  using S = typename V2::value_type;
+  switch (n) {
+  case 2: sol::stack::push(L, V2(S(v[0]), S(v[1]))); break;
+  case 3: sol::stack::push(L, V3(S(v[0]), S(v[1]), S(v[2]))); break;
+  default: sol::stack::push(L, V4(S(v[0]), S(v[1]), S(v[2]), S(v[3]))); break;
+  }
+}
+
+template<class T>
+static void readNumericArray(NumericDataInterface const* numeric, T* out, size_t count)
+{
+  size_t len = 0;
+  if constexpr (std::is_same<T, int32_t>::value)
+    numeric->getInt32Array(out, len, 0, count);
+  else if constexpr (std::is_same<T, uint32_t>::value)
+    numeric->getUint32Array(out, len, 0, count);
+  else if constexpr (std::is_same<T, int64_t>::value)
+    numeric->getInt64Array(out, len, 0, count);
+  else if constexpr (std::is_same<T, uint64_t>::value)
+    numeric->getUint64Array(out, len, 0, count);
+  else if constexpr (std::is_same<T, float>::value)
+    numeric->getFloatArray(out, len, 0, count);
+  else
+    numeric->getDoubleArray(out, len, 0, count);
+}
+
+/// syntax:
+///   table:array('P')    -- read-only array of numeric column 'P'
+///   table:mutArray('P') -- writable, makes the table and the column unique first
+static LuaColumnArray makeColumnArray(DataTable* table, String const& name, bool writable)
+{
+  RUNTIME_CHECK(table, "DataTable was nil");
+  DataColumn* col = writable ? table->mutColumn(name) : table->getColumn(name);
+  RUNTIME_CHECK(col, "column \"{}\" cannot be found", name);
+  auto* numeric = col->asNumericData();
+  RUNTIME_CHECK(numeric && !col->desc().container, "column \"{}\" of type {} is not numeric",
+                name, dataTypeName(col->dataType()));
+
+  LuaColumnArray arr;
+  arr.table     = table;
+  arr.column    = col;
+  arr.type      = col->dataType();
+  arr.tupleSize = col->tupleSize();
+  arr.numRows   = table->numRows();
+  size_t const count = table->numIndices() * arr.tupleSize;
+  arr.count     = count;
+  RUNTIME_CHECK(col->length() * arr.tupleSize >= count, "column \"{}\" is shorter than its table", name);
+  if (count > 0) {
+    if (writable) {
+      arr.data  = numeric->getRawBufferRW(0, count, arr.type);
+      arr.cdata = arr.data;
+    } else if (!(arr.cdata = numeric->getRawBufferRO(0, count, arr.type))) {
+      visitNumericType(arr.type, [&](auto zero) {
+        using T = decltype(zero);
+        std::shared_ptr<T> copy(new T[count], std::default_delete<T[]>());
+        readNumericArray(numeric, copy.get(), count);
+        arr.cdata    = copy.get();
+        arr.snapshot = std::move(copy);
+      });
+    }
+    RUNTIME_CHECK(arr.cdata, "cannot access storage of column \"{}\"", name);
+  }
+
+  bool         identity = table->numRows() == table->numIndices();
+  Vector<sint> rowToIndex(arr.numRows);
+  for (sint row = 0, n = sint(arr.numRows); row < n; ++row) {
+    rowToIndex[row] = sint(table->getIndex(row).value());
+    identity &= rowToIndex[row] == row;
+  }
+  if (!identity)
+    arr.rowToIndex = std::move(rowToIndex);
+  arr.version = table->structureVersion(); // after making it and the column unique
+  return arr;
+}
+
+/// syntax: arr[row] -- number, or vec2/3/4 (ivec for integers) for tuples
+static int lua_ColumnArray_index(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  if (!lua_isinteger(L, 2))
+    return 0;
+  sint const row = sint(lua_tointeger(L, 2));
+  self->checkRow(row);
+  visitNumericType(self->type, [&](auto zero) {
+    using T = decltype(zero);
+    T const*   v = self->template get<T>() + self->base(row);
+    sint const n = self->tupleSize;
+    if (n == 1) {
+      pushLuaNumber(L, v[0]);
+    } else if (n <= 4) {
+      if constexpr (std::is_floating_point<T>::value)
+        pushLuaVector<vec2, vec3, vec4>(L, v, n);
+      else
+        pushLuaVector<ivec2, ivec3, ivec4>(L, v, n);
+    } else {
+      lua_createtable(L, int(n), 0);
+      for (sint c = 0; c < n; ++c) {
+        pushLuaNumber(L, v[c]);
+        lua_rawseti(L, -2, c + 1);
+      }
+    }
+  });
+  return 1;
+}
+
+/// syntax: arr:get(row, component)
+static int lua_ColumnArray_get(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  sint const row  = sint(luaL_checkinteger(L, 2));
+  sint const comp = sint(luaL_optinteger(L, 3, 0));
+  self->checkRow(row);
+  RUNTIME_CHECK(comp >= 0 && comp < self->tupleSize, "component {} out of range [0, {})", comp, self->tupleSize);
+  visitNumericType(self->type, [&](auto zero) {
+    using T = decltype(zero);
+    pushLuaNumber(L, self->template get<T>()[self->base(row) + comp]);
+  });
+  return 1;
+}
+
+/// components of a value at `stk`: number (goes to all components), vecN or array
+template<class T>
+static void readLuaTuple(lua_State* L, int stk, T* out, sint tupleSize)
+{
+  if (lua_isnumber(L, stk)) {
+    std::fill(out, out + tupleSize, toLuaNumber<T>(L, stk));
+  } else if (lua_istable(L, stk)) {
+    RUNTIME_CHECK(sint(lua_rawlen(L, stk)) == tupleSize, "expecting {} components", tupleSize);
+    for (sint c = 0; c < tupleSize; ++c) {
+      lua_rawgeti(L, stk, c + 1);
+      out[c] = toLuaNumber<T>(L, -1);
+      lua_pop(L, 1);
+    }
+  } else {
+    real v[4];
+    sint n = 0;
+    if (sol::stack::check<vec2>(L, stk)) {
+      auto x = sol::stack::get<vec2>(L, stk); n = 2; v[0] = x.x; v[1] = x.y;
+    } else if (sol::stack::check<vec3>(L, stk)) {
+      auto x = sol::stack::get<vec3>(L, stk); n = 3; v[0] = x.x; v[1] = x.y; v[2] = x.z;
+    } else if (sol::stack::check<vec4>(L, stk)) {
+      auto x = sol::stack::get<vec4>(L, stk); n = 4; v[0] = x.x; v[1] = x.y; v[2] = x.z; v[3] = x.w;
+    } else if (sol::stack::check<ivec2>(L, stk)) {
+      auto x = sol::stack::get<ivec2>(L, stk); n = 2; v[0] = x.x; v[1] = x.y;
+    } else if (sol::stack::check<ivec3>(L, stk)) {
+      auto x = sol::stack::get<ivec3>(L, stk); n = 3; v[0] = x.x; v[1] = x.y; v[2] = x.z;
+    } else if (sol::stack::check<ivec4>(L, stk)) {
+      auto x = sol::stack::get<ivec4>(L, stk); n = 4; v[0] = x.x; v[1] = x.y; v[2] = x.z; v[3] = x.w;
+    } else {
+      throw TypeError(fmt::format("cannot take a {} as column value", luaL_typename(L, stk)));
+    }
+    RUNTIME_CHECK(n == tupleSize, "expecting {} components, got {}", tupleSize, n);
+    for (sint c = 0; c < n; ++c)
+      out[c] = T(v[c]);
+  }
+}
+
+/// syntax: arr[row] = value -- number, vecN or {x, y, ...}
+static int lua_ColumnArray_newindex(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  self->checkWritable();
+  sint const row = sint(luaL_checkinteger(L, 2));
+  self->checkRow(row);
+  visitNumericType(self->type, [&](auto zero) {
+    using T = decltype(zero);
+    readLuaTuple(L, 3, self->template mut<T>() + self->base(row), self->tupleSize);
+  });
+  return 0;
+}
+
+/// syntax: arr:fill(value) -- value as in arr[row] = value
+static int lua_ColumnArray_fill(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  self->checkWritable();
+  visitNumericType(self->type, [&](auto zero) {
+    using T = decltype(zero);
+    T value[MAX_TUPLE_SIZE];
+    readLuaTuple(L, 2, value, self->tupleSize);
+    T* d = self->template mut<T>();
+    self->forEachRow([&](size_t b) { std::copy(value, value + self->tupleSize, d + b); });
+  });
+  lua_settop(L, 1);
+  return 1;
+}
+
+/// syntax: arr:map(function(x, y, ...) return x*2, y end)
+///         arr:map('x*2, y') -- expression over components x, y, z, w
+/// returned values replace the components, missing ones are left as they were
+static int lua_ColumnArray_map(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  self->checkWritable();
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    String const code = fmt::format("return function(x, y, z, w) return {} end", lua_tostring(L, 2));
+    if (luaL_loadstring(L, code.c_str()) != LUA_OK || lua_pcall(L, 0, 1, 0) != LUA_OK)
+      throw ExecutionError(fmt::format("bad map expression: {}", lua_tostring(L, -1)));
+    lua_replace(L, 2);
+  }
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  sint const ts = self->tupleSize;
+  visitNumericType(self->type, [&](auto zero) {
+    using T = decltype(zero);
+    T* d = self->template mut<T>();
+    self->forEachRow([&](size_t b) {
+      lua_pushvalue(L, 2);
+      for (sint c = 0; c < ts; ++c)
+        pushLuaNumber(L, d[b + c]);
+      if (lua_pcall(L, ts, ts, 0) != LUA_OK)
+        throw ExecutionError(fmt::format("map: {}", lua_tostring(L, -1)));
+      for (sint c = 0; c < ts; ++c)
+        if (!lua_isnil(L, c - ts))
+          d[b + c] = toLuaNumber<T>(L, c - ts);
+      lua_pop(L, ts);
+    });
+  });
+  lua_settop(L, 1);
+  return 1;
+}
+
+/// syntax: arr:sum() -- one sum per component
+static int lua_ColumnArray_sum(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  sint const ts = self->tupleSize;
+  visitNumericType(self->type, [&](auto zero) {
+    using T   = decltype(zero);
+    using Acc = std::conditional_t<std::is_floating_point<T>::value, double, int64_t>;
+    Acc      sums[MAX_TUPLE_SIZE] = {0};
+    T const* s = self->template get<T>();
+    self->forEachRow([&](size_t b) {
+      for (sint c = 0; c < ts; ++c)
+        sums[c] += Acc(s[b + c]);
+    });
+    for (sint c = 0; c < ts; ++c)
+      pushLuaNumber(L, sums[c]);
+  });
+  return int(ts);
+}
+
+struct ColumnAddOp { template<class A> static A apply(A a, A b) { return a + b; } };
+struct ColumnSubOp { template<class A> static A apply(A a, A b) { return a - b; } };
+struct ColumnMulOp { template<class A> static A apply(A a, A b) { return a * b; } };
+struct ColumnDivOp
+{
+  template<class A>
+  static A apply(A a, A b)
+  {
+    if constexpr (!std::is_floating_point<A>::value)
+      RUNTIME_CHECK(b != 0, "integer division by zero");
+    return a / b;
+  }
+};
+
+/// syntax: arr:add(other) -- other is a number or an array of same rows,
+///                           with same tuple size or a single component
+///         also arr:sub, arr:mul, arr:div
+template<class Op>
+static int lua_ColumnArray_binary(lua_State* L)
+{
+  auto* self = sol::stack::get<LuaColumnArray*>(L, 1);
+  self->checkValid();
+  self->checkWritable();
+  sint const ts = self->tupleSize;
+  if (lua_isnumber(L, 2)) {
+    bool const intOperand = lua_isinteger(L, 2);
+    visitNumericType(self->type, [&](auto zero) {
+      using T = decltype(zero);
+      using C = std::conditional_t<std::is_floating_point<T>::value, T, int64_t>;
+      T* d = self->template mut<T>();
+      if (!std::is_floating_point<T>::value && !intOperand) {
+        // integer column, real operand: compute in real
+        double const v = lua_tonumber(L, 2);
+        self->forEachRow([&](size_t b) {
+          for (sint c = 0; c < ts; ++c)
+            d[b + c] = T(Op::apply(double(d[b + c]), v));
+        });
+      } else {
+        C const v = toLuaNumber<C>(L, 2);
+        self->forEachRow([&](size_t b) {
+          for (sint c = 0; c < ts; ++c)
+            d[b + c] = T(Op::apply(C(d[b + c]), v));
+        });
+      }
+    });
+  } else {
+    RUNTIME_CHECK(sol::stack::check<LuaColumnArray>(L, 2), "expecting a number or a column array, got {}",
+                  luaL_typename(L, 2));
+    auto const* other = sol::stack::get<LuaColumnArray*>(L, 2);
+    other->checkValid();
+    RUNTIME_CHECK(other->numRows == self->numRows, "row count mismatch: {} vs {}", self->numRows, other->numRows);
+    RUNTIME_CHECK(other->tupleSize == ts || other->tupleSize == 1, "tuple size mismatch: {} vs {}", ts, other->tupleSize);
+    sint const stride = other->tupleSize == 1 ? 0 : 1;
+    visitNumericType(self->type, [&](auto zero) {
+      using T = decltype(zero);
+      visitNumericType(other->type, [&](auto otherZero) {
+        using U = decltype(otherZero);
+        using C = std::common_type_t<T, U>;
+        T*       d = self->template mut<T>();
+        U const* s = other->template get<U>();
+        for (sint row = 0, n = sint(self->numRows); row < n; ++row) {
+          size_t const db = self->base(row), sb = other->base(row);
+          for (sint c = 0; c < ts; ++c)
+            d[db + c] = T(Op::apply(C(d[db + c]), C(s[sb + c * stride])));
+        }
+      });
+    });
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+// Column Arrays }}}
+
 /// syntax: table:foreach(function(row) row.xxxx = row.yyy end)
 static int lua_DataTable_foreach(lua_State* L)
 {
@@ -507,6 +938,65 @@ static int lua_DataTable_foreach(lua_State* L)
   return 0;
 }
 
+/// syntax: table:parallel_foreach(function(row) row.out = row.a * 2 end, {'out'})
+///   rows are split into ranges, run as tasks in Lua states of their own: the function
+///   is copied there as bytecode, so it cannot capture locals, and globals it sets are
+///   not shared between ranges. Only the listed columns can be written, they must exist
+///   and be numeric.
+static int lua_DataTable_parallel_foreach(lua_State* L)
+{
+  auto* dt = sol::stack::get<DataTable*>(L, 1);
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  RUNTIME_CHECK(!lua_iscfunction(L, 2), "parallel_foreach: expected a lua function");
+  for (int i = 1; auto const* upvalue = lua_getupvalue(L, 2, i); ++i) {
+    lua_pop(L, 1);
+    RUNTIME_CHECK(std::strcmp(upvalue, "_ENV") == 0, "parallel_foreach: function cannot capture local \"{}\"", upvalue);
+  }
+
+  Vector<DataColumn*> writable;
+  if (!lua_isnoneornil(L, 3)) {
+    auto names = sol::stack::get<sol::as_table_t<std::vector<std::string>>>(L, 3);
+    for (auto const& name : names.value()) {
+      auto* col = dt->getColumn(name);
+      RUNTIME_CHECK(col, "column \"{}\" cannot be found", name);
+      RUNTIME_CHECK(isNumeric(col->dataType()) && !col->desc().container,
+                    "column \"{}\" of type {} cannot be written in parallel", name, dataTypeName(col->dataType()));
+      writable.push_back(dt->mutColumn(name));
+    }
+  }
+
+  String bytecode;
+  lua_pushvalue(L, 2);
+  lua_dump(L, [](lua_State*, void const* p, size_t size, void* ud) {
+    static_cast<String*>(ud)->append(static_cast<char const*>(p), size);
+    return 0;
+  }, &bytecode, 0);
+  lua_pop(L, 1);
+
+  auto&      tasks   = TaskContext::instance();
+  sint const numRows = dt->numRows();
+  sint const numJobs = std::max<sint>(1, std::min<sint>(numRows / 64, tasks.scheduler.config().workerThread.count));
+  tasks.parallelFor(size_t(numJobs), CostModel::instance().history("lua.parallel_foreach.row"), real(numRows) / numJobs,
+                    [&](size_t job) {
+    PROFILER_SCOPE("lua parallel_foreach", 0xf8f4ed);
+    detail::LuaStatePool::Lease lua(detail::LuaStateKind::READONLY);
+    auto* WL = lua.state();
+    lua.pushChunk(bytecode);
+    String error;
+    for (sint row = numRows * sint(job) / numJobs, end = numRows * sint(job + 1) / numJobs; row < end; ++row) {
+      lua_pushvalue(WL, -1);
+      sol::stack::push(WL, TableRowAccessor{dt, dt->getIndex(row), &writable});
+      if (lua_pcall(WL, 1, 0, 0) != LUA_OK) {
+        auto const* message = lua_tostring(WL, -1);
+        error = message ? message : "lua error";
+        break;
+      }
+    }
+    RUNTIME_CHECK(error.empty(), "parallel_foreach: {}", error);
+  });
+  return 0;
+}
+
 CORE_API void bindLuaTypes(lua_State* L, bool readonly)
 {
   PROFILER_SCOPE("bind types", 0xE3F9FD);
@@ -554,15 +1044,38 @@ CORE_API void bindLuaTypes(lua_State* L, bool readonly)
     "z",    &ivec4::z,
     "w",    &ivec4::w
   );
+  lua.new_usertype<OpEvalMetrics>(
+    "EvalMetrics",    sol::no_constructor,
+    "evalIndex",      sol::readonly(&OpEvalMetrics::evalIndex),
+    "wallSeconds",    sol::readonly(&OpEvalMetrics::wallSeconds),
+    "cpuSeconds",     sol::readonly(&OpEvalMetrics::cpuSeconds),
+    "queueSeconds",   sol::readonly(&OpEvalMetrics::queueSeconds),
+    "rowsIn",         sol::readonly(&OpEvalMetrics::rowsIn),
+    "rowsOut",        sol::readonly(&OpEvalMetrics::rowsOut),
+    "bytesAllocated", sol::readonly(&OpEvalMetrics::bytesAllocated),
+    "bytesCopied",    sol::readonly(&OpEvalMetrics::bytesCopied),
+    "diskCacheHit",   sol::readonly(&OpEvalMetrics::diskCacheHit),
+    "refill",         sol::readonly(&OpEvalMetrics::refill)
+  );
+  auto luaMetricsOf = [](OpContext const* ctx) {
+    std::vector<OpEvalMetrics> history;
+    if (ctx) {
+      auto metrics = ctx->metrics();
+      history.assign(metrics.begin(), metrics.end());
+    }
+    return sol::as_table(std::move(history));
+  };
   lua.new_usertype<OpNode>(
-    "Node", sol::no_constructor,
-    "name", &OpNode::name
+    "Node",    sol::no_constructor,
+    "name",    &OpNode::name,
+    "metrics", [luaMetricsOf](OpNode const* node) { return luaMetricsOf(node->context()); }
   );
   auto luaopgraph = lua.new_usertype<OpGraph>(
-    "Graph",    sol::no_constructor,
-    "name",     &OpGraph::name,
-    "node",     &OpGraph::node,
-    "children", &OpGraph::childNames
+    "Graph",         sol::no_constructor,
+    "name",          &OpGraph::name,
+    "node",          &OpGraph::node,
+    "children",      &OpGraph::childNames,
+    "metricsReport", [](OpGraph const* graph) { return metricsReport(graph); }
   );
   if (!readonly) {
     luaopgraph.set_function("addNode",    &OpGraph::addNode);
@@ -577,6 +1090,7 @@ CORE_API void bindLuaTypes(lua_State* L, bool readonly)
     "columns",    &DataTable::columnNames,
     "numRows",    &DataTable::numRows,
     "numIndices", &DataTable::numIndices,
+    "array",      [](DataTable* table, String const& name) { return makeColumnArray(table, name, false); },
     "__length",   &DataTable::numRows
     // "__index",    &TableRowAccessor::create
   );
@@ -591,7 +1105,27 @@ CORE_API void bindLuaTypes(lua_State* L, bool readonly)
     luadatatable.set_function("removeRow",    &DataTable::removeRow);
     luadatatable.set_function("removeRows",   &DataTable::removeRows);
     luadatatable.set_function("foreach",      lua_DataTable_foreach);
+    luadatatable.set_function("parallel_foreach", lua_DataTable_parallel_foreach);
+    luadatatable.set_function("mutArray",     [](DataTable* table, String const& name) {
+      return makeColumnArray(table, name, true);
+    });
   }
+  lua.new_usertype<LuaColumnArray>(
+    "ColumnArray",                 sol::no_constructor,
+    sol::meta_function::index,     lua_ColumnArray_index,
+    sol::meta_function::new_index, lua_ColumnArray_newindex,
+    sol::meta_function::length,    [](LuaColumnArray const& arr) { arr.checkValid(); return arr.numRows; },
+    "tupleSize", sol::readonly(&LuaColumnArray::tupleSize),
+    "writable",  &LuaColumnArray::writable,
+    "get",       lua_ColumnArray_get,
+    "sum",       lua_ColumnArray_sum,
+    "fill",      lua_ColumnArray_fill,
+    "map",       lua_ColumnArray_map,
+    "add",       lua_ColumnArray_binary<ColumnAddOp>,
+    "sub",       lua_ColumnArray_binary<ColumnSubOp>,
+    "mul",       lua_ColumnArray_binary<ColumnMulOp>,
+    "div",       lua_ColumnArray_binary<ColumnDivOp>
+  );
 
   auto luatableaccessor = lua.new_usertype<TableRowAccessor>(
     "RowAccessor", sol::no_constructor,
@@ -632,8 +1166,56 @@ CORE_API void bindLuaTypes(lua_State* L, bool readonly)
   lua.new_usertype<OpContext>(
     "Context",   sol::no_constructor,
     "arg",       [](OpContext* ctx, String const& name) { return &ctx->arg(name); },
-    "inputData", [](OpContext* ctx, int pin) { return ctx->fetchInputData(pin); }
+    "inputData", [](OpContext* ctx, int pin) { return ctx->fetchInputData(pin); },
+    "progress",  [](OpContext* ctx, real fraction, sol::optional<String> message) {
+      ctx->reportProgress(fraction, message.value_or(""));
+    },
+    "metrics",     luaMetricsOf,
+    "cacheHits",   &OpContext::cacheHits,
+    "cacheMisses", &OpContext::cacheMisses,
+    "copyAmplification", &OpContext::copyAmplification
   );
+
+  auto priorityOf = [](String const& name) {
+    if (name == "interactive")
+      return TaskPriority::INTERACTIVE;
+    RUNTIME_CHECK(name == "background", "unknown priority \"{}\"", name);
+    return TaskPriority::BACKGROUND;
+  };
+  auto priorityName = [](TaskPriority priority) {
+    return priority == TaskPriority::INTERACTIVE ? "interactive" : "background";
+  };
+  auto luascheduler = lua.create_named_table("Scheduler");
+  luascheduler.set_function("running", &Scheduler::running);
+  luascheduler.set_function("config", [](sol::this_state L) {
+    auto config = Scheduler::config();
+    return sol::state_view(L).create_table_with(
+      "workerThreads", config.workerThreads,
+      "affinity",      sol::as_table(std::vector<sint>(config.affinity.begin(), config.affinity.end())));
+  });
+  luascheduler.set_function("priority", [priorityName] { return priorityName(Scheduler::threadPriority()); });
+  luascheduler.set_function("pendingTasks", [priorityOf](String const& priority) {
+    return Scheduler::pendingTasks(priorityOf(priority));
+  });
+  if (!readonly) {
+    // {workerThreads = 4, affinity = "0-3"} or affinity = {0, 1, 2, 3}
+    luascheduler.set_function("configure", [](sol::table options) {
+      auto config = Scheduler::config();
+      config.workerThreads = options.get_or("workerThreads", config.workerThreads);
+      sol::object affinity = options["affinity"];
+      if (affinity.is<String>()) {
+        config.affinity = Scheduler::parseCpuList(affinity.as<String>());
+      } else if (affinity.is<sol::table>()) {
+        config.affinity.clear();
+        for (auto const& [key, cpu] : affinity.as<sol::table>())
+          config.affinity.push_back(cpu.as<sint>());
+      }
+      return Scheduler::configure(config);
+    });
+    luascheduler.set_function("setPriority", [priorityOf, priorityName](String const& priority) {
+      return priorityName(Scheduler::setThreadPriority(priorityOf(priority)));
+    });
+  }
 }
 
 END_JOYFLOW_NAMESPACE
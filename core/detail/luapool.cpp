@@ -0,0 +1,160 @@
+#include "luapool.h"
+#include "../luabinding.h"
+#include "../profiler.h"
+#include "../vector.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include <mimalloc.h>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+static void* pooled_lua_alloc(void*, void* ptr, size_t, size_t nsize)
+{
+  if (nsize == 0) {
+    mi_free(ptr);
+    return nullptr;
+  }
+  return mi_realloc(ptr, nsize);
+}
+
+static LuaStatePool::PooledState newPooledState(LuaStateKind kind)
+{
+  PROFILER_SCOPE("lua init", 0xD6ECF0);
+  LuaStatePool::PooledState state;
+  state.L = lua_newstate(pooled_lua_alloc, nullptr);
+  sol::set_default_state(state.L);
+  if (kind == LuaStateKind::PLAIN) {
+    sol::state_view(state.L).open_libraries(sol::lib::base,
+                                            sol::lib::string,
+                                            sol::lib::table,
+                                            sol::lib::math,
+                                            sol::lib::bit32,
+                                            sol::lib::utf8);
+  } else {
+    bindLuaTypes(state.L, kind == LuaStateKind::READONLY);
+  }
+  lua_newtable(state.L);
+  state.chunkCache = luaL_ref(state.L, LUA_REGISTRYINDEX);
+  return state;
+}
+
+/// states of this thread not in use, closed when the thread ends
+struct LuaThreadPool
+{
+  Vector<LuaStatePool::PooledState> idle[size_t(LuaStateKind::COUNT)];
+
+  ~LuaThreadPool()
+  {
+    for (auto& states : idle)
+      for (auto& state : states)
+        lua_close(state.L);
+  }
+
+  LuaStatePool::PooledState acquire(LuaStateKind kind)
+  {
+    auto& states = idle[size_t(kind)];
+    if (states.empty())
+      return newPooledState(kind);
+    auto state = states.back();
+    states.pop_back();
+    return state;
+  }
+
+  void release(LuaStateKind kind, LuaStatePool::PooledState state)
+  {
+    auto& states = idle[size_t(kind)];
+    if (states.size() < LuaStatePool::MAX_IDLE)
+      states.push_back(state);
+    else
+      lua_close(state.L);
+  }
+};
+
+static thread_local LuaThreadPool t_luaPool;
+
+LuaStatePool::Lease::Lease(LuaStateKind kind) : state_(t_luaPool.acquire(kind)), kind_(kind)
+{
+  sol::state_view lua(state_.L);
+  env_ = sol::environment(lua, sol::create, lua.globals());
+}
+
+LuaStatePool::Lease::~Lease()
+{
+  auto* L = state_.L;
+  lua_settop(L, 0);
+  // cached chunks may still have it as _ENV, leave nothing in there
+  env_.push();
+  lua_pushnil(L);
+  while (lua_next(L, -2)) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    lua_rawset(L, -4);
+  }
+  lua_settop(L, 0);
+  env_ = sol::environment();
+  // bound states may hold on to data through userdata scripts made,
+  // nothing of it should outlive the lease
+  if (kind_ == LuaStateKind::PLAIN)
+    lua_gc(L, LUA_GCSTEP, 0);
+  else
+    lua_gc(L, LUA_GCCOLLECT, 0);
+  t_luaPool.release(kind_, state_);
+}
+
+void LuaStatePool::Lease::pushChunk(String const& code)
+{
+  auto* L = state_.L;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, state_.chunkCache);
+  lua_pushlstring(L, code.data(), code.size());
+  lua_rawget(L, -2);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    if (luaL_loadbuffer(L, code.data(), code.size(), code.c_str()) != LUA_OK) {
+      String message = lua_tostring(L, -1);
+      lua_pop(L, 2);
+      throw sol::error(message);
+    }
+    if (state_.numChunks >= MAX_CHUNKS) {
+      lua_newtable(L);
+      lua_replace(L, -3);
+      lua_pushvalue(L, -2);
+      lua_rawseti(L, LUA_REGISTRYINDEX, state_.chunkCache);
+      state_.numChunks = 0;
+    }
+    lua_pushlstring(L, code.data(), code.size());
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+    ++state_.numChunks;
+  }
+  lua_remove(L, -2); // cache table
+
+  // a chunk's only upvalue is _ENV, functions loaded from bytecode may have none
+  env_.push();
+  if (!lua_setupvalue(L, -2, 1))
+    lua_pop(L, 1);
+}
+
+sol::object LuaStatePool::Lease::run(String const& code)
+{
+  auto* L   = state_.L;
+  int   top = lua_gettop(L);
+  pushChunk(code);
+  if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+    char const* message = lua_tostring(L, -1);
+    String      what    = message ? message : "lua error";
+    lua_settop(L, top);
+    throw sol::error(what);
+  }
+  sol::object result(L, -1);
+  lua_settop(L, top);
+  return result;
+}
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
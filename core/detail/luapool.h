@@ -0,0 +1,69 @@
+#pragma once
+#include "../def.h"
+
+#include <sol/sol.hpp>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+enum class LuaStateKind : uint8_t
+{
+  PLAIN,    //< standard libraries only, for argument expressions
+  READONLY, //< bindLuaTypes(L, true)
+  FULL,     //< bindLuaTypes(L)
+
+  COUNT
+};
+
+/// Lua states with libraries opened and types bound, ready to run scripts
+///
+/// States are pooled per thread and never leave the thread that made them; fibers
+/// waiting in the middle of a script keep their lease, others get another state.
+/// Each lease runs in an environment of its own that falls back to the globals, so
+/// whatever a script assigns is gone for the next one. Compiled chunks are cached
+/// per state, keyed by their source text.
+class LuaStatePool
+{
+public:
+  struct PooledState
+  {
+    lua_State* L          = nullptr;
+    int        chunkCache = 0; //< registry ref of {source = function}
+    sint       numChunks  = 0;
+  };
+
+  class Lease
+  {
+    PooledState      state_;
+    LuaStateKind     kind_;
+    sol::environment env_;
+
+  public:
+    explicit Lease(LuaStateKind kind);
+    ~Lease();
+
+    Lease(Lease const&) = delete;
+    Lease& operator=(Lease const&) = delete;
+
+    lua_State*        state() const { return state_.L; }
+    sol::environment& env() { return env_; }
+
+    /// pushes the function compiled from `code`, source or bytecode, taken from cache
+    /// if compiled before, with my environment as its _ENV; throws sol::error when
+    /// `code` doesn't compile
+    void        pushChunk(String const& code);
+    /// compiles and runs `code` in my environment, returns its first result,
+    /// throws sol::error when it fails
+    sol::object run(String const& code);
+  };
+
+  /// idle states kept per thread and kind, more are closed when returned
+  static constexpr size_t MAX_IDLE = 4;
+  /// compiled chunks kept per state, the cache starts over when full
+  static constexpr sint MAX_CHUNKS = 256;
+};
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
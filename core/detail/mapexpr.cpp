@@ -0,0 +1,1100 @@
+#include "mapexpr.h"
+#include "runtime.h"
+#include "../datatable.h"
+#include "../error.h"
+#include "../profiler.h"
+#include "../traits.h"
+
+#include <fast_float/fast_float.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+// Tokens {{{
+struct MapToken
+{
+  enum Kind : uint8_t
+  {
+    END,
+    NEWLINE,
+    NUMBER,
+    STRING,
+    NAME,
+    COLUMN, //< ${any column name}
+    PUNCT
+  };
+  Kind   kind  = END;
+  String text;
+  real   value = 0;
+  sint   line  = 1;
+};
+
+static bool isNameStart(char c) { return std::isalpha(uint8_t(c)) || c == '_'; }
+static bool isNameChar(char c) { return std::isalnum(uint8_t(c)) || c == '_'; }
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+/// newlines end statements, except inside parentheses;
+/// `#` and `//` start comments
+static Vector<MapToken> tokenize(String const& code)
+{
+  Vector<MapToken> tokens;
+  sint             line  = 1;
+  sint             depth = 0;
+  char const*      p     = code.data();
+  char const*      end   = p + code.size();
+  auto const push = [&](MapToken::Kind kind, String text, real value = 0) {
+    MapToken token;
+    token.kind  = kind;
+    token.text  = std::move(text);
+    token.value = value;
+    token.line  = line;
+    tokens.push_back(std::move(token));
+  };
+  while (p < end) {
+    char const c = *p;
+    if (c == '\n') {
+      if (depth == 0)
+        push(MapToken::NEWLINE, "\n");
+      ++line;
+      ++p;
+    } else if (std::isspace(uint8_t(c))) {
+      ++p;
+    } else if (c == '#' || (c == '/' && p + 1 < end && p[1] == '/')) {
+      while (p < end && *p != '\n')
+        ++p;
+    } else if (isDigit(c) || (c == '.' && p + 1 < end && isDigit(p[1]))) {
+      char const* q = p;
+      while (q < end && isDigit(*q))
+        ++q;
+      if (q < end && *q == '.' && !(q + 1 < end && q[1] == '.')) { // `1..x` concatenates
+        ++q;
+        while (q < end && isDigit(*q))
+          ++q;
+      }
+      if (q < end && (*q == 'e' || *q == 'E')) {
+        char const* e = q + 1;
+        if (e < end && (*e == '+' || *e == '-'))
+          ++e;
+        if (e < end && isDigit(*e)) {
+          q = e;
+          while (q < end && isDigit(*q))
+            ++q;
+        }
+      }
+      real value = 0;
+      auto [parsed, ec] = fast_float::from_chars(p, q, value);
+      RUNTIME_CHECK(ec == std::errc() && parsed == q, "map: line {}: bad number \"{}\"", line, String(p, q));
+      push(MapToken::NUMBER, String(p, q), value);
+      p = q;
+    } else if (isNameStart(c)) {
+      char const* q = p;
+      while (q < end && isNameChar(*q))
+        ++q;
+      push(MapToken::NAME, String(p, q));
+      p = q;
+    } else if (c == '$' && p + 1 < end && p[1] == '{') {
+      char const* q = std::find(p + 2, end, '}');
+      RUNTIME_CHECK(q < end, "map: line {}: unclosed \"${{\"", line);
+      push(MapToken::COLUMN, String(p + 2, q));
+      p = q + 1;
+    } else if (c == '"' || c == '\'') {
+      String text;
+      char const* q = p + 1;
+      for (; q < end && *q != c && *q != '\n'; ++q) {
+        if (*q == '\\' && q + 1 < end) {
+          ++q;
+          switch (*q) {
+          case 'n': text += '\n'; break;
+          case 't': text += '\t'; break;
+          default:  text += *q; break;
+          }
+        } else {
+          text += *q;
+        }
+      }
+      RUNTIME_CHECK(q < end && *q == c, "map: line {}: unfinished string", line);
+      push(MapToken::STRING, std::move(text));
+      p = q + 1;
+    } else {
+      static char const* const pairs[] = {"..", "==", "!=", "<=", ">=", "&&", "||"};
+      String text(1, c);
+      for (auto const* pair : pairs) {
+        if (p + 1 < end && c == pair[0] && p[1] == pair[1]) {
+          text = pair;
+          break;
+        }
+      }
+      RUNTIME_CHECK(text.size() == 2 || std::strchr("+-*/%^<>!?:(),.=;", c),
+                    "map: line {}: unexpected character '{}'", line, c);
+      if (c == '(')
+        ++depth;
+      else if (c == ')' && depth > 0)
+        --depth;
+      push(MapToken::PUNCT, text);
+      p += text.size();
+    }
+  }
+  push(MapToken::END, "");
+  return tokens;
+}
+// Tokens }}}
+
+// Compiler {{{
+/// recursive descent, emitting instructions as it goes:
+///
+///   statement := column '=' expr
+///   expr      := or ('?' expr ':' expr)?
+///   or        := and ('||' and)*
+///   and       := compare ('&&' compare)*
+///   compare   := concat (('<'|'<='|'>'|'>='|'=='|'!=') concat)?
+///   concat    := sum ('..' sum)*
+///   sum       := product (('+'|'-') product)*
+///   product   := unary (('*'|'/'|'%') unary)*
+///   unary     := ('-'|'+'|'!') unary | power
+///   power     := postfix ('^' unary)?
+///   postfix   := primary ('.' swizzle)*
+///   primary   := number | string | column | name '(' args ')' | '(' expr ')'
+class MapCompiler
+{
+  struct Value
+  {
+    sint                       reg      = -1;
+    sint                       width    = 1;
+    bool                       isString = false;
+    Vector<MapStatement::Part> parts;
+  };
+
+  struct ColumnType
+  {
+    bool isString = false;
+    sint width    = 1;
+  };
+
+  MapProgram&                 program_;
+  DataTable const*            table_;
+  Vector<MapToken>            tokens_;
+  size_t                      pos_  = 0;
+  MapStatement*               stmt_ = nullptr;
+  Vector<sint>                freeRegs_[5]; // by width
+  HashMap<String, ColumnType> assigned_;
+  HashMap<String, sint>       inputSlots_;
+
+public:
+  MapCompiler(MapProgram& program, DataTable const* table, String const& code)
+      : program_(program), table_(table), tokens_(tokenize(code))
+  {
+  }
+
+  void compile()
+  {
+    while (true) {
+      while (isPunct(";") || peek().kind == MapToken::NEWLINE)
+        ++pos_;
+      if (peek().kind == MapToken::END)
+        break;
+      statement();
+    }
+  }
+
+private:
+  MapToken const& peek() const { return tokens_[pos_]; }
+  sint            line() const { return peek().line; }
+  bool            isPunct(char const* text) const
+  {
+    return peek().kind == MapToken::PUNCT && peek().text == text;
+  }
+  bool accept(char const* text)
+  {
+    if (!isPunct(text))
+      return false;
+    ++pos_;
+    return true;
+  }
+  void expect(char const* text)
+  {
+    RUNTIME_CHECK(accept(text), "map: line {}: expecting \"{}\", got \"{}\"", line(), text, describe(peek()));
+  }
+  static String describe(MapToken const& token)
+  {
+    switch (token.kind) {
+    case MapToken::END:     return "end of code";
+    case MapToken::NEWLINE: return "end of line";
+    case MapToken::STRING:  return fmt::format("\"{}\"", token.text);
+    default:                return token.text;
+    }
+  }
+
+  // registers {{{
+  sint alloc(sint width)
+  {
+    if (!freeRegs_[width].empty())
+      return freeRegs_[width].pop_back();
+    program_.regWidth_.push_back(width);
+    program_.regOffset_.push_back(program_.regSize_);
+    program_.regSize_ += size_t(width);
+    return sint(program_.regWidth_.size()) - 1;
+  }
+  void release(Value const& v)
+  {
+    if (!v.isString && v.reg >= 0)
+      freeRegs_[v.width].push_back(v.reg);
+  }
+  void emit(MapInstr const& instr) { stmt_->code.push_back(instr); }
+  Value numeric(sint reg, sint width)
+  {
+    Value v;
+    v.reg   = reg;
+    v.width = width;
+    return v;
+  }
+  // registers }}}
+
+  // types {{{
+  void checkNumeric(Value const& v, char const* what) const
+  {
+    if (v.isString)
+      throw TypeError(fmt::format("map: line {}: {} takes numbers, got a string", stmt_->line, what));
+  }
+  /// operands of width 1 are broadcast to the others
+  sint commonWidth(std::initializer_list<Value const*> values, char const* what) const
+  {
+    sint width = 1;
+    for (auto const* v : values) {
+      checkNumeric(*v, what);
+      if (v->width == 1 || v->width == width)
+        continue;
+      if (width != 1)
+        throw TypeError(fmt::format("map: line {}: {} got vectors of {} and {} components", stmt_->line, what, width, v->width));
+      width = v->width;
+    }
+    return width;
+  }
+  ColumnType columnType(String const& name) const
+  {
+    if (auto found = assigned_.find(name); found != assigned_.end())
+      return found->second;
+    auto const* col = table_->getColumn(name);
+    RUNTIME_CHECK(col, "map: line {}: column \"{}\" does not exist", stmt_->line, name);
+    ColumnType type;
+    if (col->dataType() == DataType::STRING) {
+      type.isString = true;
+    } else if (isNumeric(col->dataType()) && !col->desc().container && col->tupleSize() <= 4) {
+      type.width = col->tupleSize();
+    } else {
+      throw TypeError(fmt::format("map: line {}: column \"{}\" of type {}{} is neither numeric nor string",
+                                  stmt_->line, name, dataTypeName(col->dataType()), col->desc().container ? "[]" : ""));
+    }
+    return type;
+  }
+  // types }}}
+
+  // emitters {{{
+  Value unary(MapOpcode op, Value const& a, char const* what)
+  {
+    checkNumeric(a, what);
+    MapInstr instr;
+    instr.op  = op;
+    instr.dst = alloc(a.width);
+    instr.a   = a.reg;
+    emit(instr);
+    release(a);
+    return numeric(instr.dst, a.width);
+  }
+  Value binary(MapOpcode op, Value const& a, Value const& b, char const* what)
+  {
+    sint const width = commonWidth({&a, &b}, what);
+    MapInstr   instr;
+    instr.op  = op;
+    instr.dst = alloc(width);
+    instr.a   = a.reg;
+    instr.b   = b.reg;
+    emit(instr);
+    release(a);
+    release(b);
+    return numeric(instr.dst, width);
+  }
+  Value ternary(MapOpcode op, Value const& a, Value const& b, Value const& c, char const* what)
+  {
+    sint const width = commonWidth({&a, &b, &c}, what);
+    MapInstr   instr;
+    instr.op  = op;
+    instr.dst = alloc(width);
+    instr.a   = a.reg;
+    instr.b   = b.reg;
+    instr.c   = c.reg;
+    emit(instr);
+    release(a);
+    release(b);
+    release(c);
+    return numeric(instr.dst, width);
+  }
+  Value constant(real value)
+  {
+    MapInstr instr;
+    instr.op    = MapOpcode::CONST;
+    instr.dst   = alloc(1);
+    instr.value = value;
+    emit(instr);
+    return numeric(instr.dst, 1);
+  }
+  /// components of `sources` packed into a new register
+  Value pack(Vector<Pair<sint, sint>> const& sources)
+  {
+    sint const dst = alloc(sint(sources.size()));
+    for (sint i = 0, n = sint(sources.size()); i < n; ++i) {
+      MapInstr instr;
+      instr.op      = MapOpcode::COPY;
+      instr.dst     = dst;
+      instr.dstComp = i;
+      instr.a       = sources[i].first;
+      instr.aComp   = sources[i].second;
+      emit(instr);
+    }
+    return numeric(dst, sint(sources.size()));
+  }
+  Value column(String const& name)
+  {
+    auto const type = columnType(name);
+    if (type.isString) {
+      Value v;
+      v.isString = true;
+      v.parts.push_back({MapStatement::Part::COLUMN, name});
+      return v;
+    }
+    auto slot = inputSlots_.find(name);
+    if (slot == inputSlots_.end()) {
+      slot = inputSlots_.emplace(name, sint(program_.inputs_.size())).first;
+      program_.inputs_.push_back(name);
+    }
+    MapInstr instr;
+    instr.op  = MapOpcode::LOAD;
+    instr.dst = alloc(type.width);
+    instr.a   = slot->second;
+    emit(instr);
+    return numeric(instr.dst, type.width);
+  }
+  static Vector<MapStatement::Part> toParts(Value const& v)
+  {
+    if (v.isString)
+      return v.parts;
+    MapStatement::Part part;
+    part.kind  = MapStatement::Part::NUMBER;
+    part.reg   = v.reg;
+    part.width = v.width;
+    return {part};
+  }
+  // emitters }}}
+
+  // parsing {{{
+  void statement()
+  {
+    auto& stmt = program_.statements_.emplace_back();
+    stmt_      = &stmt;
+    stmt.line  = line();
+    for (sint w = 1; w <= 4; ++w)
+      freeRegs_[w].clear();
+    for (sint r = sint(program_.regWidth_.size()) - 1; r >= 0; --r)
+      freeRegs_[program_.regWidth_[r]].push_back(r);
+
+    auto const& target = peek();
+    RUNTIME_CHECK(target.kind == MapToken::NAME || target.kind == MapToken::COLUMN,
+                  "map: line {}: expecting a column name, got \"{}\"", stmt.line, describe(target));
+    stmt.column = target.text;
+    ++pos_;
+    expect("=");
+    Value value = expr();
+    RUNTIME_CHECK(accept(";") || peek().kind == MapToken::NEWLINE || peek().kind == MapToken::END,
+                  "map: line {}: unexpected \"{}\"", line(), describe(peek()));
+
+    ColumnType type;
+    bool const exists = assigned_.count(stmt.column) || table_->getColumn(stmt.column);
+    if (exists) {
+      type = columnType(stmt.column);
+    } else {
+      type.isString = value.isString;
+      type.width    = value.width;
+    }
+    if (type.isString) {
+      stmt.isString = true;
+      stmt.parts    = toParts(value);
+    } else {
+      if (value.isString)
+        throw TypeError(fmt::format("map: line {}: cannot assign a string to numeric column \"{}\"", stmt.line, stmt.column));
+      if (value.width != 1 && value.width != type.width)
+        throw TypeError(fmt::format("map: line {}: cannot assign {} components to column \"{}\" of {}",
+                                    stmt.line, value.width, stmt.column, type.width));
+      stmt.result = value.reg;
+      stmt.width  = value.width;
+    }
+    assigned_[stmt.column] = type;
+  }
+
+  Value expr()
+  {
+    Value cond = orExpr();
+    if (!accept("?"))
+      return cond;
+    Value a = expr();
+    expect(":");
+    Value b = expr();
+    return ternary(MapOpcode::SELECT, cond, a, b, "?:");
+  }
+
+  Value orExpr()
+  {
+    Value v = andExpr();
+    while (accept("||"))
+      v = binary(MapOpcode::OR, v, andExpr(), "||");
+    return v;
+  }
+
+  Value andExpr()
+  {
+    Value v = compare();
+    while (accept("&&"))
+      v = binary(MapOpcode::AND, v, compare(), "&&");
+    return v;
+  }
+
+  Value compare()
+  {
+    static Pair<char const*, MapOpcode> const ops[] = {
+      {"<", MapOpcode::LT}, {"<=", MapOpcode::LE}, {">", MapOpcode::GT},
+      {">=", MapOpcode::GE}, {"==", MapOpcode::EQ}, {"!=", MapOpcode::NE}};
+    Value v = concat();
+    for (auto const& op : ops)
+      if (accept(op.first))
+        return binary(op.second, v, concat(), op.first);
+    return v;
+  }
+
+  Value concat()
+  {
+    Value v = sum();
+    while (accept("..")) {
+      Value rhs    = sum();
+      auto  parts  = toParts(v);
+      auto  rparts = toParts(rhs);
+      v            = Value();
+      v.isString   = true;
+      v.parts      = std::move(parts);
+      for (auto& part : rparts)
+        v.parts.push_back(std::move(part));
+    }
+    return v;
+  }
+
+  Value sum()
+  {
+    Value v = product();
+    while (true) {
+      if (accept("+"))
+        v = binary(MapOpcode::ADD, v, product(), "+");
+      else if (accept("-"))
+        v = binary(MapOpcode::SUB, v, product(), "-");
+      else
+        return v;
+    }
+  }
+
+  Value product()
+  {
+    Value v = unaryExpr();
+    while (true) {
+      if (accept("*"))
+        v = binary(MapOpcode::MUL, v, unaryExpr(), "*");
+      else if (accept("/"))
+        v = binary(MapOpcode::DIV, v, unaryExpr(), "/");
+      else if (accept("%"))
+        v = binary(MapOpcode::MOD, v, unaryExpr(), "%");
+      else
+        return v;
+    }
+  }
+
+  Value unaryExpr()
+  {
+    if (accept("-"))
+      return unary(MapOpcode::NEG, unaryExpr(), "-");
+    if (accept("!"))
+      return unary(MapOpcode::NOT, unaryExpr(), "!");
+    if (accept("+")) {
+      Value v = unaryExpr();
+      checkNumeric(v, "+");
+      return v;
+    }
+    return power();
+  }
+
+  Value power()
+  {
+    Value v = postfix();
+    if (accept("^"))
+      return binary(MapOpcode::POW, v, unaryExpr(), "^");
+    return v;
+  }
+
+  Value postfix()
+  {
+    Value v = primary();
+    while (accept(".")) {
+      RUNTIME_CHECK(peek().kind == MapToken::NAME, "map: line {}: expecting components after \".\"", line());
+      String const swizzle = peek().text;
+      ++pos_;
+      checkNumeric(v, "\".\"");
+      RUNTIME_CHECK(swizzle.size() <= 4, "map: line {}: too many components in \".{}\"", line(), swizzle);
+      Vector<Pair<sint, sint>> sources;
+      for (char c : swizzle) {
+        char const* xyzw = std::strchr("xyzw", c);
+        char const* rgba = std::strchr("rgba", c);
+        sint const  comp = xyzw ? sint(xyzw - "xyzw") : rgba ? sint(rgba - "rgba") : 4;
+        RUNTIME_CHECK(comp < v.width, "map: line {}: no component \"{}\" in a value of {}", line(), c, v.width);
+        sources.push_back({v.reg, comp});
+      }
+      Value swizzled = pack(sources);
+      release(v);
+      v = swizzled;
+    }
+    return v;
+  }
+
+  Value primary()
+  {
+    MapToken const token = peek();
+    switch (token.kind) {
+    case MapToken::NUMBER:
+      ++pos_;
+      return constant(token.value);
+    case MapToken::STRING: {
+      ++pos_;
+      Value v;
+      v.isString = true;
+      v.parts.push_back({MapStatement::Part::LITERAL, token.text});
+      return v;
+    }
+    case MapToken::COLUMN:
+      ++pos_;
+      return column(token.text);
+    case MapToken::NAME:
+      ++pos_;
+      if (accept("("))
+        return call(token.text);
+      return column(token.text);
+    default:
+      break;
+    }
+    expect("(");
+    Value v = expr();
+    expect(")");
+    return v;
+  }
+
+  Value call(String const& name)
+  {
+    Vector<Value> args;
+    if (!accept(")")) {
+      do {
+        args.push_back(expr());
+      } while (accept(","));
+      expect(")");
+    }
+    sint const numArgs = sint(args.size());
+    auto const arity   = [&](sint n) {
+      RUNTIME_CHECK(numArgs == n, "map: line {}: {}() takes {} argument(s), got {}", stmt_->line, name, n, numArgs);
+    };
+
+    static Pair<char const*, MapOpcode> const unaryFunctions[] = {
+      {"abs", MapOpcode::ABS},   {"sqrt", MapOpcode::SQRT}, {"floor", MapOpcode::FLOOR},
+      {"ceil", MapOpcode::CEIL}, {"round", MapOpcode::ROUND}, {"sin", MapOpcode::SIN},
+      {"cos", MapOpcode::COS},   {"tan", MapOpcode::TAN},   {"asin", MapOpcode::ASIN},
+      {"acos", MapOpcode::ACOS}, {"exp", MapOpcode::EXP},   {"log", MapOpcode::LOG}};
+    static Pair<char const*, MapOpcode> const binaryFunctions[] = {
+      {"min", MapOpcode::MIN}, {"max", MapOpcode::MAX}, {"pow", MapOpcode::POW}, {"mod", MapOpcode::MOD}};
+    static Pair<char const*, MapOpcode> const ternaryFunctions[] = {
+      {"clamp", MapOpcode::CLAMP}, {"lerp", MapOpcode::LERP}, {"select", MapOpcode::SELECT}};
+
+    for (auto const& f : unaryFunctions)
+      if (name == f.first) {
+        arity(1);
+        return unary(f.second, args[0], f.first);
+      }
+    for (auto const& f : binaryFunctions)
+      if (name == f.first) {
+        arity(2);
+        return binary(f.second, args[0], args[1], f.first);
+      }
+    for (auto const& f : ternaryFunctions)
+      if (name == f.first) {
+        arity(3);
+        return ternary(f.second, args[0], args[1], args[2], f.first);
+      }
+
+    if (name == "atan") {
+      RUNTIME_CHECK(numArgs == 1 || numArgs == 2, "map: line {}: atan() takes 1 or 2 arguments, got {}", stmt_->line, numArgs);
+      return numArgs == 1 ? unary(MapOpcode::ATAN, args[0], "atan") : binary(MapOpcode::ATAN2, args[0], args[1], "atan");
+    }
+    if (name == "row") {
+      arity(0);
+      MapInstr instr;
+      instr.op  = MapOpcode::ROW;
+      instr.dst = alloc(1);
+      emit(instr);
+      return numeric(instr.dst, 1);
+    }
+    if (name == "dot" || name == "cross") {
+      arity(2);
+      sint const width = commonWidth({&args[0], &args[1]}, name.c_str());
+      RUNTIME_CHECK(args[0].width == args[1].width, "map: line {}: {}() takes vectors of the same size", stmt_->line, name);
+      RUNTIME_CHECK(name == "dot" || width == 3, "map: line {}: cross() takes vec3s", stmt_->line);
+      MapInstr instr;
+      instr.op  = name == "dot" ? MapOpcode::DOT : MapOpcode::CROSS;
+      instr.dst = alloc(name == "dot" ? 1 : 3);
+      instr.a   = args[0].reg;
+      instr.b   = args[1].reg;
+      emit(instr);
+      release(args[0]);
+      release(args[1]);
+      return numeric(instr.dst, name == "dot" ? 1 : 3);
+    }
+    if (name == "length" || name == "normalize") {
+      arity(1);
+      checkNumeric(args[0], name.c_str());
+      MapInstr instr;
+      instr.op  = name == "length" ? MapOpcode::LENGTH : MapOpcode::NORMALIZE;
+      instr.dst = alloc(name == "length" ? 1 : args[0].width);
+      instr.a   = args[0].reg;
+      emit(instr);
+      release(args[0]);
+      return numeric(instr.dst, name == "length" ? 1 : args[0].width);
+    }
+    if (name == "vec2" || name == "vec3" || name == "vec4") {
+      sint const               width = name[3] - '0';
+      Vector<Pair<sint, sint>> sources;
+      for (auto const& arg : args) {
+        checkNumeric(arg, name.c_str());
+        for (sint c = 0; c < arg.width; ++c)
+          sources.push_back({arg.reg, c});
+      }
+      if (sources.size() == 1)
+        while (sint(sources.size()) < width)
+          sources.push_back(sources.front());
+      RUNTIME_CHECK(sint(sources.size()) == width, "map: line {}: {}() got {} components", stmt_->line, name,
+                    sources.size());
+      Value v = pack(sources);
+      for (auto const& arg : args)
+        release(arg);
+      return v;
+    }
+    RUNTIME_CHECK(false, "map: line {}: unknown function {}()", stmt_->line, name);
+    return {};
+  }
+  // parsing }}}
+};
+
+MapProgram::MapProgram(String const& code, DataTable const* table)
+    : schema_(schemaOf(table))
+{
+  PROFILER_SCOPE("map compile", 0xC5E1A5);
+  MapCompiler(*this, table, code).compile();
+}
+
+String MapProgram::schemaOf(DataTable const* table)
+{
+  String schema;
+  for (auto const& name : table->columnNames()) {
+    auto const* col = table->getColumn(name);
+    schema += fmt::format("{}:{}:{}{};", name, dataTypeName(col->dataType()), col->tupleSize(),
+                          col->desc().container ? "[]" : "");
+  }
+  return schema;
+}
+// Compiler }}}
+
+// Evaluation {{{
+struct MapColumnRef
+{
+  DataColumn* column    = nullptr;
+  DataType    type      = DataType::UNKNOWN;
+  sint        tupleSize = 1;
+  void*       data      = nullptr; //< outputs
+  void const* cdata     = nullptr; //< inputs, null if storage was not filled up yet
+};
+
+struct MapProgram::Batch
+{
+  Vector<MapColumnRef> const& inputs;
+  sint const*                 rowToIndex; //< null when rows are indices
+  real*                       regs;
+  sint                        rowBase = 0; //< row() of the table's first row
+  sint                        row0 = 0;
+  sint                        size = 0;
+
+  size_t index(sint i) const { return size_t(rowToIndex ? rowToIndex[row0 + i] : row0 + i); }
+};
+
+template<class F>
+static void visitNumeric(DataType type, F&& f)
+{
+  switch (type) {
+  case DataType::INT32:  f(int32_t{}); break;
+  case DataType::UINT32: f(uint32_t{}); break;
+  case DataType::INT64:  f(int64_t{}); break;
+  case DataType::UINT64: f(uint64_t{}); break;
+  case DataType::FLOAT:  f(float{}); break;
+  case DataType::DOUBLE: f(double{}); break;
+  default:
+    throw TypeError(fmt::format("{} is not a numeric type", dataTypeName(type)));
+  }
+}
+
+/// components of the rows in `batch` into consecutive runs of BATCH at `dst`
+static void gather(MapColumnRef const& ref, MapProgram::Batch const& batch, real* dst)
+{
+  sint const ts = ref.tupleSize;
+  sint const n  = batch.size;
+  if (!ref.cdata) {
+    real   value[4];
+    size_t len = 0;
+    for (sint i = 0; i < n; ++i) {
+      ref.column->asNumericData()->getDoubleArray(value, len, batch.index(i) * ts, ts);
+      for (sint c = 0; c < ts; ++c)
+        dst[c * MapProgram::BATCH + i] = value[c];
+    }
+    return;
+  }
+  visitNumeric(ref.type, [&](auto zero) {
+    using T          = decltype(zero);
+    auto const* data = static_cast<T const*>(ref.cdata);
+    for (sint c = 0; c < ts; ++c) {
+      real* d = dst + c * MapProgram::BATCH;
+      if (batch.rowToIndex) {
+        for (sint i = 0; i < n; ++i)
+          d[i] = real(data[batch.index(i) * ts + c]);
+      } else {
+        T const* s = data + size_t(batch.row0) * ts + c;
+        for (sint i = 0; i < n; ++i)
+          d[i] = real(s[size_t(i) * ts]);
+      }
+    }
+  });
+}
+
+/// `src`, `width` runs of BATCH with width 1 broadcast, into the rows in `batch`
+static void scatter(MapColumnRef const& ref, MapProgram::Batch const& batch, real const* src, sint width)
+{
+  sint const ts = ref.tupleSize;
+  sint const n  = batch.size;
+  visitNumeric(ref.type, [&](auto zero) {
+    using T    = decltype(zero);
+    auto* data = static_cast<T*>(ref.data);
+    for (sint c = 0; c < ts; ++c) {
+      real const* s = src + (width == 1 ? 0 : c) * MapProgram::BATCH;
+      if (batch.rowToIndex) {
+        for (sint i = 0; i < n; ++i)
+          data[batch.index(i) * ts + c] = T(s[i]);
+      } else {
+        T* d = data + size_t(batch.row0) * ts + c;
+        for (sint i = 0; i < n; ++i)
+          d[size_t(i) * ts] = T(s[i]);
+      }
+    }
+  });
+}
+
+static void appendNumber(String& out, real value)
+{
+  if (std::trunc(value) == value && std::abs(value) < 1e15)
+    fmt::format_to(std::back_inserter(out), "{}", int64_t(value));
+  else
+    fmt::format_to(std::back_inserter(out), "{}", value);
+}
+
+void MapProgram::exec(Vector<MapInstr> const& code, Batch& batch) const
+{
+  sint const n   = batch.size;
+  auto const reg = [&](sint r, sint c) { return batch.regs + (regOffset_[r] + size_t(c)) * BATCH; };
+  // width 1 operands are broadcast
+  auto const src = [&](sint r, sint c) -> real const* {
+    return batch.regs + (regOffset_[r] + size_t(regWidth_[r] == 1 ? 0 : c)) * BATCH;
+  };
+
+#define MAP_UNARY(OP, EXPR)                    \
+  case MapOpcode::OP:                          \
+    for (sint c = 0; c < width; ++c) {         \
+      real*       d = reg(in.dst, c);          \
+      real const* x = src(in.a, c);            \
+      for (sint i = 0; i < n; ++i)             \
+        d[i] = EXPR;                           \
+    }                                          \
+    break
+#define MAP_BINARY(OP, EXPR)                   \
+  case MapOpcode::OP:                          \
+    for (sint c = 0; c < width; ++c) {         \
+      real*       d = reg(in.dst, c);          \
+      real const* x = src(in.a, c);            \
+      real const* y = src(in.b, c);            \
+      for (sint i = 0; i < n; ++i)             \
+        d[i] = EXPR;                           \
+    }                                          \
+    break
+#define MAP_TERNARY(OP, EXPR)                  \
+  case MapOpcode::OP:                          \
+    for (sint c = 0; c < width; ++c) {         \
+      real*       d = reg(in.dst, c);          \
+      real const* x = src(in.a, c);            \
+      real const* y = src(in.b, c);            \
+      real const* z = src(in.c, c);            \
+      for (sint i = 0; i < n; ++i)             \
+        d[i] = EXPR;                           \
+    }                                          \
+    break
+
+  for (auto const& in : code) {
+    sint const width = regWidth_[in.dst];
+    switch (in.op) {
+    case MapOpcode::LOAD:
+      gather(batch.inputs[in.a], batch, reg(in.dst, 0));
+      break;
+    case MapOpcode::CONST:
+      std::fill(reg(in.dst, 0), reg(in.dst, 0) + n, in.value);
+      break;
+    case MapOpcode::ROW: {
+      real* d = reg(in.dst, 0);
+      for (sint i = 0; i < n; ++i)
+        d[i] = real(batch.rowBase + batch.row0 + i);
+      break;
+    }
+    case MapOpcode::COPY:
+      std::copy(reg(in.a, in.aComp), reg(in.a, in.aComp) + n, reg(in.dst, in.dstComp));
+      break;
+
+    MAP_UNARY(NEG, -x[i]);
+    MAP_UNARY(NOT, real(x[i] == 0));
+    MAP_UNARY(ABS, std::abs(x[i]));
+    MAP_UNARY(SQRT, std::sqrt(x[i]));
+    MAP_UNARY(FLOOR, std::floor(x[i]));
+    MAP_UNARY(CEIL, std::ceil(x[i]));
+    MAP_UNARY(ROUND, std::round(x[i]));
+    MAP_UNARY(SIN, std::sin(x[i]));
+    MAP_UNARY(COS, std::cos(x[i]));
+    MAP_UNARY(TAN, std::tan(x[i]));
+    MAP_UNARY(ASIN, std::asin(x[i]));
+    MAP_UNARY(ACOS, std::acos(x[i]));
+    MAP_UNARY(ATAN, std::atan(x[i]));
+    MAP_UNARY(EXP, std::exp(x[i]));
+    MAP_UNARY(LOG, std::log(x[i]));
+
+    MAP_BINARY(ADD, x[i] + y[i]);
+    MAP_BINARY(SUB, x[i] - y[i]);
+    MAP_BINARY(MUL, x[i] * y[i]);
+    MAP_BINARY(DIV, x[i] / y[i]);
+    MAP_BINARY(MOD, std::fmod(x[i], y[i]));
+    MAP_BINARY(POW, std::pow(x[i], y[i]));
+    MAP_BINARY(MIN, std::min(x[i], y[i]));
+    MAP_BINARY(MAX, std::max(x[i], y[i]));
+    MAP_BINARY(ATAN2, std::atan2(x[i], y[i]));
+    MAP_BINARY(LT, real(x[i] < y[i]));
+    MAP_BINARY(LE, real(x[i] <= y[i]));
+    MAP_BINARY(GT, real(x[i] > y[i]));
+    MAP_BINARY(GE, real(x[i] >= y[i]));
+    MAP_BINARY(EQ, real(x[i] == y[i]));
+    MAP_BINARY(NE, real(x[i] != y[i]));
+    MAP_BINARY(AND, real(x[i] != 0 && y[i] != 0));
+    MAP_BINARY(OR, real(x[i] != 0 || y[i] != 0));
+
+    MAP_TERNARY(SELECT, x[i] != 0 ? y[i] : z[i]);
+    MAP_TERNARY(CLAMP, std::min(std::max(x[i], y[i]), z[i]));
+    MAP_TERNARY(LERP, x[i] + (y[i] - x[i]) * z[i]);
+
+    case MapOpcode::DOT:
+    case MapOpcode::LENGTH: {
+      real*      d = reg(in.dst, 0);
+      sint const b = in.op == MapOpcode::DOT ? in.b : in.a;
+      std::fill(d, d + n, real(0));
+      for (sint c = 0, w = regWidth_[in.a]; c < w; ++c) {
+        real const* x = reg(in.a, c);
+        real const* y = reg(b, c);
+        for (sint i = 0; i < n; ++i)
+          d[i] += x[i] * y[i];
+      }
+      if (in.op == MapOpcode::LENGTH)
+        for (sint i = 0; i < n; ++i)
+          d[i] = std::sqrt(d[i]);
+      break;
+    }
+    case MapOpcode::NORMALIZE: {
+      real scale[BATCH] = {0};
+      for (sint c = 0; c < width; ++c) {
+        real const* x = reg(in.a, c);
+        for (sint i = 0; i < n; ++i)
+          scale[i] += x[i] * x[i];
+      }
+      for (sint i = 0; i < n; ++i)
+        scale[i] = scale[i] > 0 ? 1 / std::sqrt(scale[i]) : 0;
+      for (sint c = 0; c < width; ++c) {
+        real*       d = reg(in.dst, c);
+        real const* x = reg(in.a, c);
+        for (sint i = 0; i < n; ++i)
+          d[i] = x[i] * scale[i];
+      }
+      break;
+    }
+    case MapOpcode::CROSS: {
+      real const *x0 = reg(in.a, 0), *x1 = reg(in.a, 1), *x2 = reg(in.a, 2);
+      real const *y0 = reg(in.b, 0), *y1 = reg(in.b, 1), *y2 = reg(in.b, 2);
+      real *      d0 = reg(in.dst, 0), *d1 = reg(in.dst, 1), *d2 = reg(in.dst, 2);
+      for (sint i = 0; i < n; ++i) {
+        d0[i] = x1[i] * y2[i] - x2[i] * y1[i];
+        d1[i] = x2[i] * y0[i] - x0[i] * y2[i];
+        d2[i] = x0[i] * y1[i] - x1[i] * y0[i];
+      }
+      break;
+    }
+    }
+  }
+#undef MAP_UNARY
+#undef MAP_BINARY
+#undef MAP_TERNARY
+}
+
+void MapProgram::run(DataTable* table, sint firstRow) const
+{
+  PROFILER_SCOPE("map", 0xC5E1A5);
+  size_t const numIndices = table->numIndices();
+  sint const   numRows    = sint(table->numRows());
+
+  // outputs first: creating columns and filling up their storage may move it
+  Vector<MapColumnRef> outputs(statements_.size());
+  for (size_t s = 0; s < statements_.size(); ++s) {
+    auto const& stmt = statements_[s];
+    DataColumn* col  = table->getColumn(stmt.column);
+    if (!col) {
+      if (stmt.isString) {
+        col = table->createColumn<String>(stmt.column);
+      } else {
+        switch (stmt.width) {
+        case 1:  col = table->createColumn<real>(stmt.column); break;
+        case 2:  col = table->createColumn<vec2>(stmt.column); break;
+        case 3:  col = table->createColumn<vec3>(stmt.column); break;
+        default: col = table->createColumn<vec4>(stmt.column); break;
+        }
+      }
+    }
+    RUNTIME_CHECK(col, "map: cannot create column \"{}\"", stmt.column);
+    col->makeUnique();
+    auto& ref     = outputs[s];
+    ref.column    = col;
+    ref.type      = col->dataType();
+    ref.tupleSize = col->tupleSize();
+    if (!stmt.isString && numIndices > 0) {
+      ref.data = col->asNumericData()->getRawBufferRW(0, numIndices * ref.tupleSize, ref.type);
+      RUNTIME_CHECK(ref.data, "map: cannot access storage of column \"{}\"", stmt.column);
+    }
+  }
+  Vector<MapColumnRef> inputs(inputs_.size());
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    auto* col = table->getColumn(inputs_[i]);
+    RUNTIME_CHECK(col && col->asNumericData(), "map: numeric column \"{}\" is gone", inputs_[i]);
+    auto& ref     = inputs[i];
+    ref.column    = col;
+    ref.type      = col->dataType();
+    ref.tupleSize = col->tupleSize();
+    if (numIndices > 0)
+      ref.cdata = col->asNumericData()->getRawBufferRO(0, numIndices * ref.tupleSize, ref.type);
+  }
+  if (numRows == 0)
+    return;
+
+  bool         identity = size_t(numRows) == numIndices;
+  Vector<sint> rowToIndex(numRows);
+  for (sint row = 0; row < numRows; ++row) {
+    rowToIndex[row] = sint(table->getIndex(row).value());
+    identity &= rowToIndex[row] == row;
+  }
+  sint const* indices = identity ? nullptr : rowToIndex.data();
+
+  auto&      tasks      = TaskContext::instance();
+  sint const numBatches = (numRows + BATCH - 1) / BATCH;
+  sint const numJobs    = std::max<sint>(1, std::min<sint>(numBatches, tasks.scheduler.config().workerThread.count));
+  for (size_t s = 0; s < statements_.size();) {
+    if (statements_[s].isString) {
+      PROFILER_SCOPE("map strings", 0xC5E1A5);
+      auto const&                  stmt = statements_[s];
+      Vector<StringDataInterface*> columns(stmt.parts.size());
+      for (size_t p = 0; p < stmt.parts.size(); ++p) {
+        if (stmt.parts[p].kind != MapStatement::Part::COLUMN)
+          continue;
+        auto* col = table->getColumn(stmt.parts[p].text);
+        RUNTIME_CHECK(col && col->asStringData(), "map: string column \"{}\" is gone", stmt.parts[p].text);
+        columns[p] = col->asStringData();
+      }
+      auto*        strings = outputs[s].column->asStringData();
+      Vector<real> regs(regSize_ * BATCH);
+      Batch        batch{inputs, indices, regs.data(), firstRow};
+      String       value;
+      for (sint row = 0; row < numRows; row += BATCH) {
+        batch.row0 = row;
+        batch.size = std::min(BATCH, numRows - row);
+        exec(stmt.code, batch);
+        for (sint i = 0; i < batch.size; ++i) {
+          CellIndex const index{batch.index(i)};
+          value.clear();
+          for (size_t p = 0; p < stmt.parts.size(); ++p) {
+            auto const& part = stmt.parts[p];
+            if (part.kind == MapStatement::Part::LITERAL) {
+              value += part.text;
+            } else if (part.kind == MapStatement::Part::COLUMN) {
+              auto const sv = columns[p]->getString(index);
+              value.append(sv.data(), sv.size());
+            } else {
+              if (part.width > 1)
+                value += '(';
+              for (sint c = 0; c < part.width; ++c) {
+                if (c > 0)
+                  value += ", ";
+                appendNumber(value, regs[(regOffset_[part.reg] + c) * BATCH + i]);
+              }
+              if (part.width > 1)
+                value += ')';
+            }
+          }
+          strings->setString(index, value);
+        }
+      }
+      ++s;
+      continue;
+    }
+
+    size_t end = s;
+    while (end < statements_.size() && !statements_[end].isString)
+      ++end;
+    tasks.parallelFor(size_t(numJobs), CostModel::instance().history("map.row"), real(numRows) / numJobs,
+                      [&, s, end](size_t job) {
+      PROFILER_SCOPE("map batch", 0xC5E1A5);
+      Vector<real> regs(regSize_ * BATCH);
+      Batch        batch{inputs, indices, regs.data(), firstRow};
+      for (sint row = numRows * sint(job) / numJobs, last = numRows * sint(job + 1) / numJobs; row < last; row += BATCH) {
+        batch.row0 = row;
+        batch.size = std::min(BATCH, last - row);
+        for (size_t i = s; i < end; ++i) {
+          auto const& stmt = statements_[i];
+          exec(stmt.code, batch);
+          scatter(outputs[i], batch, batch.regs + regOffset_[stmt.result] * BATCH, stmt.width);
+        }
+      }
+    });
+    s = end;
+  }
+}
+// Evaluation }}}
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
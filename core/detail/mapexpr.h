@@ -0,0 +1,110 @@
+#pragma once
+#include "../def.h"
+#include "../vector.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+class DataTable;
+
+namespace detail {
+
+enum class MapOpcode : uint8_t
+{
+  LOAD,  //< input slot `a` into dst
+  CONST, //< `value` into dst
+  ROW,   //< row numbers into dst
+  COPY,  //< component `aComp` of `a` into component `dstComp` of dst
+
+  // component wise, operands of width 1 are broadcast
+  NEG, NOT, ABS, SQRT, FLOOR, CEIL, ROUND, SIN, COS, TAN, ASIN, ACOS, ATAN, EXP, LOG,
+  ADD, SUB, MUL, DIV, MOD, POW, MIN, MAX, ATAN2, LT, LE, GT, GE, EQ, NE, AND, OR,
+  SELECT, CLAMP, LERP,
+
+  // vectors
+  DOT, LENGTH, NORMALIZE, CROSS
+};
+
+struct MapInstr
+{
+  MapOpcode op      = MapOpcode::CONST;
+  sint      dst     = -1;
+  sint      a       = -1;
+  sint      b       = -1;
+  sint      c       = -1;
+  sint      dstComp = 0;
+  sint      aComp   = 0;
+  real      value   = 0;
+};
+
+/// one `column = expression` line
+struct MapStatement
+{
+  struct Part
+  {
+    enum Kind : uint8_t { LITERAL, COLUMN, NUMBER };
+    Kind   kind  = LITERAL;
+    String text; //< literal text or column name
+    sint   reg   = -1;
+    sint   width = 0;
+  };
+
+  String           column;
+  sint             line     = 0;
+  bool             isString = false;
+  sint             result   = -1; //< register holding the value, numeric statements
+  sint             width    = 1;
+  Vector<MapInstr> code;
+  Vector<Part>     parts;         //< concatenated, string statements
+};
+
+/// Compiled code of a `map` node, e.g.
+///
+///   speed = length(v)
+///   P     = P + v * 0.04
+///   name  = "pt" .. row()
+///
+/// Assignments are checked against a table's columns once and lowered to
+/// instructions over registers holding one batch of rows per component, so each
+/// instruction is a plain loop the compiler can vectorize. Runs of numeric
+/// assignments are evaluated in parallel over row ranges, string assignments
+/// in order on the calling thread. Numbers are computed as `real`.
+class MapProgram
+{
+public:
+  /// rows per batch
+  static constexpr sint BATCH = 256;
+
+  /// parses `code` against the columns of `table`, throws CheckFailure or
+  /// TypeError naming the offending line
+  MapProgram(String const& code, DataTable const* table);
+
+  /// names and types of columns in `table`, programs run on tables of the
+  /// schema they were compiled against
+  static String schemaOf(DataTable const* table);
+
+  String const&               schema() const { return schema_; }
+  Vector<MapStatement> const& statements() const { return statements_; }
+
+  /// evaluates all assignments on unique `table`, creating missing columns;
+  /// `firstRow` is what `row()` gives for the table's first row, streamed batches start where the last one ended
+  void run(DataTable* table, sint firstRow = 0) const;
+
+  /// rows being evaluated, and registers for them
+  struct Batch;
+
+private:
+  void exec(Vector<MapInstr> const& code, Batch& batch) const;
+
+  String               schema_;
+  Vector<MapStatement> statements_;
+  Vector<String>       inputs_;    //< columns by LOAD slot
+  Vector<sint>         regWidth_;
+  Vector<size_t>       regOffset_; //< in components
+  size_t               regSize_ = 0;
+
+  friend class MapCompiler;
+};
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
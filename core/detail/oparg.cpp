@@ -1,5 +1,7 @@
 #include "oparg.h"
 #include "opcontext.h"
+#include "opgraph.h"
+#include "luapool.h"
 #include "runtime.h"
 #include "serialize.h"
 #include "profiler.h"
@@ -7,21 +9,232 @@
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 #include <glm/glm.hpp>
-#include <sol/sol.hpp>
-#include <lua.h>
-#include <lauxlib.h>
-#include <lualib.h>
 #include <algorithm> //min/max
 #include <cstring>   //memset
+#include <optional>
 
 BEGIN_JOYFLOW_NAMESPACE
 
-CORE_API void ArgValue::eval(OpContext* context)
+// Expression Dependencies {{{
+/// reads of the expressions being expanded go through here to be recorded
+struct ArgExprRecorder
+{
+  OpContext*   context = nullptr;
+  ArgExprDeps* deps    = nullptr;
+  sint         frame   = 0;
+  real         time    = 0;
+};
+
+/// `name` is a sibling of the context's node, empty for the node itself
+static OpNode* argExprNode(OpContext* context, String const& name)
+{
+  auto* node = context ? context->node() : nullptr;
+  if (!node || name.empty())
+    return node;
+  auto* graph = node->parent();
+  return graph ? graph->node(name) : nullptr;
+}
+
+/// arguments whose expressions are being expanded on this thread, innermost last
+static thread_local Vector<ArgValue const*> t_expandingArgs;
+
+struct ArgExpandingScope
+{
+  ArgExpandingScope(ArgValue const* arg) { t_expandingArgs.push_back(arg); }
+  ~ArgExpandingScope() { t_expandingArgs.pop_back(); }
+};
+
+/// evaluates the argument read by an expression, so that it's not stale,
+/// returns false if it's being expanded already - reading it would go round in circles
+static bool evalArgExprSource(OpNode* node, String const& argName)
+{
+  auto const* arg = &node->arg(argName);
+  if (std::find(t_expandingArgs.begin(), t_expandingArgs.end(), arg) != t_expandingArgs.end())
+    return false;
+  node->evalArgument(argName);
+  return true;
+}
+
+/// pushes the value, or the error message and returns false
+static bool pushArgExprValue(lua_State* L, ArgExprRecorder* rec, String const& path, lua_Integer elem)
+{
+  auto const dot      = path.rfind('.');
+  String     nodeName = dot == String::npos ? "" : path.substr(0, dot);
+  String     argName  = dot == String::npos ? path : path.substr(dot + 1);
+  auto*      node     = argExprNode(rec->context, nodeName);
+  if (!node || node->argIndex(argName) < 0) {
+    lua_pushfstring(L, "no argument named \"%s\"", path.c_str());
+    return false;
+  }
+  if (!evalArgExprSource(node, argName)) {
+    lua_pushfstring(L, "argument \"%s\" reads itself", path.c_str());
+    return false;
+  }
+  auto const& arg = node->arg(argName);
+  if (elem < 0 || elem >= std::min(MAX_ARG_TUPLE_SIZE, arg.desc().tupleSize)) {
+    lua_pushfstring(L, "argument \"%s\" has no element %d", path.c_str(), int(elem));
+    return false;
+  }
+  rec->deps->args.push_back({std::move(nodeName), std::move(argName), arg.version()});
+  // whatever depends on frame or time through the argument depends on it as well,
+  // and reads its value for my frame and time, not for the one it was expanded for
+  ArgValue const*         value = &arg;
+  std::optional<ArgValue> atFrame;
+  if (arg.readsFrameOrTime()) {
+    rec->deps->readsFrame |= arg.readsFrame();
+    rec->deps->readsTime  |= arg.readsTime();
+    auto const*   expandedFor = node->context() ? node->context()->env() : nullptr;
+    OpEnvironment env;
+    if (expandedFor || (expandedFor = node->env()))
+      env = *expandedFor;
+    if (env.frame != rec->frame || env.time != rec->time) {
+      env.frame = rec->frame;
+      env.time  = rec->time;
+      ArgExpandingScope expanding(&arg);
+      atFrame.emplace(arg);
+      atFrame->eval(node->context(), &env);
+      value = &*atFrame;
+    }
+  }
+  switch (value->desc().type) {
+  case ArgType::INT: case ArgType::BOOL: case ArgType::TOGGLE: case ArgType::MENU:
+    lua_pushinteger(L, lua_Integer(value->asInt4()[int(elem)]));
+    break;
+  case ArgType::REAL: case ArgType::COLOR:
+    lua_pushnumber(L, value->asReal4()[int(elem)]);
+    break;
+  default: {
+    auto const& str = value->asStringList()[elem];
+    lua_pushlstring(L, str.data(), str.size());
+  }
+  }
+  return true;
+}
+
+/// arg('name' [, elem]), arg('node.name' [, elem])
+static int argexpr_arg(lua_State* L)
+{
+  auto* rec = static_cast<ArgExprRecorder*>(lua_touserdata(L, lua_upvalueindex(1)));
+  if (!pushArgExprValue(L, rec, luaL_checkstring(L, 1), luaL_optinteger(L, 2, 0)))
+    return lua_error(L);
+  return 1;
+}
+
+/// volatile(value): never reuse the expansion, e.g. volatile(math.random())
+static int argexpr_volatile(lua_State* L)
+{
+  auto* rec = static_cast<ArgExprRecorder*>(lua_touserdata(L, lua_upvalueindex(1)));
+  rec->deps->isVolatile = true;
+  lua_settop(L, 1);
+  return 1;
+}
+
+/// functions of `math` giving something else each call, or changing what those give
+static bool isNondeterministic(char const* name)
+{
+  return std::strcmp(name, "random") == 0 || std::strcmp(name, "randomseed") == 0;
+}
+
+/// `math` of the expression: reading a nondeterministic function makes the expression volatile
+static int argexpr_math(lua_State* L)
+{
+  auto* rec = static_cast<ArgExprRecorder*>(lua_touserdata(L, lua_upvalueindex(1)));
+  if (lua_type(L, 2) == LUA_TSTRING && isNondeterministic(lua_tostring(L, 2)))
+    rec->deps->isVolatile = true;
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(2));
+  return 1;
+}
+
+/// globals of the expression: `frame` and `time` are recorded when read,
+/// `random` is `math.random`, volatile as it
+static int argexpr_index(lua_State* L)
+{
+  auto* rec = static_cast<ArgExprRecorder*>(lua_touserdata(L, lua_upvalueindex(1)));
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    char const* key = lua_tostring(L, 2);
+    if (std::strcmp(key, "frame") == 0) {
+      rec->deps->readsFrame = true;
+      lua_pushinteger(L, lua_Integer(rec->frame));
+      return 1;
+    } else if (std::strcmp(key, "time") == 0) {
+      rec->deps->readsTime = true;
+      lua_pushnumber(L, rec->time);
+      return 1;
+    } else if (isNondeterministic(key)) {
+      rec->deps->isVolatile = true;
+      lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+      lua_getfield(L, -1, "math");
+      lua_getfield(L, -1, key);
+      return 1;
+    }
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+  return 1;
+}
+
+static void installArgExprRecorder(detail::LuaStatePool::Lease& lua, ArgExprRecorder* rec)
+{
+  auto* L = lua.state();
+  lua.env().push();
+  lua_newtable(L);
+  lua_pushlightuserdata(L, rec);
+  lua_pushcclosure(L, argexpr_index, 1);
+  lua_setfield(L, -2, "__index");
+  lua_setmetatable(L, -2);
+  lua_pushlightuserdata(L, rec);
+  lua_pushcclosure(L, argexpr_arg, 1);
+  lua_setfield(L, -2, "arg");
+  lua_pushlightuserdata(L, rec);
+  lua_pushcclosure(L, argexpr_volatile, 1);
+  lua_setfield(L, -2, "volatile");
+  lua_newtable(L); // math, looked up through argexpr_math
+  lua_newtable(L);
+  lua_pushlightuserdata(L, rec);
+  lua_getglobal(L, "math");
+  lua_pushcclosure(L, argexpr_math, 2);
+  lua_setfield(L, -2, "__index");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, -2, "math");
+  lua_pop(L, 1);
+}
+
+static bool argExprDepsChanged(ArgExprDeps const& deps, ArgExprRecorder const& now)
+{
+  // failures are not cached, what was missing may be there now
+  if (!deps.valid || !deps.error.empty() || deps.isVolatile)
+    return true;
+  if ((deps.readsFrame && deps.frame != now.frame) || (deps.readsTime && deps.time != now.time))
+    return true;
+  for (auto const& read : deps.args) {
+    auto* node = argExprNode(now.context, read.node);
+    if (!node || node->argIndex(read.arg) < 0 || !evalArgExprSource(node, read.arg) ||
+        node->arg(read.arg).version() != read.version)
+      return true;
+  }
+  return false;
+}
+// Expression Dependencies }}}
+
+CORE_API void ArgValue::eval(OpContext* context, OpEnvironment const* env)
 {
   PROFILER_SCOPE("ArgValue::eval", 0xE29C45);
+  ArgExpandingScope expanding(this);
   bool        valueDirty = false;
-  lua_State*  L          = nullptr;
+  std::optional<detail::LuaStatePool::Lease> lua;
+  ArgExprRecorder recorder;
   auto const& desc       = this->desc();
+  recorder.context = context;
+  if (!env && context)
+    env = context->env();
+  if (!env && context && context->node())
+    env = context->node()->env();
+  if (env) {
+    recorder.frame = env->frame;
+    recorder.time  = env->time;
+  }
   ensureVectorSize(expr_,                  desc.tupleSize);
   ensureVectorSize(evaluatedStringValues_, desc.tupleSize);
 
@@ -45,43 +258,49 @@ CORE_API void ArgValue::eval(OpContext* context)
         continue;
       isValid_[i] = true;
       String expr = expr_[i];
-      auto   startquote = expr.find('`');
-      while (startquote != String::npos) {
-        auto endquote = expr.find('`', startquote + 1);
-        if (endquote == String::npos) {
-          errorMessage_ = "quote was not closed";
-          endquote = startquote;
-          break;
-        }
-        auto quoted = expr.substr(startquote + 1, endquote - startquote - 1);
-        if (!quoted.empty()) {
-          bool newlyCreated = false;
-          if (L == nullptr) {
-            L = luaL_newstate();
-            newlyCreated = true;
-          }
-          auto view = sol::state_view(L);
-          if (newlyCreated)
-            view.open_libraries(sol::lib::base,
-              sol::lib::string,
-              sol::lib::table,
-              sol::lib::math,
-              sol::lib::bit32,
-              sol::lib::utf8);
-          String expanded = "";
-          spdlog::info("Arg: evaluating \"{}\"", quoted);
-          try {
-            auto result =
-              view.safe_script("return tostring(" + quoted + ")", sol::script_throw_on_error);
-            expanded = result.get<String>();
-          } catch (sol::error const& err) {
-            errorMessage_ = err.what();
-            isValid_[i] = false;
+      if (expr.find('`') != String::npos) {
+        ensureVectorSize(exprDeps_, desc.tupleSize);
+        auto& deps   = exprDeps_[i];
+        recorder.deps = &deps;
+        if (deps.expr == expr && !argExprDepsChanged(deps, recorder)) {
+          expr = deps.expanded;
+        } else {
+          deps       = ArgExprDeps{};
+          deps.expr  = expr;
+          deps.frame = recorder.frame;
+          deps.time  = recorder.time;
+          auto startquote = expr.find('`');
+          while (startquote != String::npos) {
+            auto endquote = expr.find('`', startquote + 1);
+            if (endquote == String::npos) {
+              deps.error = "quote was not closed";
+              endquote = startquote;
+              break;
+            }
+            auto quoted = expr.substr(startquote + 1, endquote - startquote - 1);
+            if (!quoted.empty()) {
+              if (!lua) {
+                lua.emplace(detail::LuaStateKind::PLAIN);
+                installArgExprRecorder(*lua, &recorder);
+              }
+              String expanded = "";
+              spdlog::info("Arg: evaluating \"{}\"", quoted);
+              try {
+                expanded = lua->run("return tostring(" + quoted + ")").as<String>();
+              } catch (sol::error const& err) {
+                deps.error = err.what();
+                isValid_[i] = false;
+              }
+              spdlog::info("Arg: got \"{}\"", expanded);
+              expr = expr.substr(0, startquote) + expanded + expr.substr(endquote + 1);
+            }
+            startquote = expr.find('`');
           }
-          spdlog::info("Arg: got \"{}\"", expanded);
-          expr = expr.substr(0, startquote) + expanded + expr.substr(endquote + 1);
+          deps.expanded = expr;
+          deps.valid    = true;
         }
-        startquote = expr.find('`');
+        if (!deps.error.empty())
+          errorMessage_ = deps.error;
       }
       if ((desc.type == ArgType::STRING || desc.type == ArgType::CODEBLOCK || desc.type == ArgType::OPREF)
           && evaluatedStringValues_[i] != expr)
@@ -127,8 +346,6 @@ CORE_API void ArgValue::eval(OpContext* context)
     }
   }
 
-  if (L)
-    lua_close(L);
   if (valueDirty)
     ++evaluatedVersion_;
 }
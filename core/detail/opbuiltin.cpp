@@ -9,7 +9,12 @@
 #include "datatable.h"
 #include "ophelper.h"
 #include "luabinding.h"
+#include "luapool.h"
+#include "mapexpr.h"
+#include "groupby.h"
+#include "cppscript.h"
 #include "runtime.h"
+#include "evalscope.h"
 #include "profiler.h"
 
 #include <pdqsort.h>
@@ -18,8 +23,11 @@
 #include <sol/sol.hpp>
 
 #include <algorithm>
+#include <cctype>
 #include <charconv>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <numeric>
 #include <regex>
 
@@ -65,6 +73,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<Join>("join")
+            .flags(OpFlag::DISK_CACHEABLE)
             .icon(/*ICON_FA_HANDSHAKE*/ "\xEF\x8A\xB5")
             .numMaxInput(4)
             .numRequiredInput(1)
@@ -79,20 +88,16 @@ public:
         context.requireInput(i);
     }
     auto* odc = context.copyInputToOutput(0);
-    for (sint i=0, n=odc->numTables(); i<n; ++i) {
-      auto* table = odc->getTable(i);
-      table->makeUnique();
-      for (auto const& name: table->columnNames()) {
-        table->getColumn(name)->makeUnique();
-      }
-    }
+    Vector<DataCollection const*> others;
     for (int i=1; i<context.getNumInputs(); ++i) {
       if (!context.hasInput(i))
         continue;
-      auto* dc = context.fetchInputData(i);
-      if (dc)
-        odc->join(dc);
+      if (auto* dc = context.fetchInputData(i))
+        others.push_back(dc);
     }
+    // columns are made unique by the join itself, in parallel, and only those being joined
+    if (!others.empty())
+      odc->join(others);
   }
 };
 // }}}
@@ -107,6 +112,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<Sort>("sort")
+            .flags(OpFlag::DISK_CACHEABLE)
             .icon(/*ICON_FA_SORT_ALPHA_UP*/"\xEF\x85\x9E")
             .numMaxInput(1)
             .inputPinNames({"data to sort"})
@@ -130,8 +136,8 @@ public:
     sint   argOrder  = context.arg("order").asInt();         // 0: ascending; 1: descending
     bool   argStable = context.arg("stable").asBool();       // stable sort?
 
-    auto*  odc   = context.copyInputToOutput(0);
-    if (context.fetchInputData(0)->numTables() == 0)
+    auto*  odc   = context.moveInputToOutput(0);
+    if (odc->numTables() == 0)
       return;
 
     auto* table = odc->getTable(argTable);
@@ -230,16 +236,22 @@ public:
     Vector<sint> order(nrows);
     std::iota(order.begin(), order.end(), 0);
 
-    if (argStable) {
-      std::stable_sort(order.begin(), order.end(), lessThan);
-    } else {
-      pdqsort(order.begin(), order.end(), lessThan);
-    }
+    {
+      OpStageScope stage(context, "sort");
+      context.reportProgress(0.1, "sorting");
+      if (argStable) {
+        std::stable_sort(order.begin(), order.end(), lessThan);
+      } else {
+        pdqsort(order.begin(), order.end(), lessThan);
+      }
 
-    if (argOrder == 1) // descending, inverse
-      for (sint i=0; i<nrows/2; ++i)
-        std::swap(order[i], order[nrows-i-1]);
+      if (argOrder == 1) // descending, inverse
+        for (sint i=0; i<nrows/2; ++i)
+          std::swap(order[i], order[nrows-i-1]);
+    }
 
+    OpStageScope stage(context, "reorder");
+    context.reportProgress(0.8, "reordering rows");
     table->sort(order);
   }
 };
@@ -252,6 +264,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<Split>("split")
+      .flags(OpFlag::DISK_CACHEABLE | OpFlag::STREAMABLE)
       .icon(/*ICON_FA_FILTER*/"\xEF\x82\xB0")
       .numMaxInput(1)
       .numOutputs(2)
@@ -326,6 +339,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<Defragment>("defragment")
+      .flags(OpFlag::DISK_CACHEABLE)
       .numMaxInput(1)
       .argDescs({
           tableSelectionArg("table", "Table", true)
@@ -336,7 +350,7 @@ public:
   {
     PROFILER_SCOPE("defragment", 0xee3f4d);
     auto argTable = context.arg("table").asString();
-    auto* odc = context.copyInputToOutput(0);
+    auto* odc = context.moveInputToOutput(0);
     if (odc->numTables() == 0)
       return;
     if (argTable=="ALL") {
@@ -364,56 +378,6 @@ public:
 // }}}
 
 // Lua script {{{
-static void* tracked_lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
-class LuaOpState : public OpStateBlock, public ObjectTracker<LuaOpState>
-{
-  lua_State* L = nullptr;
-  OpContext* context_ = nullptr; // should always destory after me
-  size_t memUsage_ = 0;
-  friend void* tracked_lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
-public:
-  LuaOpState(OpContext* ctx) : context_(ctx)
-  {
-    PROFILER_SCOPE("lua init", 0xD6ECF0);
-    L = lua_newstate(tracked_lua_alloc, this);
-    sol::set_default_state(L);
-    joyflow::bindLuaTypes(L);
-  }
-  ~LuaOpState()
-  {
-    lua_close(L);
-    // memUsage_ should be exactly 0 here
-  }
-
-  String name() const { return fmt::format("lua for [{}]", context_->node()->name()); }
-  size_t size() const { return memUsage_ + sizeof(*this); }
-  lua_State* interpreter() const { return L; }
-};
-
-static struct LuaOpInspectorRegister
-{
-  LuaOpInspectorRegister()
-  {
-    Stats::setInspector<LuaOpState>({
-      /*name*/ [](void const* p) { return static_cast<LuaOpState const*>(p)->name(); },
-      /*size*/ [](void const* p) { return static_cast<LuaOpState const*>(p)->size(); }
-    });
-  }
-} _luaopreg;
-
-static void* tracked_lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
-{
-  auto* state = static_cast<LuaOpState*>(ud);
-  state->memUsage_ += nsize;
-  if (ptr)
-    state->memUsage_ -= osize;
-  if (nsize == 0) {
-    mi_free(ptr);
-    return nullptr;
-  }
-  return mi_realloc(ptr, nsize);
-}
-
 class LuaScript : public OpKernel
 {
 public:
@@ -433,25 +397,8 @@ public:
   {
     PROFILER_SCOPE("lua", 0xf8f4ed);
     auto script = ctx.arg("code").asString();
-    lua_State* L = nullptr;
-    /*
-    {
-      PROFILER_SCOPE("lua init", 0xD6ECF0);
-      L = luaL_newstate();
-      joyflow::bindLuaTypes(L);
-    }
-    DEFER([L] {lua_close(L); });
-    */
-    {
-      auto *state = static_cast<LuaOpState*>(ctx.getState());
-      if (!state) {
-        state = new LuaOpState(&ctx);
-        ctx.setState(state);
-      }
-      L = state->interpreter();
-    }
-    sol::state_view lua(L);
-    lua["ctx"]  = &ctx;
+    detail::LuaStatePool::Lease lua(detail::LuaStateKind::FULL);
+    lua.env()["ctx"] = &ctx;
     // spdlog::info("evaluation lua script of node {}", ctx.nodeName());
 
     DataCollection* in = ctx.hasInput(0) ? ctx.fetchInputData(0) : nullptr;
@@ -463,10 +410,10 @@ public:
     } else {
       out = ctx.reallocOutput(0);
     }
-    lua["data"] = out;
+    lua.env()["data"] = out;
 
     try {
-      lua.safe_script(script, sol::script_throw_on_error);
+      lua.run(script);
     } catch (sol::error const& e) {
       ctx.reportError(e.what(), OpErrorLevel::ERROR, true);
     } catch(CheckFailure const& e) {
@@ -474,7 +421,56 @@ public:
     } catch(AssertionFailure const& e) {
       ctx.reportError(e.what(), OpErrorLevel::ERROR, true);
     }
-    lua.collect_gc();
+  }
+};
+// }}}
+
+// Cpp Script {{{
+/// kernel built from the node's code, rebuilt when the code changes
+struct CppScriptState : public OpStateBlock
+{
+  String         code;
+  OpKernelHandle kernel{nullptr};
+
+  ~CppScriptState() { delete *kernel; }
+};
+
+class CppScriptOp : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<CppScriptOp>("cpp")
+      .numMaxInput(4)
+      .numRequiredInput(0)
+      .numOutputs(1)
+      .argDescs({
+          ArgDescBuilder("code").label("Code").codeLanguage("cpp").type(ArgType::CODEBLOCK)
+            .description("body of `void eval(OpContext& ctx)`,\n`DataCollection* data` is the output, a copy of input 0 if connected")
+       })
+      .icon("\xEF\x84\xA1"/*FA_ICON_CODE*/);
+  }
+
+  void eval(OpContext& ctx) const override
+  {
+    PROFILER_SCOPE("cpp", 0xf8f4ed);
+    auto code  = ctx.arg("code").asString();
+    auto* state = static_cast<CppScriptState*>(ctx.getState());
+    if (!state) {
+      state = new CppScriptState;
+      ctx.setState(state);
+    }
+    if (!*state->kernel || state->code != code) {
+      OpKernel* kernel = nullptr;
+      {
+        OpStageScope stage(ctx, "compile");
+        kernel = CppScript::newKernel(code);
+      }
+      delete *state->kernel;
+      state->kernel.reset(kernel);
+      state->code = code;
+    }
+    state->kernel->eval(ctx);
   }
 };
 // }}}
@@ -510,6 +506,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<StringCast>("string_cast")
+      .flags(OpFlag::DISK_CACHEABLE | OpFlag::STREAMABLE)
       .numMaxInput(1).numRequiredInput(1).numOutputs(1)
       .icon(/*ICON_FA_EXCHANGE_ALT*/"\xEF\x8D\xA2")
       .argDescs({
@@ -524,7 +521,7 @@ public:
     sint   const tableidx    = ctx.arg("table").asInt();
     auto   const columnNames = ctx.arg("columns").asStringList();
     String const destType    = ctx.arg("dst_type").asString();
-    auto*        odc         = ctx.copyInputToOutput(0, 0);
+    auto*        odc         = ctx.moveInputToOutput(0, 0);
 
     if (columnNames.empty()) // nothing to do
       return;
@@ -538,7 +535,12 @@ public:
 
     Vector<marl::Event> eventsToWait;
     Vector<String>      tempnames;
-    bool const fireTask = columnNames.size() > 1 && odt->numIndices()>100; // TODO: tune these conditions
+    // fan out when converting one column is expected to outweigh scheduling it
+    auto&      columnCost = CostModel::instance().history("string_cast.column");
+    real const perRow     = columnCost.expected();
+    bool const fireTask   = columnNames.size() > 1 &&
+                            (perRow < 0 ? odt->numIndices() > 100
+                                        : TaskContext::instance().worthScheduling(perRow * odt->numIndices()));
     for (auto const& columnName : columnNames) {
       // TODO: exceptions should be catched within task
       marl::Event evt;
@@ -559,8 +561,9 @@ public:
       RUNTIME_CHECK(origColumn, "column \"{}\" of table {} was not found", columnName, tableidx);
       RUNTIME_CHECK(origColumn->asStringData(), "column \"{}\" of table {} has no string interface", columnName, tableidx);
 
-      auto task = [odt, evt, origColumn, tempcolumn, &destType]() {
+      auto task = [odt, evt, origColumn, tempcolumn, &destType, &columnCost]() {
         PROFILER_SCOPE("StringConversion", 0xD9B611);
+        auto const start = std::chrono::steady_clock::now();
         try {
           if (destType == "int32") {
             strColumnConv<int32_t>(odt, origColumn.get(), tempcolumn.get());
@@ -574,11 +577,13 @@ public:
         } catch (std::exception const& e) {
           spdlog::error("string_cast: exception caught during task evaluation: {}", e.what());
         }
+        if (auto const rows = odt->numIndices(); rows > 0)
+          columnCost.add(std::chrono::duration<real>(std::chrono::steady_clock::now() - start).count() / rows);
         evt.signal();
       };
       if (fireTask) {
         eventsToWait.push_back(evt);
-        TaskContext::instance().scheduler.enqueue(marl::Task(task));
+        TaskContext::instance().enqueue(marl::Task(task));
       } else {
         task();
         odt->renameColumn(tempname, columnName, true);
@@ -587,8 +592,10 @@ public:
     if (fireTask && !eventsToWait.empty()) {
       RUNTIME_CHECK(eventsToWait.size() == tempnames.size(), "task count mismatched");
       RUNTIME_CHECK(eventsToWait.size() == columnNames.size(), "column count mismatched");
-      for (size_t i = 0; i < eventsToWait.size(); ++i) {
-        eventsToWait[i].wait();
+      {
+        detail::EvalSuspendScope suspend;
+        for (size_t i = 0; i < eventsToWait.size(); ++i)
+          eventsToWait[i].wait();
       }
       for (size_t i = 0; i < tempnames.size(); ++i) {
         odt->renameColumn(tempnames[i], columnNames[i]);
@@ -644,20 +651,13 @@ public:
 
   void eval(OpContext& ctx) const override
   {
-    // sol::state lua;
-    // bindLuaTypes(lua, true);
-    auto *state = static_cast<LuaOpState*>(ctx.getState());
-    if (!state) {
-      state = new LuaOpState(&ctx);
-      ctx.setState(state);
-    }
-    sol::state_view lua(state->interpreter());
+    detail::LuaStatePool::Lease lua(detail::LuaStateKind::READONLY);
 
     String expr = ctx.arg("condition").asString();
     if (std::regex_match(expr, std::regex("\\W?data[^a-zA-Z0-9_]+"))) {
-      lua["data"] = ctx.fetchInputData(0);
+      lua.env()["data"] = ctx.fetchInputData(0);
     }
-    if (lua.safe_script(fmt::format("return not not ({})", expr), sol::script_throw_on_error)) {
+    if (lua.run(fmt::format("return not not ({})", expr)).as<bool>()) {
       if (ctx.hasInput(0))
         ctx.copyInputToOutput(0,0);
       else
@@ -679,6 +679,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<ColumnRename>("rename_column").numMaxInput(1).numOutputs(1)
+      .flags(OpFlag::STREAMABLE)
       .icon(/*ICON_FA_I_CURSOR*/ "\xEF\x89\x86")
       .argDescs({
         tableSelectionArg("table", "Table", false),
@@ -695,7 +696,7 @@ public:
     bool   const overwrite = context.arg("overwrite").asBool();
     auto *idc = context.fetchInputData(0);
     RUNTIME_CHECK(idc, "no input data");
-    auto *odc = context.copyInputToOutput(0, 0);
+    auto *odc = context.moveInputToOutput(0, 0);
     if (name.empty()) {
       context.reportError("no source column specified", OpErrorLevel::WARNING, false);
       return;
@@ -731,7 +732,7 @@ public:
   {
     auto cnt = context.arg("count").asInt();
     DEBUG_ASSERT(cnt >= 0 && cnt <= 10000000);
-    auto* odc = context.copyInputToOutput(0, 0);
+    auto* odc = context.moveInputToOutput(0, 0);
     for (sint i = 0; i < cnt; ++i) {
       odc->addTable();
     }
@@ -768,7 +769,7 @@ public:
     auto isarray   = context.arg("array").asBool();
     auto overwrite = context.arg("overwrite").asBool();
 
-    auto* odc = context.copyInputToOutput(0, 0);
+    auto* odc = context.moveInputToOutput(0, 0);
     RUNTIME_CHECK(odc, "failed to alloc output data");
     auto* odt = odc->getTable(tid);
     RUNTIME_CHECK(odt, "table {} not found", tid);
@@ -814,7 +815,7 @@ public:
     auto tid = ctx.arg("table").asInt();
     auto cnt = ctx.arg("count").asInt();
 
-    auto* odc = ctx.copyInputToOutput(0, 0);
+    auto* odc = ctx.moveInputToOutput(0, 0);
     RUNTIME_CHECK(odc, "failed to alloc output data");
     auto* odt = odc->getTable(tid);
     RUNTIME_CHECK(odt, "table {} not found", tid);
@@ -851,7 +852,7 @@ public:
       return;
     }
 
-    auto* odc = context.copyInputToOutput(0, 0);
+    auto* odc = context.moveInputToOutput(0, 0);
     auto* odt = odc->getTable(tid);
     RUNTIME_CHECK(odt, "table {} cannot be found", tid);
     auto* srccol = odt->getColumn(colname);
@@ -871,6 +872,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<ColumnRemove>("remove_column").numMaxInput(1).numOutputs(1)
+      .flags(OpFlag::STREAMABLE)
       .icon(/*ICON_FA_MINUS_CIRCLE*/ "\xEF\x81\x96")
       .argDescs({
         tableSelectionArg("table", "Table", false),
@@ -881,7 +883,7 @@ public:
   {
     sint  const tid     = context.arg("table").asInt();
     auto const& columns = context.arg("columns").asStringList();
-    auto *odc = context.copyInputToOutput(0, 0);
+    auto *odc = context.moveInputToOutput(0, 0);
     if (columns.empty()) {
       return;
     }
@@ -915,7 +917,7 @@ public:
 
   void eval(OpContext &context) const override
   {
-    auto *odc = context.copyInputToOutput(0, 0);
+    auto *odc = context.moveInputToOutput(0, 0);
     auto const& tables = context.arg("tables").asStringList();
     if (tables.empty())
       return;
@@ -944,12 +946,66 @@ public:
   bool              inputDirty    = false;
 };
 
+/// While iterating, the loop body passes data on by ownership (`CachingPolicy::HandOver`),
+/// so each iteration modifies the previous result in place instead of copying it;
+/// what the body reads from outside is retained, so it is evaluated once however many
+/// iterations there are
+class LoopBodyScope
+{
+  Vector<Pair<OpContext*, OpEnvironment const*>> overridden_;
+  Vector<OpEnvironment>                          envs_;
+
+public:
+  LoopBodyScope(OpContext& ctrl, LoopOpState const& state)
+  {
+    HashSet<OpContext*> body;
+    for (auto const& [c, pin] : state.affected)
+      body.insert(c);
+    Vector<OpContext*>  outside;
+    HashSet<OpContext*> visited = {&ctrl};
+    Vector<OpContext*>  stack   = {ctrl.inputContext(0)};
+    while (!stack.empty()) {
+      auto* c = stack.pop_back();
+      if (!c || !visited.insert(c).second)
+        continue;
+      if (body.find(c) == body.end()) {
+        outside.push_back(c);
+        continue;
+      }
+      for (sint pin = 0, n = c->getNumInputs(); pin < n; ++pin)
+        stack.push_back(c->inputContext(pin));
+    }
+    envs_.reserve(outside.size() + body.size()); // contexts point into it
+    for (auto* c : outside)
+      setPolicy(c, CachingPolicy::Retained);
+    for (auto* c : body)
+      if (c != &ctrl)
+        setPolicy(c, CachingPolicy::HandOver);
+  }
+  ~LoopBodyScope()
+  {
+    for (auto const& [c, env] : overridden_)
+      c->setEnv(env);
+  }
+
+private:
+  void setPolicy(OpContext* c, CachingPolicy policy)
+  {
+    auto const* current = c->env() ? c->env() : c->node()->env();
+    envs_.push_back(current ? *current : OpEnvironment{});
+    envs_.back().cachingPolicy = policy;
+    overridden_.push_back({c, c->env()});
+    c->setEnv(&envs_.back());
+  }
+};
+
 class LoopController : public OpKernel
 {
 public:
   static OpDesc desc()
   {
     return makeOpDesc<LoopController>("loop")
+      .flags(OpFlag::FORK_UNSAFE)
       .numMaxInput(1).numRequiredInput(0).numOutputs(1)
       .icon(/*ICON_FA_RETWEET*/ "\xEF\x81\xB9")
       .argDescs({
@@ -991,15 +1047,19 @@ public:
     LoopOpState* state = static_cast<LoopOpState*>(ctx.getState());
     RUNTIME_CHECK(state, "loop state should be initialized before eval");
     state->loopCount = ctx.arg("count").asInt();
+    LoopBodyScope bodyScope(ctx, *state);
     for (state->loopIteration=0; state->loopIteration<state->loopCount; ++state->loopIteration) {
       for (auto const [c,p]: state->affected) {
         c->markDirty(true);
       }
       spdlog::debug("loop: iteration {}", state->loopIteration);
-      state->feedback = ctx.fetchInputData(0);
+      ctx.reportProgress(real(state->loopIteration) / state->loopCount,
+                         fmt::format("iteration {}/{}", state->loopIteration+1, state->loopCount));
+      // taken over from the body if nothing else reads it, and handed on to feedback
+      state->feedback = ctx.moveInputToOutput(0, 0);
+      ctx.setOutputData(0, nullptr);
     }
-    ctx.setOutputData(0, state->feedback);
-    state->feedback = nullptr;
+    ctx.setOutputData(0, std::move(state->feedback));
   }
   void afterEval(OpContext& ctx) const override
   {
@@ -1081,7 +1141,7 @@ public:
       .numMaxInput(2).numRequiredInput(0).numOutputs(1)
       .icon(/*ICON_FA_RECYCLE*/ "\xEF\x86\xB8")
       .inputPinNames({"Initial Value", "Loop Body"})
-      .flags(OpFlag::LIGHTWEIGHT | OpFlag::ALLOW_LOOP | OpFlag::LOOP_PIN1)
+      .flags(OpFlag::LIGHTWEIGHT | OpFlag::ALLOW_LOOP | OpFlag::LOOP_PIN1 | OpFlag::FORK_UNSAFE)
       .argDescs({
         // controllerArg()
       });
@@ -1100,7 +1160,8 @@ public:
     if (ctrlState_ && ctx.inputDirty(0))
       ctrlState_->inputDirty = true;
     if (ctrlState_ && ctrlState_->feedback) {
-      ctx.setOutputData(0, ctrlState_->feedback);
+      // by ownership, the body may then modify it in place
+      ctx.setOutputData(0, std::move(ctrlState_->feedback));
     } else if (ctx.hasInput(0)) {
       ctx.copyInputToOutput(0, 0);
     } else {
@@ -1122,7 +1183,7 @@ public:
     return makeOpDesc<LoopInfo>("loop_info")
       .numMaxInput(0).numOutputs(1)
       .icon(/*ICON_FA_INFO_CIRCLE*/ "\xEF\x81\x9A")
-      .flags(OpFlag::LIGHTWEIGHT)
+      .flags(OpFlag::LIGHTWEIGHT | OpFlag::FORK_UNSAFE)
       .argDescs({
         controllerArg()
       });
@@ -1161,6 +1222,7 @@ public:
   static OpDesc desc()
   {
     return makeOpDesc<Match>("match")
+      .flags(OpFlag::DISK_CACHEABLE)
       .numMaxInput(1).numOutputs(1)
       .argDescs({
           tableSelectionArg("dsttable", "Destiny Table", false),
@@ -1189,7 +1251,7 @@ public:
       FIRST = 0, LAST, AVERAGE, SUM
     } behavior = static_cast<Behaviour>(ctx.arg("behavior").asInt());
     bool  overwrite = ctx.arg("overwrite").asBool();
-    auto* odc = ctx.copyInputToOutput(0,0);
+    auto* odc = ctx.moveInputToOutput(0,0);
     auto* dt = odc->getTable(dsttableidx);
     auto* st = odc->getTable(srctableidx);
     RUNTIME_CHECK(st, "Source table missing");
@@ -1235,8 +1297,11 @@ public:
       throw Unimplemented(
           fmt::format("importing {} is not supported yet", ctx.arg("behavior").asString()));
     RUNTIME_CHECK(cmpifce && cmpifce->comparable(scol.get()), "Column \"{}\" from source and column \"{}\" from destiny are not comparable", srcmatchcol, dstmatchcol);
+    OpStageScope stage(ctx, "match");
     if (scol->compareInterface() && scol->compareInterface()->searchable(dcol->dataType(), dcol->tupleSize(), dcol->desc().elemSize)) {
       for (CellIndex didx{ 0 }, n{ dt->numIndices() }; didx < n; ++didx) {
+        if ((didx.value() & PROGRESS_REPORT_MASK) == 0)
+          ctx.reportProgress(real(didx.value()) / n.value(), "matching");
         if (dt->getRow(didx) == -1)
           continue;
 
@@ -1263,6 +1328,8 @@ public:
       }
     } else if (cmpifce->comparable(scol.get())) { // iterate through
       for (CellIndex didx{ 0 }, n{ dt->numIndices() }; didx < n; ++didx) {
+        if ((didx.value() & PROGRESS_REPORT_MASK) == 0)
+          ctx.reportProgress(real(didx.value()) / n.value(), "matching");
         if (dt->getRow(didx) == -1)
           continue;
         for (CellIndex sidx(0); sidx < st->numIndices(); ++sidx) {
@@ -1292,7 +1359,7 @@ public:
   {
     return makeOpDesc<Iterate>("iterate")
       .icon(/*ICON_FA_SYNC*/ "\xEF\x80\xA1")
-      .flags(OpFlag::LIGHTWEIGHT | OpFlag::ALLOW_LOOP | OpFlag::LOOP_PIN1)
+      .flags(OpFlag::LIGHTWEIGHT | OpFlag::ALLOW_LOOP | OpFlag::LOOP_PIN1 | OpFlag::FORK_UNSAFE)
       .numMaxInput(2).inputPinNames({ "Initial", "Next" }).numOutputs(2).outputPinNames({ "Previous frame", "This frame" })
       .argDescs({
         // ArgDescBuilder("fetchfrom").type(ArgType::OPREF).label("Fetch From").description("fetch and cache output from where"),
@@ -1342,12 +1409,348 @@ public:
 };
 // Iterate }}}
 
-// Map (TODO) {{{
-// Map (TODO) }}}
+// Map {{{
+struct MapState : public OpStateBlock
+{
+  String                              code;
+  std::unique_ptr<detail::MapProgram> program;
+  sint                                streamRow = 0; //< row() of the next streamed batch
+};
+
+class Map : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<Map>("map")
+      .flags(OpFlag::DISK_CACHEABLE | OpFlag::STREAMABLE)
+      .icon(/*ICON_FA_CALCULATOR*/ "\xEF\x87\xAC")
+      .numMaxInput(1).numRequiredInput(1).numOutputs(1)
+      .argDescs({
+        tableSelectionArg("table", "Table", false),
+        ArgDescBuilder("code").label("Assignments").type(ArgType::CODEBLOCK)
+          .description("one `column = expression` per line, e.g.\n"
+                       "  speed = length(v)\n"
+                       "  P = P + v * 0.04\n"
+                       "  name = \"pt\" .. row()\n"
+                       "numbers, vec2/3/4 (.xyzw) and strings (..);\n"
+                       "functions: abs sqrt floor ceil round sin cos tan asin acos atan exp log\n"
+                       "min max pow mod clamp lerp select dot cross length normalize vec2 vec3 vec4 row")
+      });
+  }
+
+  void eval(OpContext& ctx) const override { run(ctx, 0); }
+
+  // batches are slices of the whole input, row() carries on from the last one
+  void beginStream(OpContext& ctx) const override { state(ctx)->streamRow = 0; }
+  bool evalBatch(OpContext& ctx) const override
+  {
+    auto* state = this->state(ctx);
+    state->streamRow += run(ctx, state->streamRow);
+    return false;
+  }
+
+private:
+  static MapState* state(OpContext& ctx)
+  {
+    auto* state = static_cast<MapState*>(ctx.getState());
+    if (!state) {
+      state = new MapState;
+      ctx.setState(state);
+    }
+    return state;
+  }
+
+  /// returns number of rows in the selected table
+  static sint run(OpContext& ctx, sint firstRow)
+  {
+    PROFILER_SCOPE("map", 0xC5E1A5);
+    sint const tableidx = ctx.arg("table").asInt();
+    auto const code     = ctx.arg("code").asString();
+    auto*      odc      = ctx.moveInputToOutput(0, 0);
+    if (std::all_of(code.begin(), code.end(), [](char c) { return std::isspace(uint8_t(c)); }))
+      return 0; // nothing reads row()
+
+    RUNTIME_CHECK(odc, "no output data");
+    RUNTIME_CHECK(tableidx>=0 && tableidx<odc->numTables(), "table {} out of bound [0, {})", tableidx, odc->numTables());
+    auto* table = odc->getTable(tableidx);
+    table->makeUnique();
 
-// Reduce (TODO) {{{
+    // compiled once per code and column layout
+    auto* state = Map::state(ctx);
+    if (!state->program || state->code != code || state->program->schema() != detail::MapProgram::schemaOf(table)) {
+      OpStageScope stage(ctx, "compile");
+      state->program.reset();
+      state->program = std::make_unique<detail::MapProgram>(code, table);
+      state->code    = code;
+    }
+    state->program->run(table, firstRow);
+    return sint(table->numRows());
+  }
+};
+// Map }}}
+
+// Reduce {{{
+class Reduce : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<Reduce>("reduce")
+      .flags(OpFlag::DISK_CACHEABLE)
+      .icon(/*ICON_FA_COMPRESS_ARROWS_ALT*/ "\xEF\x9E\x8C")
+      .numMaxInput(1).numRequiredInput(1).numOutputs(1)
+      .argDescs({
+        tableSelectionArg("table", "Table", false),
+        columnSelectionArg("table", "keys", "Group By").type(ArgType::MULTI_MENU).tupleSize(0),
+        ArgDescBuilder("aggregates").label("Aggregates").type(ArgType::CODEBLOCK)
+          .description("one `column = func(source)` per line, e.g.\n"
+                       "  total = sum(price)\n"
+                       "  n = count()\n"
+                       "functions: sum min max mean var count first last;\n"
+                       "output defaults to source_func")
+      });
+  }
+
+  void eval(OpContext& ctx) const override
+  {
+    PROFILER_SCOPE("reduce", 0xB39DDB);
+    sint const tableidx   = ctx.arg("table").asInt();
+    auto const keys       = ctx.arg("keys").asStringList();
+    auto const aggregates = detail::parseAggregates(ctx.arg("aggregates").asString());
+    auto*      idc        = ctx.fetchInputData(0);
+    RUNTIME_CHECK(idc, "no input data");
+    RUNTIME_CHECK(tableidx>=0 && tableidx<idc->numTables(), "table {} out of bound [0, {})", tableidx, idc->numTables());
+
+    // other tables pass through shared
+    auto* odc = ctx.reallocOutput(0);
+    for (sint t = 0, n = idc->numTables(); t < n; ++t) {
+      if (t != tableidx) {
+        odc->addTable(idc->getTable(t)->share().get());
+        continue;
+      }
+      auto* table = odc->getTable(odc->addTable());
+      detail::groupBy(idc->getTable(t), keys, aggregates, table);
+    }
+  }
+};
 // Reduce }}}
 
+// For Each {{{
+struct ForEachState : public OpStateBlock
+{
+  Vector<DataCollectionPtr> pieces;
+};
+
+/// the body itself evaluates the first piece with the environment made for it
+class ForEachBodyScope
+{
+  Vector<Pair<OpContext*, OpEnvironment const*>> overridden_;
+
+public:
+  ForEachBodyScope(Vector<OpContext*> const& body, OpEnvironment const& env)
+  {
+    for (auto* c : body) {
+      overridden_.push_back({c, c->env()});
+      c->setEnv(&env);
+    }
+  }
+  ~ForEachBodyScope()
+  {
+    for (auto const& [c, env] : overridden_)
+      c->setEnv(env);
+  }
+};
+
+class ForEach : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<ForEach>("foreach")
+      .icon(/*ICON_FA_LAYER_GROUP*/ "\xEF\x97\xBD")
+      .numMaxInput(2).numRequiredInput(1).numOutputs(1)
+      .inputPinNames({"Input", "Loop Body"})
+      .argDescs({
+        ArgDescBuilder("by").label("For Each").type(ArgType::MENU).menu({"Table", "Key"})
+          .description("run the loop body once per table of the input,\n"
+                       "or once per distinct key in rows of one table"),
+        tableSelectionArg("table", "Table", false),
+        columnSelectionArg("table", "keys", "Keys").type(ArgType::MULTI_MENU).tupleSize(0)
+      });
+  }
+  void bind(OpContext& ctx) override
+  {
+    if (!ctx.getState())
+      ctx.setState(new ForEachState);
+  }
+  void eval(OpContext& ctx) const override
+  {
+    PROFILER_SCOPE("foreach", 0x9575CD);
+    auto* state = static_cast<ForEachState*>(ctx.getState());
+    RUNTIME_CHECK(state, "foreach state should be initialized before eval");
+    auto* idc = ctx.fetchInputData(0);
+    RUNTIME_CHECK(idc, "no input data");
+    {
+      OpStageScope stage(ctx, "split");
+      state->pieces = split(ctx, idc);
+    }
+    sint const numPieces = state->pieces.ssize();
+    if (!ctx.hasInput(1) || numPieces == 0) {
+      auto* odc = ctx.reallocOutput(0);
+      for (auto const& piece : state->pieces)
+        for (sint t = 0; t < piece->numTables(); ++t)
+          odc->addTable(piece->getTable(t));
+      return;
+    }
+
+    // body nodes reading a piece, directly or not, are forked for each piece;
+    // the others are shared by all forks and evaluated once
+    auto*                  body = ctx.inputContext(1);
+    Vector<OpContext*>     variants;
+    Vector<OpNode const*>  variantNodes;
+    HashMap<OpContext*, bool> visited;
+    std::function<bool(OpContext*)> readsPiece = [&](OpContext* c) {
+      if (auto itr = visited.find(c); itr != visited.end())
+        return itr->second;
+      visited[c] = false;
+      bool reads = c->desc()->name == "foreach_item" && c->arg("controller").asString() == ctx.node()->name();
+      for (sint pin = 0, n = c->getNumInputs(); pin < n; ++pin)
+        if (auto* up = c->inputContext(pin))
+          reads = readsPiece(up) || reads;
+      if (reads) {
+        variants.push_back(c);
+        variantNodes.push_back(c->node());
+      }
+      return visited[c] = reads;
+    };
+    readsPiece(body);
+    for (auto* c : variants)
+      c->markDirty(true);
+
+    // each piece is passed on to the body through an environment scope of mine
+    OpEnvironment env;
+    auto const*   current = ctx.env() ? ctx.env() : ctx.node()->env();
+    if (current)
+      env = *current;
+    env.scopeOwner  = ctx.node();
+    env.scopeParent = current;
+    Vector<OpEnvironment> envs(numPieces, env);
+    for (sint i = 0; i < numPieces; ++i)
+      envs[i].scopePayload = &state->pieces[i];
+
+    // the first piece goes through the body itself, so edits to it make me dirty as usual;
+    // unless I'm a fork, whose body is a fork too
+    bool const                         bodyTakesFirst = ctx.node()->context() == &ctx;
+    Vector<std::unique_ptr<OpContext>> forks(numPieces);
+    // forking expands arguments again from the shared contexts, so none may run before all are made
+    for (sint i = bodyTakesFirst ? 1 : 0; i < numPieces; ++i)
+      forks[i].reset(body->fork(&envs[i], variantNodes));
+    for (auto& fork : forks)
+      if (fork)
+        fork->schedule();
+    ForEachBodyScope bodyScope(bodyTakesFirst ? variants : Vector<OpContext*>{}, envs[0]);
+
+    // all forks are waited for before they go away, even if some of them failed
+    sint const                bodyPin = ctx.node()->upstreams()[1].pin;
+    Vector<DataCollectionPtr> results(numPieces);
+    String                    failure;
+    for (sint i = 0; i < numPieces; ++i) {
+      try {
+        results[i] = !forks[i] ? ctx.fetchInputData(1) : forks[i]->getOrCalculateOutputData(bodyPin);
+        if (!results[i] && failure.empty())
+          failure = fmt::format("piece {}: loop body gave no output", i);
+      } catch (std::exception const& e) {
+        if (failure.empty())
+          failure = fmt::format("piece {}: {}", i, e.what());
+      }
+      ctx.reportProgress(real(i + 1) / numPieces);
+    }
+    if (!failure.empty())
+      throw ExecutionError(failure);
+
+    auto* odc = ctx.reallocOutput(0);
+    for (auto const& result : results)
+      for (sint t = 0; t < result->numTables(); ++t)
+        odc->addTable(result->getTable(t));
+  }
+
+private:
+  static Vector<DataCollectionPtr> split(OpContext& ctx, DataCollection* idc)
+  {
+    Vector<DataCollectionPtr> pieces;
+    if (ctx.arg("by").asInt() == 0) {
+      for (sint t = 0; t < idc->numTables(); ++t) {
+        auto piece = newDataCollection();
+        piece->addTable(idc->getTable(t));
+        pieces.push_back(piece);
+      }
+      return pieces;
+    }
+    sint const tableidx = ctx.arg("table").asInt();
+    RUNTIME_CHECK(tableidx>=0 && tableidx<idc->numTables(), "table {} out of bound [0, {})", tableidx, idc->numTables());
+    auto*      table     = idc->getTable(tableidx);
+    sint       numGroups = 0;
+    auto const groups    = detail::groupRows(table, ctx.arg("keys").asStringList(), numGroups);
+    // rows are bucketed once, then each piece copies just its own bucket
+    Vector<Vector<sint>> buckets(numGroups);
+    for (sint row = 0, n = groups.ssize(); row < n; ++row)
+      buckets[groups[row]].push_back(row);
+    auto const names = table->columnNames();
+    for (auto const& rows : buckets) {
+      auto            piece = newDataCollection();
+      auto*           part  = piece->getTable(piece->addTable());
+      CellIndex const first = part->addRows(rows.size());
+      for (auto const& name : names) {
+        auto const* scol = table->getColumn(name);
+        auto*       dcol = part->createColumn(name, scol->desc(), true);
+        auto*       cp   = dcol->copyInterface();
+        RUNTIME_CHECK(cp, "column \"{}\" cannot be copied", name);
+        // copy in runs of continuous indices
+        for (size_t i = 0; i < rows.size();) {
+          auto const start = table->getIndex(rows[i]);
+          size_t     run   = 1;
+          while (i + run < rows.size() && table->getIndex(rows[i + run]) == start.value() + run)
+            ++run;
+          cp->copy(first + sint(i), scol, start, run);
+          i += run;
+        }
+      }
+      for (auto const& kv : table->vars())
+        part->setVariable(kv.first, kv.second);
+      pieces.push_back(piece);
+    }
+    return pieces;
+  }
+};
+
+class ForEachItem : public OpKernel
+{
+public:
+  static OpDesc desc()
+  {
+    return makeOpDesc<ForEachItem>("foreach_item")
+      .numMaxInput(0).numOutputs(1)
+      .icon(/*ICON_FA_PUZZLE_PIECE*/ "\xEF\x84\xAE")
+      .flags(OpFlag::LIGHTWEIGHT)
+      .argDescs({
+        LoopControllee::controllerArg()
+      });
+  }
+  void eval(OpContext& ctx) const override
+  {
+    auto* ctrlNode = ctx.node()->parent()->node(ctx.arg("controller").asString());
+    RUNTIME_CHECK(ctrlNode && ctrlNode->context(), "no controller specified");
+    RUNTIME_CHECK(dynamic_cast<ForEach*>(*ctrlNode->context()->getKernel()), "controller is not a foreach node");
+    // the controller tells which piece is being evaluated through the environment
+    auto const* env   = ctx.env() ? ctx.env() : ctx.node()->env();
+    auto const* piece = static_cast<DataCollectionPtr const*>(env ? env->scopePayloadOf(ctrlNode) : nullptr);
+    RUNTIME_CHECK(piece, "not evaluated by the body of controller {}", ctrlNode->name());
+    ctx.setOutputData(0, *piece);
+  }
+};
+// For Each }}}
+
 }
 
 void registerBuiltinOps()
@@ -1359,6 +1762,7 @@ void registerBuiltinOps()
   OpRegistry::instance().add(op::Missing::desc());
   OpRegistry::instance().add(op::Defragment::desc());
   OpRegistry::instance().add(op::LuaScript::desc());
+  OpRegistry::instance().add(op::CppScriptOp::desc());
   OpRegistry::instance().add(op::StringCast::desc());
   OpRegistry::instance().add(op::Collect::desc());
   OpRegistry::instance().add(op::DropTable::desc());
@@ -1370,6 +1774,10 @@ void registerBuiltinOps()
   OpRegistry::instance().add(op::AddTable::desc());
   OpRegistry::instance().add(op::AddColumn::desc());
   OpRegistry::instance().add(op::AddRows::desc());
+  OpRegistry::instance().add(op::Map::desc());
+  OpRegistry::instance().add(op::Reduce::desc());
+  OpRegistry::instance().add(op::ForEach::desc());
+  OpRegistry::instance().add(op::ForEachItem::desc());
 
   OpRegistry::instance().add(op::LoopController::desc());
   OpRegistry::instance().add(op::LoopFeedback::desc());
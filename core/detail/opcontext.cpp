@@ -8,7 +8,9 @@
 #include "../datatable.h"
 #include "../utility.h"
 #include "../profiler.h"
+#include "../stats.h"
 
+#include "evalscope.h"
 #include "linearmap.h"
 #include "runtime.h"
 
@@ -18,6 +20,13 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <functional>
+
 #ifdef __unix__
 #include <sys/types.h>
 #include <sys/syscall.h>
@@ -48,10 +57,37 @@ static inline size_t gettid()
 }
 #endif
 
+/// cpu time consumed by calling thread, in seconds
+static inline double threadCpuSeconds()
+{
+#if defined(_WIN32)
+  FILETIME creation, exit, kernel, user;
+  if (!::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user))
+    return 0.0;
+  auto const ticks = [](FILETIME const& ft) { return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+  return (ticks(kernel) + ticks(user)) * 1e-7;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0.0;
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
 BEGIN_JOYFLOW_NAMESPACE
 
 namespace detail {
 
+static size_t totalRows(DataCollection const* dc)
+{
+  size_t rows = 0;
+  for (sint t = 0, n = dc ? dc->numTables() : 0; t < n; ++t)
+    rows += dc->getTable(t)->numRows();
+  return rows;
+}
+
 OpContextImpl::OpContextImpl(OpNode* node) :
   taskScheduled_(false),
   taskDone_(marl::Event::Mode::Manual),
@@ -64,8 +100,10 @@ OpContextImpl::OpContextImpl(OpNode* node) :
   inputUnusedFlag_(node->desc()->numMaxInput, false),
   outputDataCache_(node->desc()->numOutputs, nullptr),
   outputDataVersion_(node->desc()->numOutputs, 0),
-  outputActiveFlag_(node->desc()->numOutputs, false)
+  outputActiveFlag_(node->desc()->numOutputs, false),
+  opRowCost_(&CostModel::instance().history(node->desc()->name))
 {
+  OutputCacheDetail::instance().add(this);
 }
 
 OpContextImpl::OpContextImpl(OpContextImpl const& that):
@@ -75,9 +113,9 @@ OpContextImpl::OpContextImpl(OpContextImpl const& that):
   kernel_(OpRegistry::instance().createOp(that.desc()->name)),
   desc_(that.desc_),
   inputPinInfo_(that.inputPinInfo_),
-  inputContexts_(that.inputContexts_.size()),
-  outputDataCache_(),
-  outputDataVersion_(),
+  inputContexts_(),
+  outputDataCache_(that.desc_->numOutputs, nullptr),
+  outputDataVersion_(that.desc_->numOutputs, 0),
   inputDataVersionFromLastFetch_(),
   inputDataVersionFromLastEval_(),
   argsVersionFromLastEval_(that.argsVersionFromLastEval_),
@@ -94,7 +132,8 @@ OpContextImpl::OpContextImpl(OpContextImpl const& that):
   errorLevel_(OpErrorLevel::GOOD),
   errorMessage_(),
   shouldBreak_(false),
-  nodeName_(that.nodeName_)
+  nodeName_(that.nodeName_),
+  opRowCost_(that.opRowCost_)
 {
   if (node_->argCount() > 0) {
     argSnapshot_.reset(new LinearMap<String, ArgValue>());
@@ -103,23 +142,44 @@ OpContextImpl::OpContextImpl(OpContextImpl const& that):
       argSnapshot_->insert(name, node_->arg(name));
     }
   }
-  for (auto const* upstream: that.inputContexts_) {
-    if (upstream)
-      inputContexts_.push_back(new OpContextImpl(*upstream));
-    else
-      inputContexts_.push_back(nullptr);
+  // upstreams are wired by forkTree()
+}
+
+
+OpContextImpl::OpContextImpl(OpContextImpl const& stage, OpEnvironment const* env, BatchContextTag):
+  taskScheduled_(false),
+  taskDone_(marl::Event::Mode::Manual),
+  node_(stage.node_),
+  kernel_(OpRegistry::instance().createOp(stage.desc()->name)),
+  desc_(stage.desc_),
+  inputPinInfo_(stage.inputPinInfo_),
+  inputContexts_(stage.inputContexts_.size(), nullptr),
+  outputDataCache_(stage.desc_->numOutputs, nullptr),
+  outputDataVersion_(stage.desc_->numOutputs, 0),
+  outputActiveFlag_(stage.outputActiveFlag_),
+  inputDirtyFlag_(stage.inputContexts_.size(), true),
+  inputUnusedFlag_(stage.inputContexts_.size(), false),
+  environment_(env),
+  imFork_(true),
+  batchContext_(true),
+  nodeName_(stage.nodeName_),
+  opRowCost_(stage.opRowCost_)
+{
+  if (node_->argCount() > 0) {
+    argSnapshot_.reset(new LinearMap<String, ArgValue>());
+    for (sint argi = 0, argc = node_->argCount(); argi < argc; ++argi) {
+      auto name = node_->argName(argi);
+      argSnapshot_->insert(name, node_->arg(name));
+    }
   }
+  kernel_->bind(*this);
 }
-  
 
 OpContextImpl::~OpContextImpl()
 {
   OpRegistry::instance().destroyOp(kernel_);
-  if (imFork_) {
-    for (auto* upstream : inputContexts_)
-      if (upstream)
-        delete upstream;
-  }
+  if (!imFork_)
+    OutputCacheDetail::instance().remove(this);
 }
 
 sint OpContextImpl::getNumInputs() const
@@ -137,11 +197,35 @@ void OpContextImpl::evaluate()
       return;
     }
     PROFILER_SCOPE("OpNode::evaluate", 0x815476);
+    TRACE_SCOPE("evaluate", nodeName_);
     PROFILER_TEXT(nodeName_.c_str(), nodeName_.length());
     spdlog::trace("{}: evaluating at thread {}...", nodeName_, gettid());
+    // re-calculating evicted output, nothing has changed since last time,
+    // so downstream should not see a new version
+    bool const refill = outputEvicted_ && !dirtyFlag_;
+    Vector<sint> versionsBeforeRefill;
+    if (refill)
+      versionsBeforeRefill = outputDataVersion_;
+    lastEvalRefilled_ = refill;
+    auto const evalStart   = std::chrono::steady_clock::now();
+    auto const cpuStart    = threadCpuSeconds();
+    bool       diskHit     = false;
+    evalCopiedBytes_.store(0, std::memory_order_relaxed);
+    CopySinkScope copySink(&evalCopiedBytes_);
     beforeEval();
     try {
-      kernel_->eval(*this);
+      if (loadFromDiskCache()) {
+        diskHit = true;
+        spdlog::debug("{}: loaded from disk cache", nodeName_);
+      } else {
+        if (!evaluateStreaming())
+          kernel_->eval(*this);
+        storeToDiskCache();
+      }
+      std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - evalStart;
+      lastEvalSeconds_ = elapsed.count();
+      if (refill)
+        outputDataVersion_ = versionsBeforeRefill;
     } catch (CheckFailure const& f) {
       spdlog::error("check failure: {}", f.what());
       reportError(f.what(), OpErrorLevel::ERROR, false); // pass on to the calling thread
@@ -152,7 +236,46 @@ void OpContextImpl::evaluate()
       spdlog::error("std::exception: {}", e.what());
       reportError(e.what(), OpErrorLevel::ERROR, false); // pass on to the calling thread
     }
+    {
+      OpEvalMetrics m;
+      m.evalIndex    = evalCount_;
+      m.wallSeconds  = std::chrono::duration<real>(std::chrono::steady_clock::now() - evalStart).count();
+      m.cpuSeconds   = threadCpuSeconds() - cpuStart;
+      m.queueSeconds = queueSeconds_;
+      for (auto rows : inputRowsFetched_)
+        m.rowsIn += rows;
+      HashSet<DataCollection const*> counted;
+      for (auto const& dc : outputDataCache_) {
+        if (!dc || !counted.insert(dc.get()).second)
+          continue;
+        size_t shared = 0, unshared = 0;
+        dc->countMemory(shared, unshared);
+        m.rowsOut        += totalRows(dc.get());
+        m.bytesAllocated += unshared;
+      }
+      m.bytesCopied  = evalCopiedBytes_.load(std::memory_order_relaxed);
+      m.diskCacheHit = diskHit;
+      m.refill       = refill;
+      if (!batchContext_ && !shouldBreak_) {
+        evalCost_.add(m.wallSeconds);
+        if (m.rowsIn > 0)
+          opRowCost_->add(m.wallSeconds / m.rowsIn);
+      }
+      totalCopiedBytes_.fetch_add(m.bytesCopied, std::memory_order_relaxed);
+      totalProducedBytes_.fetch_add(m.bytesAllocated, std::memory_order_relaxed);
+      if (auto threshold = Stats::copyWarningThreshold(); threshold > 0 && m.bytesCopied > threshold)
+        spdlog::warn("{}: {:.1f} MB copied by copy-on-write, {:.1f}x of its {:.1f} MB output",
+                     nodeName_, m.bytesCopied / 1048576.0,
+                     real(m.bytesCopied) / std::max<size_t>(m.bytesAllocated, 1), m.bytesAllocated / 1048576.0);
+      std::lock_guard lock(metricsMutex_);
+      if (metricsHistory_.size() >= METRICS_HISTORY)
+        metricsHistory_.erase(metricsHistory_.begin());
+      metricsHistory_.push_back(m);
+    }
+    queueSeconds_ = 0.0;
     afterEval();
+    outputEvicted_ = false;
+    lastAccess_.store(OutputCacheDetail::instance().tick(), std::memory_order_relaxed);
     spdlog::trace("{}: done.", nodeName_);
   } else if (desc()->numOutputs>0) {
     beforeEval();
@@ -169,16 +292,62 @@ void OpContextImpl::evaluate()
   }
 }
 
+real OpContextImpl::expectedEvalSeconds() const
+{
+  sint rows      = 0;
+  bool rowsKnown = true;
+  for (auto const* upstream : inputContexts_) {
+    if (!upstream)
+      continue;
+    auto const upstreamRows = upstream->lastRowsOut();
+    if (upstreamRows < 0) {
+      rowsKnown = false;
+      break;
+    }
+    rows += upstreamRows;
+  }
+  if (auto const seconds = evalCost_.expected(); seconds >= 0) {
+    auto const rowsBefore = lastRowsIn();
+    return rowsKnown && rowsBefore > 0 ? seconds * rows / rowsBefore : seconds;
+  }
+  auto const perRow = opRowCost_->expected();
+  if (perRow < 0 || !rowsKnown)
+    return -1;
+  return perRow * rows;
+}
+
+sint OpContextImpl::lastRowsIn() const
+{
+  std::lock_guard lock(metricsMutex_);
+  return metricsHistory_.empty() ? -1 : sint(metricsHistory_.back().rowsIn);
+}
+
+sint OpContextImpl::lastRowsOut() const
+{
+  std::lock_guard lock(metricsMutex_);
+  return metricsHistory_.empty() ? -1 : sint(metricsHistory_.back().rowsOut);
+}
+
 void OpContextImpl::schedule()
 {
-  // don't schedule lightweight tasks
-  if ((desc()->flags&OpFlag::LIGHTWEIGHT)!=OpFlag::LIGHTWEIGHT &&
-      !taskScheduled_.exchange(true)) {
+  // don't schedule lightweight tasks, nor ones that would cost less than scheduling them:
+  // they run inline when waited for
+  if ((desc()->flags&OpFlag::LIGHTWEIGHT)==OpFlag::LIGHTWEIGHT ||
+      !TaskContext::instance().worthScheduling(expectedEvalSeconds())) {
+    spdlog::trace("{}: evaluating inline", nodeName_);
+    return;
+  }
+  if (!taskScheduled_.exchange(true)) {
     spdlog::debug("schedulered {} ...", nodeName_);
     PROFILER_SCOPE("Scheduling", 0x4C8DAE);
+    TRACE_SCOPE("schedule", nodeName_);
     taskDone_.clear();
-    TaskContext::instance().scheduler.enqueue(marl::Task([=]{
+    scheduledAt_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    TaskContext::instance().enqueue(marl::Task([=]{
       PROFILER_SCOPE("marl Task", 0xC0EBD7);
+      auto const now = std::chrono::steady_clock::now().time_since_epoch().count();
+      queueSeconds_  = std::chrono::duration<real>(std::chrono::steady_clock::duration(
+                         now - scheduledAt_.load(std::memory_order_relaxed))).count();
       try {
         evaluate();
       } catch (std::exception const& e) {
@@ -209,10 +378,14 @@ void OpContextImpl::wait()
   } else if(!taskDone_.isSignalled()) {
     evalWasCalled = true;
     PROFILER_SCOPE("Wait", 0xFF2121);
+    TRACE_SCOPE("wait", nodeName_);
     std::string profiletxt = fmt::format("Wait for {}", nodeName_);
     PROFILER_TEXT(profiletxt.c_str(), profiletxt.length());
     spdlog::trace("waiting for {} ...", nodeName_);
-    taskDone_.wait();
+    {
+      EvalSuspendScope suspend;
+      taskDone_.wait();
+    }
     spdlog::trace("waiting for {} ... done.", nodeName_);
   }
   if (evalWasCalled) {
@@ -251,14 +424,62 @@ void OpContextImpl::resolveDependency(bool recursive)
 
 OpContext* OpContextImpl::fork(OpEnvironment const* env)
 {
-  auto* ctx = new OpContextImpl(*this);
-  ctx->setEnv(env);
-  return ctx;
+  return forkTree(env, nullptr);
+}
+
+OpContext* OpContextImpl::fork(OpEnvironment const* env, Vector<OpNode const*> const& variants)
+{
+  return forkTree(env, &variants);
+}
+
+OpContextImpl* OpContextImpl::forkTree(OpEnvironment const* env, Vector<OpNode const*> const* variants)
+{
+  // upstreams reached along several paths, or through loops, are visited once
+  HashMap<OpContextImpl const*, bool>           dependent;
+  HashMap<OpContextImpl const*, OpContextImpl*> forks;
+  std::function<bool(OpContextImpl const*)> needsCopy = [&](OpContextImpl const* ctx) {
+    if (!variants)
+      return true;
+    if (auto itr = dependent.find(ctx); itr != dependent.end())
+      return itr->second;
+    dependent[ctx] = false;
+    bool copy = std::find(variants->begin(), variants->end(), ctx->node_) != variants->end();
+    for (auto const* upstream : ctx->inputContexts_)
+      copy = (upstream && needsCopy(upstream)) || copy;
+    return dependent[ctx] = copy;
+  };
+  OpContextImpl* root = nullptr;
+  std::function<OpContextImpl*(OpContextImpl const*)> forkOf = [&](OpContextImpl const* ctx) {
+    if (auto itr = forks.find(ctx); itr != forks.end())
+      return itr->second;
+    auto* copy = new OpContextImpl(*ctx);
+    copy->environment_ = env;
+    // expanded again in case the fork is for another frame
+    if (copy->argSnapshot_)
+      for (size_t i = 0, n = copy->argSnapshot_->size(); i < n; ++i)
+        if ((*copy->argSnapshot_)[i].readsFrameOrTime())
+          (*copy->argSnapshot_)[i].eval(copy);
+    forks[ctx] = copy;
+    if (root)
+      root->ownedForks_.emplace_back(copy);
+    else
+      root = copy;
+    for (auto* upstream : ctx->inputContexts_)
+      copy->inputContexts_.push_back(!upstream ? nullptr : needsCopy(upstream) ? forkOf(upstream) : upstream);
+    copy->kernel_->bind(*copy);
+    return copy;
+  };
+  return forkOf(this);
+}
+
+OpContext* OpContextImpl::inputContext(sint pin) const
+{
+  return pin >= 0 && pin < inputContexts_.ssize() ? inputContexts_[pin] : nullptr;
 }
 
 void OpContextImpl::requireInput(sint pin)
 {
-  if (!hasInput(pin))
+  if (batchContext_ || !hasInput(pin))
     return;
   auto *ictx = inputContexts_[pin];
   DEBUG_ASSERT(ictx);
@@ -271,6 +492,16 @@ void OpContextImpl::requireInput(sint pin)
 DataCollection* OpContextImpl::fetchInputData(sint pin)
 {
   ALWAYS_ASSERT(hasInput(pin));
+  if (batchContext_)
+    return streamInput_.get();
+  // consumed input may live in my output now - unless upstream is to be evaluated again,
+  // as loops do within one evaluation of their controller
+  if (pin < inputConsumed_.ssize() && inputConsumed_[pin]) {
+    if (!inputContexts_[pin]->isDirty())
+      reportError(fmt::format("input {} was consumed by moveInputToOutput(), fetch it before", pin),
+                  OpErrorLevel::ERROR, true);
+    inputConsumed_[pin] = false;
+  }
   auto* ictx = inputContexts_[pin];
   DEBUG_ASSERT(ictx);
   try {
@@ -280,6 +511,8 @@ DataCollection* OpContextImpl::fetchInputData(sint pin)
       throw ExecutionError(ictx->errorMessage_);
     }
     inputDataVersionFromLastFetch_[pin] = ictx->outputVersion(inputPinInfo_[pin].pin);
+    ensureVectorSize(inputRowsFetched_, pin + 1);
+    inputRowsFetched_[pin] = totalRows(dc);
     return dc;
   } catch(std::exception const& e) {
     reportError(fmt::format("upstream {} failed because:\n{}", ictx->nodeName_, e.what()), ictx->errorLevel_, true);
@@ -289,6 +522,8 @@ DataCollection* OpContextImpl::fetchInputData(sint pin)
 
 bool OpContextImpl::hasInput(sint pin) const
 {
+  if (batchContext_)
+    return pin == 0 && streamInput_;
   return pin >= 0 && pin<inputContexts_.ssize() && inputContexts_[pin];
 }
 
@@ -389,12 +624,118 @@ DataCollection* OpContextImpl::getOutputCache(sint pin) const
 DataCollection* OpContextImpl::getOrCalculateOutputData(sint pin)
 {
   if (!hasOutputCache(pin) || isDirty()) { // need re-evaluation
+    cacheMisses_.fetch_add(1, std::memory_order_relaxed);
     schedule();
     wait();
+  } else {
+    cacheHits_.fetch_add(1, std::memory_order_relaxed);
   }
+  lastAccess_.store(OutputCacheDetail::instance().tick(), std::memory_order_relaxed);
   return getOutputCache(pin);
 }
 
+OpEnvironment const* OpContextImpl::effectiveEnv() const
+{
+  return environment_ ? environment_ : (node_ ? node_->env() : nullptr);
+}
+
+CachingPolicy OpContextImpl::cachingPolicy() const
+{
+  auto const* env = effectiveEnv();
+  return env ? env->cachingPolicy : CachingPolicy::Caching;
+}
+
+bool OpContextImpl::outputPinned() const
+{
+  if (taskScheduled_.load())
+    return true;
+  auto* graph = node_->parent();
+  if (!graph)
+    return false;
+  for (auto const& pinset : node_->downstreams()) {
+    for (auto const& pin : pinset) {
+      auto* dsnode = graph->node(pin.name);
+      if (dsnode && dsnode->context() && dsnode->context()->isDirty())
+        return true;
+    }
+  }
+  return false;
+}
+
+void OpContextImpl::evictOutput()
+{
+  std::fill(outputDataCache_.begin(), outputDataCache_.end(), nullptr);
+  outputEvicted_ = true;
+}
+
+DataCollectionPtr OpContextImpl::takeOutput(sint pin, OpContextImpl const* taker, sint takerPin)
+{
+  // cached outputs are kept for the next evaluation unless the upstream opted in
+  auto const policy = cachingPolicy();
+  if (policy != CachingPolicy::NonCaching && policy != CachingPolicy::HandOver)
+    return nullptr;
+  // handed over output that had to be re-calculated once already is wanted again and again
+  // (e.g. while tweaking args downstream), stop trading it for a copy
+  if (policy == CachingPolicy::HandOver && lastEvalRefilled_)
+    return nullptr;
+  // someone else (another output pin, or whoever fetched it before) holds a reference
+  if (!hasOutputCache(pin) || outputDataCache_[pin]->refcnt() != 1)
+    return nullptr;
+  // forks do not own their node, the link structure tells nothing about them
+  if (imFork_ || taker->imFork_)
+    return nullptr;
+  auto* graph = node_->parent();
+  if (!graph || pin >= node_->downstreams().ssize())
+    return nullptr;
+  // the taker is linked, and it's the only downstream still going to read this output
+  bool linked = false;
+  for (auto const& link : node_->downstreams()[pin]) {
+    if (link.pin == takerPin && link.name == taker->node_->name()) {
+      linked = true;
+      continue;
+    }
+    auto* dsnode = graph->node(link.name);
+    if (dsnode && dsnode->context() && dsnode->context()->isDirty())
+      return nullptr;
+  }
+  if (!linked)
+    return nullptr;
+
+  spdlog::trace("{}: output {} handed over to {}", nodeName_, pin, taker->nodeName_);
+  // same as being evicted: re-calculate on demand, without bumping up the version
+  DataCollectionPtr taken = std::move(outputDataCache_[pin]);
+  outputDataCache_[pin] = nullptr;
+  outputEvicted_ = true;
+  return taken;
+}
+
+bool OpContextImpl::loadFromDiskCache()
+{
+  if (diskCacheKey_ == 0)
+    return false;
+  Vector<DataCollectionPtr> outputs(outputDataCache_.size(), nullptr);
+  if (!DiskCacheDetail::instance().load(diskCacheKey_, outputs))
+    return false;
+  for (sint pin = 0, n = outputs.ssize(); pin < n; ++pin) {
+    // stored by someone who did not need this output
+    if (outputIsActive(pin) && !outputs[pin])
+      return false;
+  }
+  // inputs are left unfetched, their changes are tracked by the key
+  for (sint pin = 0, n = outputs.ssize(); pin < n; ++pin)
+    setOutputData(pin, std::move(outputs[pin]));
+  outputDiskCacheKey_ = diskCacheKey_;
+  return true;
+}
+
+void OpContextImpl::storeToDiskCache()
+{
+  outputDiskCacheKey_ = diskCacheKey_;
+  if (diskCacheKey_ == 0 || shouldBreak_ || errorLevel_ >= OpErrorLevel::ERROR)
+    return;
+  DiskCacheDetail::instance().store(diskCacheKey_, outputDataCache_);
+}
+
 bool OpContextImpl::outputIsActive(sint pin) const
 {
   if (pin < 0 || pin >= desc_->numOutputs || pin >= outputActiveFlag_.ssize())
@@ -414,14 +755,7 @@ DataCollection* OpContextImpl::reallocOutput(sint pin)
 {
   ASSERT(pin >= 0 && pin < desc_->numOutputs);
   outputDataCache_[pin] = newDataCollection();
-  if (inputDataVersionFromLastEval_.empty())
-    ++outputDataVersion_[pin];
-  else {
-    sint maxInputVersion = -1;
-    for (auto iv : inputDataVersionFromLastFetch_)
-      maxInputVersion = std::max(maxInputVersion, iv);
-    outputDataVersion_[pin] = maxInputVersion + 1;
-  }
+  updateOutputVersion(pin);
   return outputDataCache_[pin].get();
 }
 
@@ -430,29 +764,45 @@ DataCollection* OpContextImpl::copyInputToOutput(sint pin, sint copyFromInput)
   ASSERT(pin >= 0 && pin < desc_->numOutputs);
   ASSERT(copyFromInput < desc_->numMaxInput);
   if (copyFromInput >= 0) {
-    // TODO: if this node is the only successor of its upstream,
-    //       it's safe to directly reuse upstream data
-    if (hasInput(copyFromInput))
+    if (hasInput(copyFromInput)) {
       outputDataCache_[pin] = fetchInputData(copyFromInput)->share();
-    else
+    } else {
       outputDataCache_[pin] = newDataCollection();
+    }
   } else {
     outputDataCache_[pin] = newDataCollection();
   }
-  if (inputDataVersionFromLastEval_.empty())
-    ++outputDataVersion_[pin];
-  else {
-    sint maxInputVersion = -1;
-    for (auto iv : inputDataVersionFromLastFetch_)
-      maxInputVersion = std::max(maxInputVersion, iv);
-    outputDataVersion_[pin] = maxInputVersion + 1;
-  }
+  updateOutputVersion(pin);
+  return outputDataCache_[pin].get();
+}
+
+DataCollection* OpContextImpl::moveInputToOutput(sint pin, sint moveFromInput)
+{
+  ASSERT(pin >= 0 && pin < desc_->numOutputs);
+  ASSERT(moveFromInput >= 0 && moveFromInput < desc_->numMaxInput);
+  if (batchContext_ || !hasInput(moveFromInput))
+    return copyInputToOutput(pin, moveFromInput);
+  auto* idc = fetchInputData(moveFromInput);
+  // if this node is the only one still to read upstream data,
+  // it's safe to directly reuse it
+  if (auto taken = inputContexts_[moveFromInput]->takeOutput(inputPinInfo_[moveFromInput].pin, this, moveFromInput))
+    outputDataCache_[pin] = std::move(taken);
+  else
+    outputDataCache_[pin] = idc->share();
+  ensureVectorSize(inputConsumed_, moveFromInput + 1);
+  inputConsumed_[moveFromInput] = true;
+  updateOutputVersion(pin);
   return outputDataCache_[pin].get();
 }
 
 void OpContextImpl::setOutputData(sint pin, DataCollectionPtr dc)
 {
   outputDataCache_[pin] = dc;
+  updateOutputVersion(pin);
+}
+
+void OpContextImpl::updateOutputVersion(sint pin)
+{
   if (inputDataVersionFromLastEval_.empty())
     ++outputDataVersion_[pin];
   else {
@@ -494,9 +844,96 @@ void OpContextImpl::reportError(StringView const& message,
     throw ExecutionError(errorMessage_);
 }
 
+// Progress {{{
+/// minimal interval between two visible progress updates
+static constexpr int64_t PROGRESS_PUBLISH_INTERVAL_NS = 50'000'000;
+
+static inline int64_t steadyNowNS()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void OpContextImpl::reportProgress(real fraction, StringView const& message)
+{
+  fraction = std::clamp<real>(fraction, 0.0, 1.0);
+  int64_t const now = steadyNowNS();
+  // throttle, but never drop the final report
+  if (fraction < 1.0 &&
+      now - progressLastPublish_.load(std::memory_order_relaxed) < PROGRESS_PUBLISH_INTERVAL_NS)
+    return;
+  progressLastPublish_.store(now, std::memory_order_relaxed);
+  if (!message.empty())
+    storeProgressMessage(message);
+  progress_.store(fraction, std::memory_order_relaxed);
+}
+
+void OpContextImpl::storeProgressMessage(StringView const& message)
+{
+  // seqlock writer: the fence keeps the bytes from being seen before the counter turns odd,
+  // bytes are atomic as readers may race with us
+  size_t const len = std::min(message.size(), PROGRESS_MESSAGE_SIZE - 1);
+  progressSeq_.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < len; ++i)
+    progressMessage_[i].store(message[i], std::memory_order_relaxed);
+  progressMessage_[len].store(0, std::memory_order_relaxed);
+  progressSeq_.fetch_add(1, std::memory_order_release);
+}
+
+String OpContextImpl::progressMessage() const
+{
+  char buf[PROGRESS_MESSAGE_SIZE];
+  uint32_t seq0 = 0, seq1 = 0;
+  do {
+    seq0 = progressSeq_.load(std::memory_order_acquire);
+    if (seq0 & 1)
+      continue;
+    for (size_t i = 0; i < PROGRESS_MESSAGE_SIZE; ++i)
+      if (!(buf[i] = progressMessage_[i].load(std::memory_order_relaxed)))
+        break;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    seq1 = progressSeq_.load(std::memory_order_relaxed);
+  } while ((seq0 & 1) || seq0 != seq1);
+  buf[PROGRESS_MESSAGE_SIZE - 1] = 0;
+  return String(buf);
+}
+
+void OpContextImpl::addStageTime(StringView const& stage, real seconds)
+{
+  std::lock_guard lock(stageMutex_);
+  for (auto& st : stageTimings_) {
+    if (st.name == stage) {
+      st.seconds += seconds;
+      return;
+    }
+  }
+  stageTimings_.push_back({String(stage), seconds});
+}
+
+Vector<OpEvalMetrics> OpContextImpl::metrics() const
+{
+  std::lock_guard lock(metricsMutex_);
+  return metricsHistory_;
+}
+
+real OpContextImpl::copyAmplification() const
+{
+  auto const produced = totalProducedBytes_.load(std::memory_order_relaxed);
+  return real(totalCopiedBytes_.load(std::memory_order_relaxed)) / std::max<size_t>(produced, 1);
+}
+
+Vector<OpStageTiming> OpContextImpl::stageTimings() const
+{
+  std::lock_guard lock(stageMutex_);
+  return stageTimings_;
+}
+// Progress }}}
+
 void OpContextImpl::beforeFrameEval()
 {
   resolveDependency(false);
+  diskCacheKey_ = 0;
   //ensureVectorSize(inputUnusedFlag_, inputContexts_.size());
   //std::fill(inputUnusedFlag_.begin(), inputUnusedFlag_.end(), true);
   try {
@@ -515,6 +952,14 @@ void OpContextImpl::beforeEval()
     errorMessage_ = "";
     shouldBreak_ = false;
   }
+  {
+    std::lock_guard lock(stageMutex_);
+    stageTimings_.clear();
+  }
+  inputRowsFetched_.clear();
+  storeProgressMessage("");
+  progress_.store(0.0, std::memory_order_relaxed);
+  progressLastPublish_.store(0, std::memory_order_relaxed);
   kernel_->beforeEval(*this);
   sint numValidInputs = 0;
 
@@ -531,6 +976,7 @@ void OpContextImpl::beforeEval()
   }
   ensureVectorSize(inputUnusedFlag_, inputContexts_.size());
   std::fill(inputUnusedFlag_.begin(), inputUnusedFlag_.end(), true);
+  inputConsumed_.clear();
 
   if (numValidInputs < desc()->numRequiredInput)
     reportError("Input missing", OpErrorLevel::FATAL, true);
@@ -545,6 +991,8 @@ void OpContextImpl::afterEval()
   std::fill(inputDirtyFlag_.begin(), inputDirtyFlag_.end(), false);
   outputActivityDirty_ = false;
   dirtyFlag_ = false;
+  inputConsumed_.clear();
+  progress_.store(1.0, std::memory_order_relaxed);
   kernel_->beforeEval(*this);
   taskDone_.clear();
   taskScheduled_.store(false);
@@ -589,6 +1037,11 @@ void OpContextImpl::evalArguments()
   ASSERT(node_);
   ALWAYS_ASSERT(!imFork_);
   node_->evalAllArguments();
+  // upstreams have their arguments evaluated first, so are their keys
+  diskCacheKey_ = DiskCacheDetail::instance().keyOf(*this);
+  // outputs loaded from disk leave inputs unfetched, rely on the key to tell changes
+  if (outputDiskCacheKey_ != 0 && outputDiskCacheKey_ != diskCacheKey_)
+    dirtyFlag_ = true;
 }
 
 static struct OpContextInspectorRegister {
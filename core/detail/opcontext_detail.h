@@ -8,7 +8,9 @@
 #include "../utility.h"
 #include "../profiler.h"
 
+#include "diskcache_detail.h"
 #include "linearmap.h"
+#include "outputcache_detail.h"
 #include "runtime.h"
 
 #include <marl/event.h>
@@ -49,6 +51,8 @@ private:
   bool                      bypassed_    = false;
   bool                      outputActivityDirty_ = false;
   bool                      imFork_      = false; // am i a fork?
+  // the fork that was asked for owns all upstreams forked along with it
+  Vector<std::unique_ptr<OpContextImpl>> ownedForks_;
   bool                      dirtyFlag_   = false; // anything dirty?
   sint                      evalCount_   = 0;
   mutable std::mutex        errorMutex_;
@@ -58,6 +62,52 @@ private:
   String                    nodeName_;
   std::unique_ptr<OpStateBlock> stateblock_ = nullptr;
 
+  // progress, written by the evaluating thread and polled by anyone:
+  // message is guarded by a sequence counter (odd while writing)
+  static constexpr size_t   PROGRESS_MESSAGE_SIZE = 128;
+  std::atomic<real>         progress_{0.0};
+  std::atomic<uint32_t>     progressSeq_{0};
+  std::atomic<char>         progressMessage_[PROGRESS_MESSAGE_SIZE] = {};
+  std::atomic<int64_t>      progressLastPublish_{0}; // steady clock, in nanoseconds
+  mutable std::mutex        stageMutex_;
+  Vector<OpStageTiming>     stageTimings_;
+
+  // evaluation metrics, see metrics()
+  static constexpr size_t   METRICS_HISTORY = 16;
+  mutable std::mutex        metricsMutex_;
+  Vector<OpEvalMetrics>     metricsHistory_;
+  std::atomic<int64_t>      scheduledAt_{0}; // steady clock, in nanoseconds
+  real                      queueSeconds_ = 0.0;
+  Vector<size_t>            inputRowsFetched_;
+  std::atomic<size_t>       cacheHits_{0};
+  std::atomic<size_t>       cacheMisses_{0};
+  std::atomic<size_t>       evalCopiedBytes_{0}; // copy-on-write sink of current evaluation
+  std::atomic<size_t>       totalCopiedBytes_{0};
+  std::atomic<size_t>       totalProducedBytes_{0};
+  CostHistory               evalCost_;                // wall seconds per evaluation
+  CostHistory*              opRowCost_ = nullptr;     // wall seconds per input row, shared by my op type
+
+  // output cache bookkeeping, see OutputCacheDetail
+  std::atomic<uint64_t>     lastAccess_{0};
+  real                      lastEvalSeconds_ = 0.0;
+  bool                      outputEvicted_   = false;
+  // inputs consumed by moveInputToOutput() during current evaluation
+  Vector<bool>              inputConsumed_;
+  // last evaluation re-calculated an evicted output, see takeOutput()
+  bool                      lastEvalRefilled_ = false;
+  friend class OutputCacheDetail;
+
+  // disk cache keys, see DiskCacheDetail; 0 means not cacheable
+  uint64_t                  diskCacheKey_       = 0; // key of current frame
+  uint64_t                  outputDiskCacheKey_ = 0; // key of outputs I'm holding
+  friend class DiskCacheDetail;
+
+  // streaming, see opstream.cpp
+  bool                      batchContext_ = false; // evaluates batches on behalf of a pipeline stage
+  DataCollectionPtr         streamInput_;          // current batch, fed to input 0
+  struct BatchContextTag {};
+  OpContextImpl(OpContextImpl const& stage, OpEnvironment const* env, BatchContextTag);
+
 public:
   OpContextImpl(OpNode* node);
   OpContextImpl(OpContextImpl const&);
@@ -81,6 +131,7 @@ public:
   DataCollection* getOutputCache(sint pin) const override;
   DataCollection* getOrCalculateOutputData(sint pin) override;
   DataCollection* copyInputToOutput(sint pinout, sint pinin) override;
+  DataCollection* moveInputToOutput(sint pinout, sint pinin) override;
   DataCollection* reallocOutput(sint pin) override;
   void            setOutputData(sint pin, DataCollectionPtr dc) override;
   void            increaseOutputVersion(sint pin) override;
@@ -95,6 +146,32 @@ public:
   sint            evalCount() const override { return evalCount_; }
   void            evaluate();
 
+  /// my environment, or my node's if not overridden
+  OpEnvironment const* effectiveEnv() const;
+  CachingPolicy   cachingPolicy() const;
+  /// output should be kept because some downstream is going to use it
+  bool            outputPinned() const;
+  /// drop cached outputs, they will be re-calculated on demand
+  void            evictOutput();
+  /// hand over output data to `taker` (reading it from input pin `takerPin`) if no other
+  /// downstream is going to read it, otherwise returns nullptr
+  DataCollectionPtr takeOutput(sint pin, OpContextImpl const* taker, sint takerPin);
+  /// try loading outputs from disk cache instead of evaluating
+  bool            loadFromDiskCache();
+  void            storeToDiskCache();
+  /// version of freshly written output, newer than any input seen
+  void            updateOutputVersion(sint pin);
+  /// publish progress message to pollers, see progressMessage()
+  void            storeProgressMessage(StringView const& message);
+
+  /// can I be a stage of streaming pipeline?
+  bool            streamable() const;
+  /// stages of the streaming pipeline ending at me, upstream first;
+  /// empty if streaming does not apply
+  Vector<OpContextImpl*> streamingPipeline();
+  /// evaluate as the tail of a streaming pipeline, returns false if not applicable
+  bool            evaluateStreaming();
+
   bool setScheduled(bool sch) override
   {
     if (sch)
@@ -103,10 +180,23 @@ public:
       taskDone_.clear();
     return taskScheduled_.exchange(sch);
   }
+  /// expected wall seconds of my next evaluation, -1 if unknown:
+  /// from my own history scaled by rows coming in now against last time,
+  /// or from my op type's per-row cost and what my inputs produced last time
+  real expectedEvalSeconds() const;
+  /// rows of my inputs when last evaluated, -1 if never
+  sint lastRowsIn() const;
+  /// rows of my outputs when last evaluated, -1 if never
+  sint lastRowsOut() const;
+
   void schedule() override;
   void wait() override;
   void resolveDependency(bool recursive) override;
   OpContext* fork(OpEnvironment const* env) override;
+  OpContext* fork(OpEnvironment const* env, Vector<OpNode const*> const& variants) override;
+  /// forks me and my upstreams, all of them if `variants` is null
+  OpContextImpl* forkTree(OpEnvironment const* env, Vector<OpNode const*> const* variants);
+  OpContext* inputContext(sint pin) const override;
   OpKernelHandle getKernel() const override { return kernel_; }
 
   OpEnvironment const* env() const override { return environment_; }
@@ -119,6 +209,16 @@ public:
   OpErrorLevel lastError() const override { return errorLevel_; }
   String       errorMessage() const override { return errorMessage_; }
 
+  void   reportProgress(real fraction, StringView const& message) override;
+  real   progress() const override { return progress_.load(std::memory_order_relaxed); }
+  String progressMessage() const override;
+  void   addStageTime(StringView const& stage, real seconds) override;
+  Vector<OpStageTiming> stageTimings() const override;
+  Vector<OpEvalMetrics> metrics() const override;
+  size_t cacheHits() const override { return cacheHits_.load(std::memory_order_relaxed); }
+  size_t cacheMisses() const override { return cacheMisses_.load(std::memory_order_relaxed); }
+  real   copyAmplification() const override;
+
   void bindKernel() override { kernel_->bind(*this); }
   void beforeFrameEval() override;
   void beforeEval() override;
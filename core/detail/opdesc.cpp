@@ -1,4 +1,5 @@
 #include "opdesc.h"
+#include "oplib.h"
 #include "serialize.h"
 
 BEGIN_JOYFLOW_NAMESPACE
@@ -65,6 +66,8 @@ bool OpRegistryImpl::add(OpDesc const& desc, bool overwriteExisting)
     shouldRecreate = true;
   }
   descRegistery_[desc.name] = desc;
+  if (desc.libVersion == 0)
+    descRegistery_[desc.name].libVersion = openingOpLibVersion();
   if (shouldRecreate) {
     // TODO: overwrite OpDesc
   }
@@ -2,6 +2,7 @@
 
 #include "opgraph_detail.h"
 #include "linearmap.h"
+#include "outputcache_detail.h"
 #include "runtime.h"
 #include "serialize.h"
 
@@ -9,6 +10,9 @@
 #include <fmt/format.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <functional>
+
 BEGIN_JOYFLOW_NAMESPACE
 
 // OpNode Impl {{{
@@ -579,6 +583,7 @@ DataCollectionPtr OpGraphImpl::evalNode(String const& name, sint pin)
   auto* outnode = node(name);
   if (outnode == nullptr)
     return nullptr;
+  detail::OutputCacheFrameScope cacheFrame;
   if (outnode->context()) // if the context already exists, this will mark output activity dirty
     outnode->context()->setOutputActive(pin, true);
   prepareEvaluation(name);
@@ -636,6 +641,73 @@ CORE_API void deleteGraph(OpGraph* graph)
   delete graph;
 }
 
+CORE_API String metricsReport(OpGraph const* graph)
+{
+  struct Row
+  {
+    String        path;
+    String        optype;
+    OpEvalMetrics total;
+    real          maxWall   = 0;
+    sint          evals     = 0;
+    sint          diskHits  = 0;
+    sint          refills   = 0;
+    size_t        cacheHits = 0, cacheMisses = 0;
+    real          amplification = 0;
+  };
+  Vector<Row> rows;
+  std::function<void(OpGraph const*, String const&)> collect = [&](OpGraph const* g, String const& prefix) {
+    for (auto const& name : g->childNames()) {
+      auto* node = g->node(name);
+      if (!node)
+        continue;
+      auto path = prefix + "/" + name;
+      if (auto* subgraph = dynamic_cast<OpGraph const*>(node))
+        collect(subgraph, path);
+      auto* ctx = node->context();
+      if (!ctx)
+        continue;
+      Row row;
+      row.path        = path;
+      row.optype      = node->optype();
+      row.cacheHits   = ctx->cacheHits();
+      row.cacheMisses = ctx->cacheMisses();
+      row.amplification = ctx->copyAmplification();
+      for (auto const& m : ctx->metrics()) {
+        ++row.evals;
+        row.maxWall               = std::max(row.maxWall, m.wallSeconds);
+        row.total.wallSeconds    += m.wallSeconds;
+        row.total.cpuSeconds     += m.cpuSeconds;
+        row.total.queueSeconds   += m.queueSeconds;
+        row.total.rowsIn         += m.rowsIn;
+        row.total.rowsOut        += m.rowsOut;
+        row.total.bytesAllocated += m.bytesAllocated;
+        row.total.bytesCopied    += m.bytesCopied;
+        row.diskHits             += m.diskCacheHit;
+        row.refills              += m.refill;
+      }
+      rows.push_back(std::move(row));
+    }
+  };
+  collect(graph, "");
+  std::sort(rows.begin(), rows.end(), [](Row const& a, Row const& b) {
+    return a.total.wallSeconds > b.total.wallSeconds;
+  });
+
+  constexpr real MB = 1024.0 * 1024.0;
+  String report = fmt::format("{:<32} {:<16} {:>5} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>9} {:>9} {:>6} {:>11} {:>5} {:>6}\n",
+                              "node", "type", "evals", "wall(ms)", "max(ms)", "cpu(ms)", "queue(ms)",
+                              "rows in", "rows out", "alloc(MB)", "copy(MB)", "amp", "cache h/m", "disk", "refill");
+  for (auto const& r : rows) {
+    report += fmt::format("{:<32} {:<16} {:>5} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10} {:>10} {:>9.2f} {:>9.2f} {:>6.2f} {:>11} {:>5} {:>6}\n",
+                          r.path, r.optype, r.evals,
+                          r.total.wallSeconds * 1e3, r.maxWall * 1e3, r.total.cpuSeconds * 1e3, r.total.queueSeconds * 1e3,
+                          r.total.rowsIn, r.total.rowsOut, r.total.bytesAllocated / MB, r.total.bytesCopied / MB, r.amplification,
+                          fmt::format("{}/{}", r.cacheHits, r.cacheMisses), r.diskHits, r.refills);
+  }
+  return report;
+}
+
 bool OpGraphImpl::load(const Json& self)
 {
   // ----------- clean up --------------
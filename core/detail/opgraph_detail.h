@@ -76,7 +76,16 @@ public:
 
   void                 setEnv(OpEnvironment const* env) override { environment_ = env; }
   void                 overrideEnv(OpEnvironment env) override { ownEnvironment_.reset(new OpEnvironment(std::move(env))); }
-  OpEnvironment const* env() const override { return ownEnvironment_ ? ownEnvironment_.get() : environment_; }
+  OpEnvironment const* env() const override
+  {
+    // falls back to the environment of the graph this node belongs to,
+    // otherwise overriding a graph's environment would not reach its children
+    if (ownEnvironment_)
+      return ownEnvironment_.get();
+    if (environment_)
+      return environment_;
+    return parent_ ? parent_->env() : nullptr;
+  }
 
   size_t                argCount() const override { return argValues_.size(); }
   sint                  argVersion(size_t idx) const override { return argValues_[idx].version(); }
@@ -123,6 +132,7 @@ class OpGraphImpl
   OpDesc*                     ownDesc_ = nullptr;
 
   OpGraphImpl(OpGraphImpl const&) = delete;
+  friend class RootContextImpl;
 
 protected:
   /// updates dependency & dirty flag
@@ -21,6 +21,8 @@ static IMPL_VERSION_INFO()
 
 BEGIN_JOYFLOW_NAMESPACE
 
+static uint64_t openingLibVersion_ = 0;
+
 static std::map<String, DllHandle>& loadedLibs()
 {
   static std::map<String, DllHandle> libs_;
@@ -68,7 +70,9 @@ bool openOpLib(String const& dllpath)
     return false;
   }
   loadedLibs()[dllpath] = dll;
+  openingLibVersion_ = dlVersion.libVersion;
   reinterpret_cast<void(*)()>(funcOpenLib)();
+  openingLibVersion_ = 0;
   spdlog::info("successfully loaded {}", dllpath);
   return true;
 }
@@ -85,6 +89,18 @@ bool closeOpLib(String const& dllpath)
   }
 }
 
+void* opLibSymbol(String const& dllpath, char const* name)
+{
+  if (auto itr = loadedLibs().find(dllpath); itr!=loadedLibs().end())
+    return reinterpret_cast<void*>(GET_FUNC(itr->second, name));
+  return nullptr;
+}
+
+uint64_t openingOpLibVersion()
+{
+  return openingLibVersion_;
+}
+
 String defaultOpDir()
 {
 #ifdef _WIN32
@@ -0,0 +1,323 @@
+#include "opcontext_detail.h"
+
+#include "../datatable.h"
+#include "../opdesc.h"
+#include "../opgraph.h"
+#include "../profiler.h"
+
+#include "evalscope.h"
+#include "runtime.h"
+
+#include <marl/conditionvariable.h>
+#include <marl/mutex.h>
+#include <marl/waitgroup.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+/// batches in flight between two stages, bounds peak memory of the pipeline
+static constexpr size_t STREAM_QUEUE_CAPACITY = 4;
+
+// Batch Queue {{{
+class BatchQueue
+{
+  marl::mutex                   mutex_;
+  marl::ConditionVariable       cv_;
+  std::deque<DataCollectionPtr> items_;
+  bool                          closed_ = false;
+
+public:
+  /// blocks while full, returns false if the queue was closed
+  bool push(DataCollectionPtr dc)
+  {
+    EvalSuspendScope suspend;
+    marl::lock       lock(mutex_);
+    cv_.wait(lock, [this] { return closed_ || items_.size() < STREAM_QUEUE_CAPACITY; });
+    if (closed_)
+      return false;
+    items_.push_back(std::move(dc));
+    cv_.notify_all();
+    return true;
+  }
+
+  /// blocks while empty, returns false once closed and drained
+  bool pop(DataCollectionPtr& dc)
+  {
+    EvalSuspendScope suspend;
+    marl::lock       lock(mutex_);
+    cv_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty())
+      return false;
+    dc = std::move(items_.front());
+    items_.pop_front();
+    cv_.notify_all();
+    return true;
+  }
+
+  void close()
+  {
+    marl::lock lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+};
+// }}}
+
+static size_t maxRowsOf(DataCollection const* dc)
+{
+  size_t maxRows = 0;
+  for (sint t = 0, nt = dc->numTables(); t < nt; ++t)
+    maxRows = std::max(maxRows, dc->getTable(t)->numRows());
+  return maxRows;
+}
+
+/// copy rows [begin, begin+count) of every table into a new collection,
+/// returns nullptr once all tables are exhausted (the first slice is always made, to keep the schema);
+/// batches are copies rather than shared views, as stages modify them in place and a shared
+/// column would be copied as a whole
+static DataCollectionPtr sliceRows(DataCollection* src, size_t begin, size_t count)
+{
+  if (begin > 0 && begin >= maxRowsOf(src))
+    return nullptr;
+
+  auto dst = newDataCollection();
+  dst->reserveTables(src->numTables());
+  for (sint t = 0, nt = src->numTables(); t < nt; ++t) {
+    auto const*  stb   = src->getTable(t);
+    auto*        dtb   = dst->getTable(dst->addTable());
+    size_t const nrows = stb->numRows();
+    size_t const b     = std::min(begin, nrows);
+    size_t const e     = std::min(begin + count, nrows);
+    CellIndex    first = e > b ? dtb->addRows(e - b) : CellIndex(0);
+    for (auto const& name : stb->columnNames()) {
+      auto const* scol = stb->getColumn(name);
+      auto*       dcol = dtb->createColumn(name, scol->desc(), true);
+      auto*       cp   = dcol->copyInterface();
+      RUNTIME_CHECK(cp, "column \"{}\" cannot be copied", name);
+      // copy in runs of continuous indices
+      for (size_t row = b; row < e;) {
+        auto const start = stb->getIndex(row);
+        size_t     run   = 1;
+        while (row + run < e && stb->getIndex(row + run) == start.value() + run)
+          ++run;
+        cp->copy(first + sint(row - b), scol, start, run);
+        row += run;
+      }
+    }
+    for (auto const& kv : stb->vars())
+      dtb->setVariable(kv.first, kv.second);
+  }
+  return dst;
+}
+
+bool OpContextImpl::streamable() const
+{
+  if (imFork_ || bypassed_ || !*kernel_)
+    return false;
+  if (!(desc_->flags & OpFlag::STREAMABLE) || !!(desc_->flags & OpFlag::ALLOW_LOOP))
+    return false;
+  // stages take a single input, from pin 0
+  for (sint i = 1, n = getNumInputs(); i < n; ++i)
+    if (hasInput(i))
+      return false;
+  auto const* env = effectiveEnv();
+  return env && env->executionPolicy == ExecutionPolicy::Streaming;
+}
+
+Vector<OpContextImpl*> OpContextImpl::streamingPipeline()
+{
+  if (!streamable())
+    return {};
+  Vector<OpContextImpl*> stages = {this};
+  for (auto* cur = this; cur->hasInput(0);) {
+    auto*      up    = cur->inputContexts_[0];
+    sint const uppin = cur->inputPinInfo_[0].pin;
+    // clean upstream is not re-evaluated, read its output as a whole
+    if (!up->streamable() || !up->isDirty())
+      break;
+    // output of a stage goes nowhere else
+    auto const& downstreams = up->node_->downstreams();
+    size_t      numLinks    = 0;
+    for (auto const& pinset : downstreams)
+      numLinks += pinset.size();
+    if (numLinks != 1 || uppin >= downstreams.ssize() || downstreams[uppin].size() != 1)
+      break;
+    stages.push_back(up);
+    cur = up;
+  }
+  if (stages.size() < 2)
+    return {};
+  std::reverse(stages.begin(), stages.end());
+  return stages;
+}
+
+bool OpContextImpl::evaluateStreaming()
+{
+  auto stages = streamingPipeline();
+  if (stages.empty())
+    return false;
+
+  PROFILER_SCOPE("Streaming", 0x5F9EA0);
+  TRACE_SCOPE("stream", nodeName_);
+  OpStageScope stageTime(*this, "stream");
+  auto const*  env       = effectiveEnv();
+  size_t const batchSize = size_t(std::max<sint>(1, env->streamBatchSize));
+  sint const   nstages   = stages.ssize();
+  spdlog::debug("{}: streaming through {} stages, {} rows per batch", nodeName_, nstages, batchSize);
+
+  // other stages are evaluated on my behalf, I've been through beforeEval() already
+  for (sint i = 0; i < nstages - 1; ++i)
+    stages[i]->beforeEval();
+  auto*           head      = stages.front();
+  DataCollection* headInput = head->hasInput(0) ? head->fetchInputData(0) : nullptr;
+
+  // each stage evaluates its batches with its own context
+  Vector<std::unique_ptr<OpContextImpl>> workers;
+  for (sint i = 0; i < nstages; ++i) {
+    auto* worker = new OpContextImpl(*stages[i], env, BatchContextTag{});
+    if (i + 1 < nstages) { // only the pin feeding next stage is wanted
+      std::fill(worker->outputActiveFlag_.begin(), worker->outputActiveFlag_.end(), false);
+      worker->outputActiveFlag_[stages[i + 1]->inputPinInfo_[0].pin] = true;
+    }
+    workers.emplace_back(worker);
+  }
+  // queues[i] feeds stage i
+  Vector<std::unique_ptr<BatchQueue>> queues;
+  for (sint i = 0; i < nstages; ++i)
+    queues.emplace_back(new BatchQueue);
+
+  std::mutex failureMutex;
+  String     failure;
+  auto fail = [&](String message) {
+    {
+      std::lock_guard lock(failureMutex);
+      if (failure.empty())
+        failure = std::move(message);
+    }
+    for (auto& q : queues)
+      q->close();
+  };
+
+  // run one stage until its input is drained (or the source is exhausted),
+  // `emit` forwards outputs and returns false if nobody wants more
+  auto runStage = [&](sint i, std::function<bool(OpContextImpl&)> const& emit) {
+    auto&       worker = *workers[i];
+    BatchQueue* input  = (i > 0 || headInput) ? queues[i].get() : nullptr;
+    try {
+      worker.kernel_->beginStream(worker);
+      for (;;) {
+        bool more = true;
+        std::fill(worker.outputDataCache_.begin(), worker.outputDataCache_.end(), nullptr);
+        if (input) {
+          if (!input->pop(worker.streamInput_))
+            break;
+          worker.kernel_->evalBatch(worker);
+          worker.streamInput_ = nullptr;
+        } else {
+          more = worker.kernel_->evalBatch(worker);
+        }
+        if (worker.shouldBreak_)
+          throw ExecutionError(worker.errorMessage_);
+        if (!emit(worker) || !more)
+          break;
+      }
+      worker.kernel_->endStream(worker);
+    } catch (std::exception const& e) {
+      fail(fmt::format("{}: {}", worker.nodeName_, e.what()));
+    }
+    if (i + 1 < nstages)
+      queues[i + 1]->close();
+  };
+
+  marl::WaitGroup done;
+  auto&           scheduler = TaskContext::instance();
+  if (headInput && maxRowsOf(headInput) <= batchSize) {
+    // fits in one batch, nothing to slice
+    queues[0]->push(headInput->share());
+    queues[0]->close();
+  } else if (headInput) {
+    done.add(1);
+    scheduler.enqueue(marl::Task([&] {
+      PROFILER_SCOPE("Stream Slicing", 0x5F9EA0);
+      try {
+        for (size_t begin = 0;; begin += batchSize) {
+          auto batch = sliceRows(headInput, begin, batchSize);
+          if (!batch || !queues[0]->push(std::move(batch)))
+            break;
+        }
+      } catch (std::exception const& e) {
+        fail(fmt::format("{}: {}", head->nodeName_, e.what()));
+      }
+      queues[0]->close();
+      done.done();
+    }));
+  }
+  for (sint i = 0; i < nstages - 1; ++i) {
+    done.add(1);
+    sint const pin = stages[i + 1]->inputPinInfo_[0].pin;
+    scheduler.enqueue(marl::Task([&, i, pin] {
+      PROFILER_SCOPE("Stream Stage", 0x5F9EA0);
+      TRACE_SCOPE("stream stage", stages[i]->nodeName_);
+      runStage(i, [&, i, pin](OpContextImpl& worker) {
+        auto batch = std::move(worker.outputDataCache_[pin]);
+        return !batch || queues[i + 1]->push(std::move(batch));
+      });
+      done.done();
+    }));
+  }
+  // I'm the last stage, collecting batches of the outputs someone reads
+  Vector<DataCollectionPtr> collected(outputDataCache_.size(), nullptr);
+  runStage(nstages - 1, [&](OpContextImpl& worker) {
+    for (size_t pin = 0; pin < collected.size(); ++pin) {
+      auto batch = std::move(worker.outputDataCache_[pin]);
+      if (!batch || !outputIsActive(sint(pin)))
+        continue;
+      if (!collected[pin])
+        collected[pin] = std::move(batch);
+      else
+        collected[pin]->join(batch.get());
+    }
+    return true;
+  });
+  {
+    EvalSuspendScope suspend;
+    done.wait();
+  }
+  workers.clear();
+
+  if (!failure.empty())
+    throw ExecutionError(failure);
+
+  // intermediate outputs were never kept, they are re-calculated on demand like evicted ones
+  for (sint i = 0; i < nstages - 1; ++i) {
+    auto* stage = stages[i];
+    if (i > 0)
+      stage->inputDataVersionFromLastFetch_[0] = stages[i - 1]->outputVersion(stages[i]->inputPinInfo_[0].pin);
+    for (sint pin = 0, n = stage->outputDataVersion_.ssize(); pin < n; ++pin)
+      stage->updateOutputVersion(pin);
+    stage->evictOutput();
+    stage->afterEval();
+  }
+  inputDataVersionFromLastFetch_[0] = stages[nstages - 2]->outputVersion(inputPinInfo_[0].pin);
+  inputUnusedFlag_[0] = false;
+  for (sint pin = 0, n = collected.ssize(); pin < n; ++pin) {
+    if (collected[pin])
+      setOutputData(pin, std::move(collected[pin]));
+    else if (outputIsActive(pin))
+      reallocOutput(pin);
+  }
+  return true;
+}
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
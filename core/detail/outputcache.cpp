@@ -0,0 +1,166 @@
+#include "outputcache_detail.h"
+#include "opcontext_detail.h"
+
+#include "../datatable.h"
+#include "../opgraph.h"
+#include "../profiler.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+OutputCacheDetail& OutputCacheDetail::instance()
+{
+  // never destroyed: contexts may still unregister themselves during static destruction
+  static OutputCacheDetail* instance_ = new OutputCacheDetail;
+  return *instance_;
+}
+
+void OutputCacheDetail::add(OpContextImpl* ctx)
+{
+  std::lock_guard lock(mutex_);
+  contexts_.insert(ctx);
+}
+
+void OutputCacheDetail::remove(OpContextImpl* ctx)
+{
+  std::lock_guard lock(mutex_);
+  contexts_.erase(ctx);
+}
+
+void OutputCacheDetail::beginFrame()
+{
+  std::lock_guard lock(mutex_);
+  ++frameDepth_;
+}
+
+void OutputCacheDetail::endFrame()
+{
+  std::lock_guard lock(mutex_);
+  ALWAYS_ASSERT(frameDepth_ > 0);
+  if (--frameDepth_ == 0 && needsCollectionLocked()) {
+    try {
+      collectLocked();
+    } catch (std::exception const& e) {
+      spdlog::error("output cache collection failed: {}", e.what());
+    }
+  }
+}
+
+bool OutputCacheDetail::needsCollectionLocked() const
+{
+  // measuring every output is not worth it when nothing would be evicted
+  if (budget_.load() > 0)
+    return true;
+  return std::any_of(contexts_.begin(), contexts_.end(), [](OpContextImpl const* ctx) {
+    return ctx->cachingPolicy() == CachingPolicy::NonCaching;
+  });
+}
+
+size_t OutputCacheDetail::collect()
+{
+  std::lock_guard lock(mutex_);
+  if (frameDepth_ > 0)
+    return 0;
+  return collectLocked();
+}
+
+size_t OutputCacheDetail::collectLocked()
+{
+  PROFILER_SCOPE("OutputCache::collect", 0x7B8D8E);
+  struct Candidate
+  {
+    OpContextImpl* ctx;
+    size_t         bytes;
+    uint64_t       lastAccess;
+    bool           cheap;
+    bool           nonCaching;
+  };
+  Vector<Candidate> candidates;
+  HashSet<void const*> counted; // outputs and their storage can be passed through as-is
+  size_t total = 0;
+  real const threshold = cheapThreshold_.load();
+
+  for (auto* ctx : contexts_) {
+    size_t bytes = 0;
+    for (auto const& dc : ctx->outputDataCache_)
+      if (dc)
+        bytes += dc->countMemory(counted);
+    total += bytes;
+    if (bytes == 0 || ctx->outputPinned())
+      continue;
+    candidates.push_back({ctx,
+                          bytes,
+                          ctx->lastAccess_.load(std::memory_order_relaxed),
+                          ctx->lastEvalSeconds_ <= threshold,
+                          ctx->cachingPolicy() == CachingPolicy::NonCaching});
+  }
+
+  size_t released = 0;
+  for (auto& c : candidates) {
+    if (c.nonCaching) {
+      c.ctx->evictOutput();
+      released += c.bytes;
+      c.bytes = 0;
+    }
+  }
+
+  size_t const budget = budget_.load();
+  if (budget > 0 && total - released > budget) {
+    // cheap ones first, then least recently used
+    std::sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+      return a.cheap != b.cheap ? a.cheap : a.lastAccess < b.lastAccess;
+    });
+    for (auto& c : candidates) {
+      if (total - released <= budget)
+        break;
+      if (c.bytes == 0)
+        continue;
+      spdlog::debug("output cache: evicting {} ({} bytes)", c.ctx->node()->name(), c.bytes);
+      c.ctx->evictOutput();
+      released += c.bytes;
+    }
+    if (total - released > budget)
+      spdlog::warn("output cache: {} bytes in use after eviction, still over budget ({} bytes)", total - released, budget);
+  }
+  usage_.store(total - released);
+  return released;
+}
+
+} // namespace detail
+
+void OutputCache::setBudget(size_t bytes)
+{
+  detail::OutputCacheDetail::instance().setBudget(bytes);
+}
+
+size_t OutputCache::budget()
+{
+  return detail::OutputCacheDetail::instance().budget();
+}
+
+void OutputCache::setCheapThreshold(real seconds)
+{
+  detail::OutputCacheDetail::instance().setCheapThreshold(seconds);
+}
+
+real OutputCache::cheapThreshold()
+{
+  return detail::OutputCacheDetail::instance().cheapThreshold();
+}
+
+size_t OutputCache::usage()
+{
+  return detail::OutputCacheDetail::instance().usage();
+}
+
+size_t OutputCache::collect()
+{
+  return detail::OutputCacheDetail::instance().collect();
+}
+
+END_JOYFLOW_NAMESPACE
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../outputcache.h"
+#include "../def.h"
+#include "../vector.h"
+
+#include <phmap.h>
+
+#include <atomic>
+#include <mutex>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+class OpContextImpl;
+
+class OutputCacheDetail
+{
+  mutable std::mutex                   mutex_;
+  phmap::flat_hash_set<OpContextImpl*> contexts_;
+  sint                                 frameDepth_ = 0; // nested top-level evaluations
+  std::atomic<uint64_t>                clock_ = 0;
+  std::atomic<size_t>                  budget_ = 0;
+  std::atomic<size_t>                  usage_ = 0;
+  std::atomic<real>                    cheapThreshold_ = 0.05;
+
+  bool   needsCollectionLocked() const;
+  size_t collectLocked();
+
+public:
+  static OutputCacheDetail& instance();
+
+  void add(OpContextImpl* ctx);
+  void remove(OpContextImpl* ctx);
+
+  /// logical clock for LRU ordering
+  uint64_t tick() { return clock_.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+  void beginFrame();
+  void endFrame();
+
+  size_t collect();
+
+  void   setBudget(size_t bytes) { budget_.store(bytes); }
+  size_t budget() const { return budget_.load(); }
+  void   setCheapThreshold(real seconds) { cheapThreshold_.store(seconds); }
+  real   cheapThreshold() const { return cheapThreshold_.load(); }
+  size_t usage() const { return usage_.load(); }
+};
+
+/// outputs are only evicted when no evaluation is in flight,
+/// wrap top-level evaluations with this
+class OutputCacheFrameScope
+{
+public:
+  OutputCacheFrameScope() { OutputCacheDetail::instance().beginFrame(); }
+  ~OutputCacheFrameScope() { OutputCacheDetail::instance().endFrame(); }
+};
+
+} // namespace detail
+
+END_JOYFLOW_NAMESPACE
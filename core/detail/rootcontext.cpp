@@ -1,9 +1,15 @@
 #include "../opcontext.h"
+#include "../opdesc.h"
 #include "../datatable.h"
 #include "../profiler.h"
 
 #include "opgraph_detail.h"
+#include "outputcache_detail.h"
 
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <functional>
 #include <mutex>
 
 BEGIN_JOYFLOW_NAMESPACE
@@ -15,7 +21,7 @@ private:
 
   OpGraph*   root_ = nullptr;
   HashMap<NodeId, std::unique_ptr<OpContext>> nodeContexts_;
-  HashMap<StringView, NodeId> nodeIds_;
+  HashMap<String, NodeId> nodeIds_;
   HashMap<NodeId, OpNode*> allNodes_;
   HashSet<OpNode*> visitedNodes_;
   HashSet<NodeId> goals_;
@@ -30,6 +36,8 @@ public:
   void addGoal(StringView oppath) override; // ?
   void eval() override;
   DataCollectionPtr fetch(StringView oppath, sint pin) override;
+  Vector<DataCollectionPtr> evalFrames(StringView oppath, sint first, sint last, sint pin,
+                                       real framesPerSecond) override;
 
 private:
   void lock() { mutex_.lock(); }
@@ -87,7 +95,7 @@ void RootContextImpl::unbind()
 void RootContextImpl::addGoal(StringView oppath)
 {
   std::lock_guard<std::mutex> guard(mutex_);
-  if (auto iditr = nodeIds_.find(oppath); iditr != nodeIds_.end()) {
+  if (auto iditr = nodeIds_.find(String(oppath)); iditr != nodeIds_.end()) {
     goals_.insert(iditr->second);
   }
 }
@@ -103,9 +111,113 @@ void RootContextImpl::eval()
 DataCollectionPtr RootContextImpl::fetch(StringView oppath, sint pin)
 {
   std::lock_guard<std::mutex> guard(mutex_);
-  ALWAYS_ASSERT(goals_.find(nodeIds_[oppath]) != goals_.end());
+  auto const id = nodeIds_[String(oppath)];
+  ALWAYS_ASSERT(goals_.find(id) != goals_.end());
+
+  return nodeContexts_.at(id)->getOutputCache(pin);
+}
+
+Vector<DataCollectionPtr> RootContextImpl::evalFrames(StringView oppath, sint first, sint last, sint pin,
+                                                      real framesPerSecond)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  PROFILER_SCOPE("evalFrames", 0xBD3322);
+  TRACE_SCOPE("evalFrames", oppath);
+  RUNTIME_CHECK(root_, "no graph bound");
+  RUNTIME_CHECK(first <= last, "empty frame range [{}, {}]", first, last);
+  RUNTIME_CHECK(framesPerSecond > 0, "frames per second should be positive, got {}", framesPerSecond);
+  auto iditr = nodeIds_.find(String(oppath));
+  RUNTIME_CHECK(iditr != nodeIds_.end(), "node {} cannot be found", oppath);
+  OpNode* goal = allNodes_.at(iditr->second);
+  RUNTIME_CHECK(!dynamic_cast<OpGraph*>(goal), "{} is a subnet, evaluate one of its nodes instead", oppath);
+  auto* graph = static_cast<OpGraphImpl*>(goal->parent());
+
+  // contexts, arguments and dirtiness are resolved once, for the graph's own frame
+  detail::OutputCacheFrameScope cacheFrame;
+  // contexts are detached on every way out, after the forks are gone
+  DEFER([graph] {
+    try {
+      graph->cleanupEvaluation();
+    } catch (std::exception const& e) {
+      spdlog::error("evalFrames: cleanup failed: {}", e.what());
+    }
+  });
+  if (goal->context())
+    goal->context()->setOutputActive(pin, true);
+  graph->prepareEvaluation(goal->name());
+  auto* context = goal->context();
+  context->setOutputActive(pin, true);
+
+  // arguments of a node are either all shared or all forked, so a node reading `frame`
+  // anywhere is variant
+  Vector<OpNode const*> variants;
+  HashSet<OpContext*>   visited;
+  Vector<OpContext*>    stack = {context};
+  while (!stack.empty()) {
+    auto* top = stack.pop_back();
+    if (!top || !visited.insert(top).second)
+      continue;
+    auto* node = top->node();
+    for (sint argi = 0, argc = sint(node->argCount()); argi < argc; ++argi) {
+      if (node->arg(argi).readsFrameOrTime()) {
+        variants.push_back(node);
+        break;
+      }
+    }
+    for (sint ipin = 0, npins = top->getNumInputs(); ipin < npins; ++ipin)
+      stack.push_back(top->inputContext(ipin));
+  }
 
-  return nodeContexts_.at(nodeIds_[oppath])->getOutputCache(pin);
+  // variants and their downstreams are forked, ops keeping state in their node's own context
+  // (loops, frame to frame) would be evaluated without it; `foreach` keeps it per fork
+  HashMap<OpContext*, bool>       forked;
+  String                          unsafe;
+  std::function<bool(OpContext*)> isForked = [&](OpContext* c) {
+    if (auto itr = forked.find(c); itr != forked.end())
+      return itr->second;
+    forked[c] = false;
+    bool fork = std::find(variants.begin(), variants.end(), c->node()) != variants.end();
+    for (sint ipin = 0, npins = c->getNumInputs(); ipin < npins; ++ipin)
+      if (auto* up = c->inputContext(ipin))
+        fork = isForked(up) || fork;
+    if (fork && !!(c->desc()->flags & OpFlag::FORK_UNSAFE) && unsafe.empty())
+      unsafe = fmt::format("{} ({}) keeps state across evaluations and cannot be evaluated per frame",
+                           c->node()->name(), c->desc()->name);
+    return forked[c] = fork;
+  };
+  isForked(context);
+  if (!unsafe.empty())
+    throw ExecutionError(unsafe);
+
+  OpEnvironment const* env = context->env() ? context->env() : goal->env();
+  sint const           numFrames = last - first + 1;
+  Vector<OpEnvironment> envs(numFrames, env ? *env : OpEnvironment{});
+  Vector<std::unique_ptr<OpContext>> forks(numFrames);
+  // forking expands arguments again from the shared contexts, so none may run before all are made
+  for (sint i = 0; i < numFrames; ++i) {
+    envs[i].frame = first + i;
+    envs[i].time  = real(first + i) / framesPerSecond;
+    forks[i].reset(context->fork(&envs[i], variants));
+  }
+  for (auto& fork : forks)
+    fork->schedule();
+
+  // all forks are waited for before they go away, even if some of them failed
+  Vector<DataCollectionPtr> results(numFrames);
+  String                    failure;
+  for (sint i = 0; i < numFrames; ++i) {
+    try {
+      results[i] = forks[i]->getOrCalculateOutputData(pin);
+      if (!results[i] && failure.empty())
+        failure = fmt::format("frame {}: no output", first + i);
+    } catch (std::exception const& e) {
+      if (failure.empty())
+        failure = fmt::format("frame {}: {}", first + i, e.what());
+    }
+  }
+  if (!failure.empty())
+    throw ExecutionError(failure);
+  return results;
 }
 
 RootContextImpl::NodeId RootContextImpl::getIdFromPath(String const& cwd, String const& nodename) const
@@ -203,6 +315,7 @@ void RootContextImpl::prepare()
 {
   std::lock_guard<std::mutex> guard(mutex_);
   PROFILER_SCOPE("prepareEvaluation", 0xBDDD22);
+  TRACE_SCOPE("prepareEvaluation");
 
 #if 0 // TODO
   // update related nodes' evaluation context(s)
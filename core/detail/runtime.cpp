@@ -1,6 +1,22 @@
 #include "runtime.h"
 #include "opdesc.h"
+#include "evalscope.h"
+#include "../error.h"
+#include "../scheduler.h"
+#include "../stats.h"
+
+#include <marl/thread.h>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 BEGIN_JOYFLOW_NAMESPACE
 
@@ -16,10 +32,246 @@ uint64_t Runtime::allocNodeID()
   return ++counter;
 }
 
+// Scheduler {{{
+static std::mutex        s_schedulerMutex;
+static std::atomic<bool> s_schedulerRunning = false;
+
+static thread_local TaskPriority t_priority = TaskPriority::INTERACTIVE;
+
+static SchedulerConfig configFromEnvironment()
+{
+  SchedulerConfig config;
+  if (auto const* threads = std::getenv("JOYFLOW_WORKER_THREADS"))
+    config.workerThreads = std::max(0, std::atoi(threads));
+  if (auto const* cpus = std::getenv("JOYFLOW_CPU_AFFINITY")) {
+    try {
+      config.affinity = Scheduler::parseCpuList(cpus);
+    } catch (std::exception const& e) {
+      spdlog::warn("JOYFLOW_CPU_AFFINITY ignored: {}", e.what());
+    }
+  }
+  if (auto const* inlineUs = std::getenv("JOYFLOW_INLINE_US"))
+    config.inlineSeconds = std::max(0.0, std::atof(inlineUs) * 1e-6);
+  return config;
+}
+
+static SchedulerConfig& schedulerConfig()
+{
+  static SchedulerConfig config = configFromEnvironment();
+  return config;
+}
+
+static void applyAffinity(marl::Scheduler::Config& cfg, Vector<sint> const& cpus)
+{
+#if defined(_WIN32) || defined(__linux__)
+  marl::containers::vector<marl::Thread::Core, 32> cores(marl::Allocator::Default);
+  for (sint cpu : cpus) {
+    marl::Thread::Core core;
+#ifdef _WIN32
+    core.windows.group = uint8_t(cpu / 64);
+    core.windows.index = uint8_t(cpu % 64);
+#else
+    core.pthread.index = uint16_t(cpu);
+#endif
+    cores.push_back(core);
+  }
+  cfg.setWorkerThreadAffinityPolicy(
+    marl::Thread::Affinity::Policy::anyOf(marl::Thread::Affinity(cores, marl::Allocator::Default)));
+#else
+  spdlog::warn("cpu affinity is not supported on this platform, ignored");
+#endif
+}
+
 TaskContext& TaskContext::instance()
 {
-  static std::unique_ptr<TaskContext> instance_{ new TaskContext(marl::Scheduler::Config::allCores()) };
+  static std::unique_ptr<TaskContext> instance_{ [] {
+    std::lock_guard lock(s_schedulerMutex);
+    auto const& config = schedulerConfig();
+    auto        cfg    = marl::Scheduler::Config::allCores();
+    if (!config.affinity.empty()) {
+      applyAffinity(cfg, config.affinity);
+      cfg.setWorkerThreadCount(int(config.affinity.size()));
+    }
+    if (config.workerThreads > 0)
+      cfg.setWorkerThreadCount(int(config.workerThreads));
+    spdlog::info("scheduler: {} worker threads{}", cfg.workerThread.count,
+                 config.affinity.empty() ? "" : fmt::format(" on {} cpus", config.affinity.size()));
+    auto* context = new TaskContext(cfg);
+    // a task pays for enqueue, a worker picking it up and signalling back:
+    // running anything cheaper inline is faster
+    context->inlineSeconds_ = config.inlineSeconds > 0
+                                ? config.inlineSeconds
+                                : std::clamp(context->measureRoundTrip() * 2, 2e-6, 1e-3);
+    spdlog::info("scheduler: running work under {:.1f} us inline", context->inlineSeconds_ * 1e6);
+    s_schedulerRunning = true;
+    return context;
+  }() };
   return *instance_;
 }
 
+real TaskContext::measureRoundTrip()
+{
+  real best = std::numeric_limits<real>::max();
+  for (int i = 0; i < 8; ++i) {
+    marl::Event done;
+    auto const  start = std::chrono::steady_clock::now();
+    scheduler.enqueue(marl::Task([done] { done.signal(); }));
+    done.wait();
+    best = std::min(best, std::chrono::duration<real>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+void TaskContext::enqueue(marl::Task&& task, TaskPriority priority)
+{
+  {
+    std::lock_guard lock(pendingMutex_);
+    pending_[size_t(priority)].push_back({std::move(task), priority});
+  }
+  scheduler.enqueue(marl::Task([this] {
+    PendingTask next;
+    {
+      std::lock_guard lock(pendingMutex_);
+      for (auto& queue : pending_) {
+        if (!queue.empty()) {
+          next = std::move(queue.front());
+          queue.pop_front();
+          break;
+        }
+      }
+    }
+    // one slot per pending task, can't come out empty
+    SchedulerPriorityScope priority(next.priority);
+    next.task();
+  }));
+}
+
+void TaskContext::parallelFor(size_t count, CostHistory& unitCost, real units, std::function<void(size_t)> const& job)
+{
+  auto const timedJob = [&unitCost, units, &job](size_t i) {
+    auto const start = std::chrono::steady_clock::now();
+    job(i);
+    if (units > 0)
+      unitCost.add(std::chrono::duration<real>(std::chrono::steady_clock::now() - start).count() / units);
+  };
+  real const perUnit = unitCost.expected();
+  if (count < 2 || !worthScheduling(perUnit < 0 ? -1 : perUnit * units)) {
+    for (size_t i = 0; i < count; ++i)
+      timedJob(i);
+    return;
+  }
+
+  auto*                           copySink = Stats::threadCopySink();
+  std::vector<std::exception_ptr> errors(count);
+  marl::WaitGroup                 done(unsigned(count - 1));
+  for (size_t i = 1; i < count; ++i) {
+    enqueue(marl::Task([&, i] {
+      CopySinkScope sink(copySink);
+      try {
+        timedJob(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      done.done();
+    }));
+  }
+  // my share
+  try {
+    timedJob(0);
+  } catch (...) {
+    errors[0] = std::current_exception();
+  }
+  {
+    detail::EvalSuspendScope suspend;
+    done.wait();
+  }
+  for (auto const& error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+size_t TaskContext::pendingTasks(TaskPriority priority)
+{
+  std::lock_guard lock(pendingMutex_);
+  return pending_[size_t(priority)].size();
+}
+
+bool Scheduler::configure(SchedulerConfig const& config)
+{
+  std::lock_guard lock(s_schedulerMutex);
+  if (s_schedulerRunning)
+    return false;
+  schedulerConfig() = config;
+  return true;
+}
+
+SchedulerConfig Scheduler::config()
+{
+  std::lock_guard lock(s_schedulerMutex);
+  return schedulerConfig();
+}
+
+bool Scheduler::running()
+{
+  return s_schedulerRunning;
+}
+
+Vector<sint> Scheduler::parseCpuList(String const& list)
+{
+  Vector<sint> cpus;
+  size_t       begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == String::npos)
+      end = list.size();
+    auto const part = list.substr(begin, end - begin);
+    auto const dash = part.find('-');
+    char*      tail = nullptr;
+    long const first = std::strtol(part.c_str(), &tail, 10);
+    long       last  = first;
+    RUNTIME_CHECK(tail != part.c_str() && first >= 0, "bad cpu list \"{}\"", list);
+    if (dash != String::npos) {
+      char const* second = part.c_str() + dash + 1;
+      last = std::strtol(second, &tail, 10);
+      RUNTIME_CHECK(tail != second && last >= first, "bad cpu list \"{}\"", list);
+    }
+    RUNTIME_CHECK(*tail == '\0', "bad cpu list \"{}\"", list);
+    for (long cpu = first; cpu <= last; ++cpu)
+      if (std::find(cpus.begin(), cpus.end(), sint(cpu)) == cpus.end())
+        cpus.push_back(sint(cpu));
+    begin = end + 1;
+  }
+  return cpus;
+}
+
+TaskPriority Scheduler::threadPriority()
+{
+  return t_priority;
+}
+
+TaskPriority Scheduler::setThreadPriority(TaskPriority priority)
+{
+  return std::exchange(t_priority, priority);
+}
+
+size_t Scheduler::pendingTasks(TaskPriority priority)
+{
+  return running() ? TaskContext::instance().pendingTasks(priority) : 0;
+}
+// Scheduler }}}
+
+// Cost Model {{{
+CostModel& CostModel::instance()
+{
+  static CostModel model;
+  return model;
+}
+
+CostHistory& CostModel::history(String const& key)
+{
+  std::lock_guard lock(mutex_);
+  return histories_[key];
+}
+// Cost Model }}}
+
 END_JOYFLOW_NAMESPACE
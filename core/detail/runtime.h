@@ -1,6 +1,7 @@
 #pragma once
 
 #include "opgraph.h"
+#include "../scheduler.h"
 
 #include <phmap.h>
 
@@ -10,6 +11,9 @@
 #include <marl/waitgroup.h>
 
 #include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
 
 BEGIN_JOYFLOW_NAMESPACE
 
@@ -20,15 +24,82 @@ public:
   static uint64_t allocNodeID();
 };
 
+/// Exponentially weighted moving average of a cost in seconds
+///
+/// Updated without locking, concurrent updates may lose a sample, which is fine for an estimate.
+class CostHistory
+{
+  std::atomic<real> seconds_{-1.0}; // < 0: nothing measured yet
+
+public:
+  static constexpr real WEIGHT = 0.25; //< of the latest sample
+
+  void add(real seconds)
+  {
+    real const prev = seconds_.load(std::memory_order_relaxed);
+    seconds_.store(prev < 0 ? seconds : prev + (seconds - prev) * WEIGHT, std::memory_order_relaxed);
+  }
+  /// -1 if nothing measured yet
+  real expected() const { return seconds_.load(std::memory_order_relaxed); }
+};
+
+/// Cost histories shared by everything of the same kind, e.g. per op type
+class CostModel
+{
+  std::mutex                                mutex_;
+  phmap::node_hash_map<String, CostHistory> histories_;
+
+public:
+  static CostModel& instance();
+
+  /// the returned history lives as long as the program
+  CostHistory& history(String const& key);
+};
+
 class TaskContext
 {
   TaskContext(const marl::Scheduler::Config& cfg): scheduler(cfg) { scheduler.bind(); }
+
+  struct PendingTask
+  {
+    marl::Task   task;
+    TaskPriority priority = TaskPriority::INTERACTIVE;
+  };
+  std::mutex              pendingMutex_;
+  std::deque<PendingTask> pending_[size_t(TaskPriority::COUNT)];
+  real                    inlineSeconds_ = 0;
+
+  /// time from enqueue to the task running and signalling back, best of a few
+  real measureRoundTrip();
+
 public:
   ~TaskContext() {
     scheduler.unbind();
   }
   marl::Scheduler scheduler;
 
+  /// two-level queue in front of `scheduler.enqueue`:
+  /// each enqueue hands marl a slot, a worker taking the slot runs the
+  /// most urgent task pending at that time, so background tasks only run when
+  /// no interactive one is waiting
+  void   enqueue(marl::Task&& task, TaskPriority priority);
+  void   enqueue(marl::Task&& task) { enqueue(std::move(task), Scheduler::threadPriority()); }
+  size_t pendingTasks(TaskPriority priority);
+
+  /// work expected to be cheaper than this should run inline, scheduling would cost more
+  real   inlineSeconds() const { return inlineSeconds_; }
+  /// decide by expected cost in seconds, negative means unknown
+  bool   worthScheduling(real expectedSeconds) const
+  {
+    return expectedSeconds < 0 || expectedSeconds >= inlineSeconds_;
+  }
+
+  /// run `job(0)` ... `job(count-1)`, as parallel tasks if one job of `units` (e.g. rows) is
+  /// expected to be worth scheduling by `unitCost`, which learns from the jobs run;
+  /// waits for all of them and rethrows the first exception.
+  /// copy-on-write done by the jobs is accounted to the calling thread's sink
+  void   parallelFor(size_t count, CostHistory& unitCost, real units, std::function<void(size_t)> const& job);
+
   static TaskContext& instance();
 };
 
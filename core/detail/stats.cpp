@@ -1,40 +1,111 @@
 #include "stats.h"
 #include "error.h"
+#include "vector.h"
+#include <atomic>
 #include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
 #include <phmap.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
 
 BEGIN_JOYFLOW_NAMESPACE
 
 namespace detail {
 
-struct ObjectAllocationInfo
+struct TypeIndexHash // for vs2017 capacity
 {
-  String      objectName;
-  void const* address = nullptr;
-  size_t      size    = 0;
-  // clock_t      birthTime;
-  // clock_t      deadTime;
+  size_t operator()(std::type_index const& ti) const { return ti.hash_code(); }
 };
 
-struct TypeIndexHash // for vs2017 capacity
+/// max number of distinct tracked classes
+static constexpr size_t STATS_MAX_TYPES = 256;
+
+/// counters of one thread, only the owning thread writes
+/// objects may die on another thread than they were born, so living counts of a
+/// single shard can go negative, only the sum makes sense
+struct StatsShard
 {
-  size_t operator()(std::type_index const& ti) const { return ti.hash_code(); }
+  std::atomic<int64_t> allocs[STATS_MAX_TYPES] = {};
+  std::atomic<int64_t> living[STATS_MAX_TYPES] = {};
 };
 
 class StatsDetail
 {
-  static StatsDetail*       instance_;
-  mutable std::shared_mutex mutex_;
+  static StatsDetail* instance_;
+
+  // type -> slot, written once per class
+  mutable std::shared_mutex slotMutex_;
+  using slotmap_t = phmap::flat_hash_map<std::type_index, size_t, TypeIndexHash>;
+  slotmap_t               slots_;
+  Vector<std::type_index> slotTypes_;
+
+  // shards live until exit, threads may end before their objects do
+  mutable std::mutex                  shardMutex_;
+  Vector<std::unique_ptr<StatsShard>> shards_;
+
+  // opt-in address tracking
+  std::atomic<bool>         trackAddresses_ = false;
+  mutable std::shared_mutex addressMutex_;
+  using clsobjlist_t = phmap::flat_hash_map<size_t, phmap::node_hash_set<void const*>>;
+  clsobjlist_t              livingObjects_;
+
   mutable std::shared_mutex inspectorMutex_;
-  using allallocmap_t = phmap::flat_hash_map<std::type_index, size_t, TypeIndexHash>;
-  using clsobjcount_t = phmap::flat_hash_map<std::type_index, size_t, TypeIndexHash>;
-  using clsobjlist_t  = phmap::flat_hash_map<std::type_index, phmap::node_hash_set<void const*>, TypeIndexHash>;
   using inspectormap_t = phmap::flat_hash_map<std::type_index, ObjectInspector, TypeIndexHash>;
+  inspectormap_t            inspectors_;
 
-  allallocmap_t  allocCounts_;
-  clsobjcount_t  clsLivingCounts_;
-  clsobjlist_t   clsLivingObjects_;
-  inspectormap_t inspectors_;
+  StatsShard& threadShard()
+  {
+    thread_local StatsShard* tlsShard = nullptr;
+    if (!tlsShard) {
+      std::lock_guard<std::mutex> guard(shardMutex_);
+      shards_.emplace_back(new StatsShard);
+      tlsShard = shards_.back().get();
+    }
+    return *tlsShard;
+  }
+
+  template<class F>
+  int64_t sum(F&& field) const
+  {
+    std::lock_guard<std::mutex> guard(shardMutex_);
+    int64_t total = 0;
+    for (auto const& shard : shards_)
+      total += field(*shard).load(std::memory_order_relaxed);
+    return total;
+  }
+
+  size_t numSlots() const
+  {
+    std::shared_lock<std::shared_mutex> guard(slotMutex_);
+    return slotTypes_.size();
+  }
+
+  std::type_index slotType(size_t slot) const
+  {
+    std::shared_lock<std::shared_mutex> guard(slotMutex_);
+    return slotTypes_[slot];
+  }
+
+  sint findSlot(std::type_index typeIndex) const
+  {
+    std::shared_lock<std::shared_mutex> guard(slotMutex_);
+    auto itr = slots_.find(typeIndex);
+    return itr == slots_.end() ? -1 : sint(itr->second);
+  }
+
+  /// shards are decremented without looking at the others, so underflow is caught here:
+  /// more deaths than births mean some object was destroyed twice or never counted
+  int64_t living(size_t slot) const
+  {
+    auto const count = sum([slot](StatsShard const& s) -> auto const& { return s.living[slot]; });
+    if (count < 0) {
+      spdlog::error("stats: living count of class \"{}\" underflowed to {}", slotType(slot).name(), count);
+      return 0;
+    }
+    return count;
+  }
 
 public:
   static StatsDetail& instance()
@@ -45,92 +116,88 @@ public:
     return *instance_;
   }
 
-  void add(std::type_index typeIndex, void const* address, size_t size)
+  size_t typeSlot(std::type_index typeIndex)
   {
-    std::unique_lock<std::shared_mutex> guard(mutex_);
-    ++allocCounts_[typeIndex];
-    ++clsLivingCounts_[typeIndex];
-    clsLivingObjects_[typeIndex].insert(address);
+    if (auto slot = findSlot(typeIndex); slot >= 0)
+      return slot;
+    std::unique_lock<std::shared_mutex> guard(slotMutex_);
+    if (auto itr = slots_.find(typeIndex); itr != slots_.end())
+      return itr->second;
+    ALWAYS_ASSERT(slotTypes_.size() < STATS_MAX_TYPES);
+    slotTypes_.push_back(typeIndex);
+    return slots_[typeIndex] = slotTypes_.size() - 1;
   }
 
-  void remove(std::type_index typeIndex, void const* address)
+  void add(size_t slot, void const* address)
   {
-    std::unique_lock<std::shared_mutex> guard(mutex_);
-    ALWAYS_ASSERT(--clsLivingCounts_[typeIndex]!=-1);
-    clsLivingObjects_[typeIndex].erase(address);
+    auto& shard = threadShard();
+    shard.allocs[slot].fetch_add(1, std::memory_order_relaxed);
+    shard.living[slot].fetch_add(1, std::memory_order_relaxed);
+    if (trackAddresses_.load(std::memory_order_relaxed)) {
+      std::unique_lock<std::shared_mutex> guard(addressMutex_);
+      livingObjects_[slot].insert(address);
+    }
   }
 
-  void dumpLiving(FILE* file)
+  void remove(size_t slot, void const* address)
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
-    bool anything_printed = false;
-    for (auto const& cls: clsLivingCounts_) {
-      if (cls.second != 0) {
-        fprintf(file, "class \"%s\": %zd objects living\n", cls.first.name(), cls.second);
-        bool hasInspector = false;
-        ObjectInspector inspector = {};
-        {
-          std::shared_lock<std::shared_mutex> inspectorlock(inspectorMutex_);
-          auto itr = inspectors_.find(cls.first);
-          if (itr!=inspectors_.end()) {
-            inspector = itr->second;
-            hasInspector = true;
-          }
-        }
-        if (hasInspector) {
-          for (auto const* ptr: clsLivingObjects_[cls.first]) {
-            std::string fmtstring = "";
-            if (inspector.name)
-              fmtstring += "\"" + inspector.name(ptr) + "\": ";
-            if (inspector.sizeInBytes)
-              fmtstring += std::to_string(inspector.sizeInBytes(ptr)) + "bytes";
-            if (inspector.sizeInBytesShared && inspector.sizeInBytesUnshared) {
-              fmtstring += "  (" + std::to_string(inspector.sizeInBytesShared(ptr)) + "b shared, "
-                          + std::to_string(inspector.sizeInBytesUnshared(ptr)) + "b unshared)";
-            }
-            fprintf(file, "    %p: %s\n", ptr, fmtstring.c_str());
-          }
-        }
-        anything_printed = true;
-      }
+    threadShard().living[slot].fetch_sub(1, std::memory_order_relaxed);
+    if (trackAddresses_.load(std::memory_order_relaxed)) {
+      std::unique_lock<std::shared_mutex> guard(addressMutex_);
+      if (auto itr = livingObjects_.find(slot); itr != livingObjects_.end())
+        itr->second.erase(address);
     }
-    if (!anything_printed)
-      fprintf(file, "everything clean.\n");
   }
 
+  void setTrackAddresses(bool track)
+  {
+    std::unique_lock<std::shared_mutex> guard(addressMutex_);
+    trackAddresses_ = track;
+    if (!track)
+      livingObjects_.clear();
+  }
+  bool trackAddresses() const { return trackAddresses_.load(); }
+
   void dumpLiving(void(*dumpf)(char const* msg, void* arg), void* arg)
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
     bool anything_printed = false;
-    for (auto const& cls: clsLivingCounts_) {
-      if (cls.second != 0) {
-        dumpf(fmt::format("class \"{}\": {} objects living\n", cls.first.name(), cls.second).c_str(), arg);
-        bool hasInspector = false;
-        ObjectInspector inspector = {};
-        {
-          std::shared_lock<std::shared_mutex> inspectorlock(inspectorMutex_);
-          auto itr = inspectors_.find(cls.first);
-          if (itr!=inspectors_.end()) {
-            inspector = itr->second;
-            hasInspector = true;
-          }
+    for (size_t slot = 0, n = numSlots(); slot < n; ++slot) {
+      auto const count = living(slot);
+      if (count == 0)
+        continue;
+      auto const type = slotType(slot);
+      dumpf(fmt::format("class \"{}\": {} objects living", type.name(), count).c_str(), arg);
+      anything_printed = true;
+      if (!trackAddresses_.load())
+        continue;
+      bool hasInspector = false;
+      ObjectInspector inspector = {};
+      {
+        std::shared_lock<std::shared_mutex> inspectorlock(inspectorMutex_);
+        auto itr = inspectors_.find(type);
+        if (itr!=inspectors_.end()) {
+          inspector = itr->second;
+          hasInspector = true;
         }
-        if (hasInspector) {
-          for (auto const* ptr: clsLivingObjects_[cls.first]) {
-            std::string fmtstring = "";
-            if (inspector.name)
-              fmtstring += "\"" + inspector.name(ptr) + "\": ";
-            if (inspector.sizeInBytes)
-              fmtstring += std::to_string(inspector.sizeInBytes(ptr)) + "bytes";
-            if (inspector.sizeInBytesShared && inspector.sizeInBytesUnshared) {
-              fmtstring += "  (" + std::to_string(inspector.sizeInBytesShared(ptr)) + "b shared, "
-                          + std::to_string(inspector.sizeInBytesUnshared(ptr)) + "b unshared)";
-            }
-            fmtstring = fmt::format("    {}: {}", ptr, fmtstring);
-            dumpf(fmtstring.c_str(), arg);
+      }
+      if (hasInspector) {
+        std::shared_lock<std::shared_mutex> guard(addressMutex_);
+        auto itr = livingObjects_.find(slot);
+        if (itr == livingObjects_.end())
+          continue;
+        for (auto const* ptr: itr->second) {
+          std::string fmtstring = "";
+          if (inspector.name)
+            fmtstring += "\"" + inspector.name(ptr) + "\": ";
+          if (inspector.sizeInBytes)
+            fmtstring += std::to_string(inspector.sizeInBytes(ptr)) + "bytes";
+          if (inspector.sizeInBytesShared && inspector.sizeInBytesUnshared) {
+            fmtstring += "  (" + std::to_string(inspector.sizeInBytesShared(ptr)) + "b shared, "
+                        + std::to_string(inspector.sizeInBytesUnshared(ptr)) + "b unshared)";
           }
+          fmtstring = fmt::format("    {}: {}", ptr, fmtstring);
+          dumpf(fmtstring.c_str(), arg);
         }
-        anything_printed = true;
       }
     }
     if (!anything_printed)
@@ -139,40 +206,34 @@ public:
 
   size_t totalAllocCount() const
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
-    size_t sum = 0;
-    for (auto const& cls : allocCounts_) {
-      sum += cls.second;
-    }
-    return sum;
+    int64_t total = 0;
+    for (size_t slot = 0, n = numSlots(); slot < n; ++slot)
+      total += sum([slot](StatsShard const& s) -> auto const& { return s.allocs[slot]; });
+    return size_t(total);
   }
 
   size_t totalAllocCount(std::type_index typeIndex) const
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
-    if (auto itr = allocCounts_.find(typeIndex); itr != allocCounts_.end())
-      return itr->second;
-    else
+    auto const slot = findSlot(typeIndex);
+    if (slot < 0)
       return 0;
+    return size_t(sum([slot](StatsShard const& s) -> auto const& { return s.allocs[slot]; }));
   }
 
   size_t livingCount() const
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
-    size_t sum = 0;
-    for (auto const& cls : clsLivingCounts_) {
-      sum += cls.second;
-    }
-    return sum;
+    int64_t total = 0;
+    for (size_t slot = 0, n = numSlots(); slot < n; ++slot)
+      total += living(slot);
+    return size_t(total);
   }
 
   size_t livingCount(std::type_index typeIndex) const
   {
-    std::shared_lock<std::shared_mutex> guard(mutex_);
-    if (auto itr = clsLivingCounts_.find(typeIndex); itr != clsLivingCounts_.end())
-      return itr->second;
-    else
+    auto const slot = findSlot(typeIndex);
+    if (slot < 0)
       return 0;
+    return size_t(living(slot));
   }
 
   void setInspector(std::type_index typeIndex, ObjectInspector const& inspector)
@@ -184,23 +245,54 @@ public:
 
 StatsDetail* StatsDetail::instance_ = nullptr;
 
+static std::atomic<size_t>               s_totalCopiedBytes   = 0;
+static std::atomic<size_t>               s_copyWarnThreshold  = size_t(256) << 20;
+static thread_local std::atomic<size_t>* s_threadCopySink     = nullptr;
+
 } // namespace detail
 
+size_t Stats::typeSlot(std::type_index typeIndex)
+{
+  return detail::StatsDetail::instance().typeSlot(typeIndex);
+}
+
+void Stats::add(size_t slot, void const* address)
+{
+  detail::StatsDetail::instance().add(slot, address);
+}
+
+void Stats::remove(size_t slot, void const* address)
+{
+  detail::StatsDetail::instance().remove(slot, address);
+}
+
 void Stats::add(std::type_index typeIndex,
                 void const*     address,
                 size_t          size)
 {
-  detail::StatsDetail::instance().add(typeIndex, address, size);
+  add(typeSlot(typeIndex), address);
 }
 
 void Stats::remove(std::type_index typeIndex, void const* address)
 {
-  detail::StatsDetail::instance().remove(typeIndex, address);
+  remove(typeSlot(typeIndex), address);
+}
+
+void Stats::setTrackAddresses(bool track)
+{
+  detail::StatsDetail::instance().setTrackAddresses(track);
+}
+
+bool Stats::trackAddresses()
+{
+  return detail::StatsDetail::instance().trackAddresses();
 }
 
 void Stats::dumpLiving(FILE* file)
 {
-  detail::StatsDetail::instance().dumpLiving(file);
+  detail::StatsDetail::instance().dumpLiving([](char const* msg, void* arg) {
+    fprintf(static_cast<FILE*>(arg), "%s\n", msg);
+  }, file);
 }
 
 void Stats::dumpLiving(void(*dumpf)(char const* msg, void* arg), void* arg)
@@ -233,4 +325,36 @@ void Stats::setInspector(std::type_index typeIndex, ObjectInspector const& inspe
   detail::StatsDetail::instance().setInspector(typeIndex, inspector);
 }
 
+void Stats::addCopiedBytes(size_t bytes)
+{
+  detail::s_totalCopiedBytes.fetch_add(bytes, std::memory_order_relaxed);
+  if (auto* sink = detail::s_threadCopySink)
+    sink->fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t Stats::totalCopiedBytes()
+{
+  return detail::s_totalCopiedBytes.load(std::memory_order_relaxed);
+}
+
+std::atomic<size_t>* Stats::setThreadCopySink(std::atomic<size_t>* sink)
+{
+  return std::exchange(detail::s_threadCopySink, sink);
+}
+
+std::atomic<size_t>* Stats::threadCopySink()
+{
+  return detail::s_threadCopySink;
+}
+
+void Stats::setCopyWarningThreshold(size_t bytes)
+{
+  detail::s_copyWarnThreshold.store(bytes);
+}
+
+size_t Stats::copyWarningThreshold()
+{
+  return detail::s_copyWarnThreshold.load(std::memory_order_relaxed);
+}
+
 END_JOYFLOW_NAMESPACE
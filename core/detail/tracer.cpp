@@ -0,0 +1,196 @@
+#include "../tracer.h"
+#include "../vector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+namespace detail {
+
+/// events kept per thread, older ones get overwritten
+static constexpr size_t TRACE_RING_SIZE = 1 << 14;
+static constexpr size_t TRACE_DETAIL_LENGTH = 47;
+
+struct TraceEvent
+{
+  char const* name;
+  uint64_t    start;    // ns since tracer epoch
+  uint64_t    duration; // ns
+  char        detail[TRACE_DETAIL_LENGTH + 1];
+};
+
+/// single producer (the owning thread), read by dump()
+struct TraceThreadBuffer
+{
+  sint                  tid;
+  Vector<TraceEvent>    events;
+  std::atomic<uint64_t> written = 0;
+  std::atomic<uint64_t> clearedAt = 0;
+
+  TraceThreadBuffer(sint id) : tid(id), events(TRACE_RING_SIZE) {}
+
+  void push(char const* name, uint64_t start, uint64_t end, String const& detail)
+  {
+    uint64_t const n  = written.load(std::memory_order_relaxed);
+    auto&          ev = events[n % TRACE_RING_SIZE];
+    ev.name           = name;
+    ev.start          = start;
+    ev.duration       = end - start;
+    size_t const len  = std::min(detail.size(), TRACE_DETAIL_LENGTH);
+    memcpy(ev.detail, detail.data(), len);
+    ev.detail[len] = 0;
+    written.store(n + 1, std::memory_order_release);
+  }
+};
+
+class TracerDetail
+{
+  std::mutex                                 mutex_;
+  Vector<std::unique_ptr<TraceThreadBuffer>> buffers_;
+  std::chrono::steady_clock::time_point      epoch_ = std::chrono::steady_clock::now();
+
+public:
+  std::atomic<bool> enabled = false;
+
+  static TracerDetail& instance()
+  {
+    static TracerDetail s_instance;
+    return s_instance;
+  }
+
+  uint64_t now() const
+  {
+    // never 0, which marks a scope not being recorded
+    return 1 + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+  }
+
+  /// buffer of calling thread, buffers outlive their threads so nothing gets lost at exit
+  TraceThreadBuffer* threadBuffer()
+  {
+    thread_local TraceThreadBuffer* tlsBuffer = nullptr;
+    if (!tlsBuffer) {
+      std::lock_guard lock(mutex_);
+      buffers_.emplace_back(new TraceThreadBuffer(buffers_.ssize()));
+      tlsBuffer = buffers_.back().get();
+    }
+    return tlsBuffer;
+  }
+
+  template<class F>
+  void forEachBuffer(F&& f)
+  {
+    std::lock_guard lock(mutex_);
+    for (auto& buf : buffers_)
+      f(*buf);
+  }
+};
+
+static void writeJsonString(std::ostream& os, char const* str, size_t maxlen)
+{
+  os << '"';
+  for (size_t i = 0; i < maxlen && str[i]; ++i) {
+    char const c = str[i];
+    switch (c) {
+    case '"': os << "\\\""; break;
+    case '\\': os << "\\\\"; break;
+    case '\n': os << "\\n"; break;
+    case '\t': os << "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        os << buf;
+      } else {
+        os << c;
+      }
+    }
+  }
+  os << '"';
+}
+
+} // namespace detail
+
+using detail::TracerDetail;
+
+void Tracer::setEnabled(bool enabled) { TracerDetail::instance().enabled.store(enabled); }
+bool Tracer::enabled() { return TracerDetail::instance().enabled.load(std::memory_order_relaxed); }
+
+void Tracer::clear()
+{
+  TracerDetail::instance().forEachBuffer([](detail::TraceThreadBuffer& buf) {
+    buf.clearedAt.store(buf.written.load(std::memory_order_acquire));
+  });
+}
+
+size_t Tracer::numEvents()
+{
+  size_t count = 0;
+  TracerDetail::instance().forEachBuffer([&count](detail::TraceThreadBuffer& buf) {
+    uint64_t const end = buf.written.load(std::memory_order_acquire);
+    count += end - std::max(buf.clearedAt.load(), end > detail::TRACE_RING_SIZE ? end - detail::TRACE_RING_SIZE : 0);
+  });
+  return count;
+}
+
+void Tracer::dump(std::ostream& os)
+{
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  TracerDetail::instance().forEachBuffer([&](detail::TraceThreadBuffer& buf) {
+    os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf.tid
+       << ",\"args\":{\"name\":\"thread " << buf.tid << "\"}}";
+    first = false;
+    uint64_t const end   = buf.written.load(std::memory_order_acquire);
+    uint64_t const begin = std::max(buf.clearedAt.load(), end > detail::TRACE_RING_SIZE ? end - detail::TRACE_RING_SIZE : 0);
+    for (uint64_t i = begin; i < end; ++i) {
+      auto const& ev = buf.events[i % detail::TRACE_RING_SIZE];
+      os << ",\n{\"name\":";
+      detail::writeJsonString(os, ev.name, size_t(-1));
+      os << ",\"cat\":\"joyflow\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf.tid
+         << ",\"ts\":" << ev.start / 1000 << '.' << ev.start / 100 % 10
+         << ",\"dur\":" << ev.duration / 1000 << '.' << ev.duration / 100 % 10;
+      if (ev.detail[0]) {
+        os << ",\"args\":{\"detail\":";
+        detail::writeJsonString(os, ev.detail, detail::TRACE_DETAIL_LENGTH);
+        os << '}';
+      }
+      os << '}';
+    }
+  });
+  os << "\n]}\n";
+}
+
+bool Tracer::dump(String const& path)
+{
+  std::ofstream os(path);
+  if (!os)
+    return false;
+  dump(os);
+  return bool(os);
+}
+
+TraceScope::TraceScope(char const* name, StringView const& text) : name_(name)
+{
+  auto& tracer = TracerDetail::instance();
+  if (!tracer.enabled.load(std::memory_order_relaxed))
+    return;
+  detail_ = String(text.substr(0, detail::TRACE_DETAIL_LENGTH));
+  start_  = tracer.now();
+}
+
+TraceScope::~TraceScope()
+{
+  if (start_ == 0)
+    return;
+  auto& tracer = TracerDetail::instance();
+  tracer.threadBuffer()->push(name_, start_, tracer.now(), detail_);
+}
+
+END_JOYFLOW_NAMESPACE
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "def.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+/// Persistent on-disk cache of node outputs, disabled by default
+///
+/// Outputs of ops flagged with `OpFlag::DISK_CACHEABLE` are written to the
+/// cache directory, keyed by a hash of the op type, evaluated arguments and
+/// upstream keys. Files referenced by FILEPATH_OPEN / DIRPATH arguments
+/// contribute their size and modification time to the key.
+///
+/// On a hit the node loads its outputs from disk instead of evaluating,
+/// upstream nodes are not evaluated at all.
+/// A node whose upstream has no key (not cacheable) has no key either.
+class CORE_API DiskCache
+{
+public:
+  /// set cache directory, it will be created if missing
+  /// empty path disables the cache
+  static void   setDirectory(String const& path);
+  static String directory();
+  static bool   enabled();
+
+  /// number of outputs loaded from / missed in the cache since start
+  static size_t hits();
+  static size_t misses();
+
+  /// remove all cached files, returns number of files removed
+  static size_t clear();
+};
+
+END_JOYFLOW_NAMESPACE
@@ -138,6 +138,7 @@ public:
 };
 
 class OpContext;
+struct OpEnvironment;
 /// attachment on arguments
 /// mainly for UI control
 class ArgAttachment
@@ -146,6 +147,29 @@ public:
   virtual ~ArgAttachment() {}
 };
 
+/// What backtick expressions of one argument element read when last expanded,
+/// the expansion holds as long as none of it changed
+struct ArgExprDeps
+{
+  struct ArgRead
+  {
+    String node; //< sibling node, empty for the argument's own node
+    String arg;
+    sint   version = 0;
+  };
+
+  String          expr;     //< raw expression expanded
+  String          expanded;
+  String          error;
+  bool            valid      = false;
+  bool            isVolatile = false; //< marked by `volatile(...)` or reading `random`, expanded every time
+  bool            readsFrame = false;
+  bool            readsTime  = false;
+  sint            frame      = 0;
+  real            time       = 0;
+  Vector<ArgRead> args;
+};
+
 // TODO: each type of argument should have its own implementation
 class ArgValue
 {
@@ -165,6 +189,7 @@ private:
   std::array<sint, MAX_ARG_TUPLE_SIZE> evaluatedIntValues_;
   String                               errorMessage_ = "";
   sint                                 updateScriptEvaluatedVersion_ = -1;
+  Vector<ArgExprDeps>                  exprDeps_; //< per element, only once it had backticks
 
 public:
   ArgDesc const& desc() const
@@ -317,8 +342,34 @@ public:
 
   sint version() const { return evaluatedVersion_; }
 
+  /// whether expressions read `frame` or `time` when last expanded,
+  /// directly or through arguments they read
+  bool readsFrameOrTime() const { return readsFrame() || readsTime(); }
+  bool readsFrame() const
+  {
+    for (auto const& deps : exprDeps_)
+      if (deps.readsFrame)
+        return true;
+    return false;
+  }
+  bool readsTime() const
+  {
+    for (auto const& deps : exprDeps_)
+      if (deps.readsTime)
+        return true;
+    return false;
+  }
+
   /// evaluation of expressions in arguments, automatically called by runtime
-  CORE_API void eval(OpContext* context);
+  ///
+  /// backtick expressions can read `frame`, `time` and other arguments with
+  /// `arg('name' [, elem])` or `arg('node.name' [, elem])` for a sibling node,
+  /// which is evaluated before being read;
+  /// they are expanded again only when something they read last time changed,
+  /// or every time if wrapped in `volatile(...)`; reading `random` (same as `math.random`),
+  /// `math.random` or `math.randomseed` makes them volatile as well;
+  /// `frame` and `time` are taken from `env` if given, from the context's environment otherwise
+  CORE_API void eval(OpContext* context, OpEnvironment const* env = nullptr);
 
 public:
   inline ArgValue(ArgDesc const* desc, OpContext* context);
@@ -359,6 +410,7 @@ inline ArgValue::ArgValue(ArgValue const& av)
     , evaluatedStringValues_(av.evaluatedStringValues_)
     , errorMessage_(av.errorMessage_)
     , updateScriptEvaluatedVersion_(av.updateScriptEvaluatedVersion_)
+    , exprDeps_(av.exprDeps_)
 {
   if (ownDesc_)
     *ownDesc_ = *av.ownDesc_;
@@ -377,6 +429,7 @@ inline ArgValue& ArgValue::operator=(ArgValue const& rhs)
   evaluatedStringValues_ = rhs.evaluatedStringValues_;
   errorMessage_          = rhs.errorMessage_;
   updateScriptEvaluatedVersion_ = rhs.updateScriptEvaluatedVersion_;
+  exprDeps_              = rhs.exprDeps_;
   if (ownDesc_)
     *ownDesc_ = *rhs.ownDesc_;
   return *this;
@@ -3,6 +3,10 @@
 #include "def.h"
 #include "opkernel.h"
 #include "stringview.h"
+#include "tracer.h"
+#include "vector.h"
+
+#include <chrono>
 
 BEGIN_JOYFLOW_NAMESPACE
 
@@ -10,12 +14,15 @@ enum class ExecutionPolicy
 {
   Sequential,
   Parallel,
+  Streaming, //< chains of streamable ops exchange row batches instead of whole collections
 };
 
 enum class CachingPolicy
 {
-  Caching,
-  NonCaching
+  Caching,  //< cached, downstreams modifying it work on a copy
+  NonCaching,
+  Retained, //< cached, and never handed over by `moveInputToOutput`
+  HandOver, //< cached, but handed over to a sole downstream modifying it (@see moveInputToOutput)
 };
 
 /// Global States
@@ -27,6 +34,22 @@ struct OpEnvironment
   sint            frame = 0;
   ExecutionPolicy executionPolicy = ExecutionPolicy::Parallel;
   CachingPolicy   cachingPolicy = CachingPolicy::Caching;
+  sint            streamBatchSize = 4096; //< rows per batch in streaming mode
+
+  /// ops evaluating their upstreams with environments of their own (e.g. `foreach`) pass data
+  /// on to them here, chained up to the environment they were evaluated with
+  OpNode const*        scopeOwner   = nullptr; //< node that made this environment ..
+  void const*          scopePayload = nullptr; //< .. what it passes on, only the owner's op knows ..
+  OpEnvironment const* scopeParent  = nullptr; //< .. and the owner's own environment
+
+  /// payload of the innermost scope made by `owner`, nullptr if there is none
+  void const* scopePayloadOf(OpNode const* owner) const
+  {
+    for (auto const* env = this; env; env = env->scopeParent)
+      if (env->scopeOwner == owner)
+        return env->scopePayload;
+    return nullptr;
+  }
 };
 
 enum class OpErrorLevel : uint8_t
@@ -37,6 +60,29 @@ enum class OpErrorLevel : uint8_t
   FATAL
 };
 
+/// Time spent in one named stage of an evaluation
+struct OpStageTiming
+{
+  String name;
+  real   seconds = 0.0;
+};
+
+/// Measurements of one evaluation, @see OpContext::metrics()
+struct OpEvalMetrics
+{
+  sint   evalIndex      = 0;     //< `evalCount()` of this evaluation
+  real   wallSeconds    = 0.0;
+  real   cpuSeconds     = 0.0;   //< cpu time of the evaluating thread
+  real   queueSeconds   = 0.0;   //< from `schedule()` to task start, 0 if evaluated inline
+  size_t rowsIn         = 0;     //< rows of all fetched inputs
+  size_t rowsOut        = 0;     //< rows of all outputs
+  size_t bytesAllocated = 0;     //< estimated memory produced by this evaluation: bytes of its outputs
+                                 //  not shared with anything else at the end, including data handed over
+  size_t bytesCopied    = 0;     //< bytes copied by copy-on-write (`makeUnique`) while evaluating
+  bool   diskCacheHit   = false; //< outputs were loaded from disk cache
+  bool   refill         = false; //< outputs had been evicted from memory and were re-calculated
+};
+
 /// State block hold by OpContext
 /// allocated by OpKernel when needed
 /// while OpKernel itself should be stateless
@@ -106,6 +152,10 @@ public:
   /// create a new context (along with all args and dependencies) with environment overriding
   virtual OpContext* fork(OpEnvironment const* env) = 0;
 
+  /// like `fork(env)`, but only upstreams of nodes in `variants`, or depending on one, are copied;
+  /// the others are shared with this context, so they are evaluated once for all forks
+  virtual OpContext* fork(OpEnvironment const* env, Vector<OpNode const*> const& variants) = 0;
+
   /// retrives kernel handle
   virtual OpKernelHandle getKernel() const = 0;
 
@@ -135,6 +185,13 @@ public:
   /// would be copyed to output `pinout`
   virtual DataCollection* copyInputToOutput(sint pinout, sint pinin = 0) = 0;
 
+  /// like `copyInputToOutput`, but input `pinin` is consumed: if upstream is `NonCaching` or
+  /// `HandOver`, no other downstream is going to read it and nothing else holds it, upstream
+  /// data is handed over instead of being shared, so it's modified in place without copies.
+  /// Read everything needed from the input before calling this - `fetchInputData(pinin)` fails
+  /// for the rest of the evaluation, and pointers fetched before may point to the output
+  virtual DataCollection* moveInputToOutput(sint pinout, sint pinin = 0) = 0;
+
   /// get last evaluation result
   virtual DataCollection* getOutputCache(sint pin) const = 0;
 
@@ -157,8 +214,33 @@ public:
   virtual OpErrorLevel lastError() const = 0;
   virtual String       errorMessage() const = 0;
 
+  /// progress reporting:
+  /// `fraction` in [0, 1], `message` is optional and will be truncated if too long
+  /// it's cheap to call this from hot loops, updates are throttled internally
+  virtual void   reportProgress(real fraction, StringView const& message = "") = 0;
+  /// last reported progress, safe to poll from any thread
+  virtual real   progress() const = 0;
+  virtual String progressMessage() const = 0;
+
+  /// stage timing, accumulated by name, reset before each evaluation
+  virtual void   addStageTime(StringView const& stage, real seconds) = 0;
+  virtual Vector<OpStageTiming> stageTimings() const = 0;
+
+  /// metrics of the last few evaluations, oldest first, safe to call from any thread
+  /// cpu time and copied bytes are measured on the evaluating thread, so they include
+  /// tasks run by that thread while waiting for inputs
+  virtual Vector<OpEvalMetrics> metrics() const = 0;
+  /// number of output requests served by / missing the in-memory output cache
+  virtual size_t cacheHits() const = 0;
+  virtual size_t cacheMisses() const = 0;
+  /// bytes copied by copy-on-write during evaluations vs. bytes they produced, over all evaluations
+  /// much greater than 1 means whole columns are copied to change a few cells
+  virtual real   copyAmplification() const = 0;
+
   // these are internal operations, call them only when you know exactly what you are doing
 public:
+  /// context evaluating input `pin`, nullptr if not connected
+  virtual OpContext* inputContext(sint pin) const = 0;
   virtual void markInputDirty(sint pin, bool dirty = true) = 0;
   virtual void markDirty(bool dirty = true) = 0;
   virtual void setOutputActive(sint pin, bool active) = 0;
@@ -171,21 +253,58 @@ public:
   virtual void afterFrameEval() = 0;
 };
 
+/// Measures the enclosing scope as one stage of current evaluation
+/// usage:
+///   {
+///     OpStageScope stage(ctx, "parse");
+///     ...
+///   }
+class OpStageScope
+{
+  OpContext& ctx_;
+  String     name_;
+  std::chrono::steady_clock::time_point start_;
+  TraceScope trace_;
+
+public:
+  OpStageScope(OpContext& ctx, StringView const& name)
+    : ctx_(ctx), name_(name), start_(std::chrono::steady_clock::now()), trace_("stage", name)
+  {
+  }
+  ~OpStageScope()
+  {
+    std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - start_;
+    ctx_.addStageTime(name_, elapsed.count());
+  }
+};
+
 // Global execution context
 // TODO: refactor OpNode, OpNode should not hold OpContext and OpGraph should not do execution
 //       all exection should start here
 class RootContext
 {
 public:
+  virtual ~RootContext() {}
   virtual void              bind(OpGraph* root) = 0;
   virtual void              unbind() = 0;
   virtual void              addGoal(StringView oppath) = 0; // add goals so that eval() will calculate them
   virtual void              eval() = 0;
   virtual DataCollectionPtr fetch(StringView oppath, sint pin=0) = 0;
 
+  /// output `pin` of `oppath` at each frame in [first, last], at `time` = frame / framesPerSecond
+  ///
+  /// frames are evaluated concurrently, each by a fork of the nodes that have arguments reading
+  /// `frame` or `time`, and of their downstreams; other nodes are evaluated once and shared by all
+  /// frames. Expressions reading `frame` through `arg()` of another node count as reading it, and
+  /// see the value of that argument for their own frame. Ops flagged `OpFlag::FORK_UNSAFE`
+  /// (loops, `iterate`) that would have to be forked raise an error instead
+  virtual Vector<DataCollectionPtr> evalFrames(StringView oppath, sint first, sint last, sint pin=0,
+                                               real framesPerSecond=24) = 0;
+
   void eval(StringView oppath) { addGoal(oppath); eval(); }
 };
 
 OpContext* newOpContext(OpNode* node);
+CORE_API RootContext* newRootContext();
 
 END_JOYFLOW_NAMESPACE
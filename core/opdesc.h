@@ -20,6 +20,9 @@ enum class OpFlag : uint32_t
   LOOP_PIN0  = 1 << 3,  //< pin0 can link to the loop
   LOOP_PIN1  = 1 << 4,  //< pin1 can link to the loop
   LOOP_PIN2  = 1 << 5,  //< pin2 can link to the loop
+  DISK_CACHEABLE = 1 << 6, //< output depends only on args and inputs, can be cached on disk (@see DiskCache)
+  STREAMABLE = 1 << 7,  //< rows can be processed batch by batch (@see OpKernel::evalBatch)
+  FORK_UNSAFE = 1 << 8, //< keeps state in its node's own context, a fork would miss it (@see RootContext::evalFrames)
 
   LOOPPIN_BITSHIFT = 3, // helper for loop pin checking
   LOOPPIN_MAXCOUNT = 3, // helper for loop pin checking
@@ -37,6 +40,7 @@ struct OpDesc
   Vector<ArgDesc> argDescs         = {};    //< arguments in order
   String          icon             = "\xEF\x82\x85";    //< FontAwesome icon /*ICON_FA_COGS*/
   OpFlag          flags            = OpFlag::REGULAR;
+  uint64_t        libVersion       = 0;     //< version of the lib providing this op, 0 if built in
 
   OpKernel* (*createKernel)()      = nullptr; //< instanciation method
   void (*destroyKernel)(OpKernel*) = nullptr; //< clean-up method
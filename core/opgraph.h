@@ -56,6 +56,8 @@ public:
   virtual bool        isBypassed() const = 0;
   virtual void        setBypassed(bool bypass) = 0;
 
+  /// environment in effect: overridden one, the one set from outside, or the one of
+  /// the graph this node belongs to - so overriding a graph's environment reaches its children
   virtual void                 setEnv(OpEnvironment const* env) = 0;
   virtual void                 overrideEnv(OpEnvironment env)   = 0;
   virtual OpEnvironment const* env() const                      = 0;
@@ -130,6 +132,11 @@ public:
 
 CORE_API OpGraph* newGraph(String const& name, OpGraph* parent=nullptr);
 CORE_API void     deleteGraph(OpGraph* graph);
+
+/// human readable table of evaluation metrics of all nodes (subnets included),
+/// aggregated over their recorded history, most expensive first
+/// @see OpContext::metrics()
+CORE_API String   metricsReport(OpGraph const* graph);
 // OpGraphAPI }}}
 
 // OpGraph Preset Registry {{{
@@ -13,6 +13,10 @@ BEGIN_JOYFLOW_NAMESPACE
 
 namespace op {
 
+/// hot loops should report progress once every (PROGRESS_REPORT_MASK+1) iterations,
+/// `OpContext::reportProgress` throttles further by time
+static constexpr sint PROGRESS_REPORT_MASK = 1023;
+
 // Common update scripts {{{
 inline ArgDescBuilder tableSelectionArg(String const& argname = "table", String const& label = "Table", bool canSelectAll = true) {
   return ArgDescBuilder(argname).label(label).type(ArgType::MENU).defaultExpression(0, "0")
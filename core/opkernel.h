@@ -17,6 +17,16 @@ public:
   virtual void eval(OpContext& context) const = 0;
   virtual void afterEval(OpContext& context) const {}
   virtual void afterFrameEval(OpNode* self) {}
+
+  /// streaming, for ops flagged with `OpFlag::STREAMABLE` (@see ExecutionPolicy::Streaming)
+  ///
+  /// the context's input 0 holds one batch of rows, outputs go to the context's outputs as usual;
+  /// ops without inputs (sources) are called repeatedly until they return false;
+  /// outputs of the last op are joined into its whole output where it's active, so batches
+  /// should give what `eval` would give for their rows
+  virtual void beginStream(OpContext& context) const {}
+  virtual bool evalBatch(OpContext& context) const { eval(context); return false; }
+  virtual void endStream(OpContext& context) const {}
 };
 
 /// kernel handle adds one level of indirection - making the kernel itself can be reloaded
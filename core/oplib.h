@@ -84,12 +84,18 @@ struct OpLibVersionInfo
   info.buildType = BUILDTYPE_UNKNOWN;
 #endif
 
+/// bump it (define before including this header) whenever ops of the lib change their results,
+/// outputs cached on disk by older versions are not used then
+#ifndef OPLIB_VERSION
+#define OPLIB_VERSION 0x000001
+#endif
+
 #define IMPL_VERSION_INFO()      \
 OpLibVersionInfo versionInfo()   \
 {                                \
   OpLibVersionInfo info;         \
   info.coreVersion = DF_CORE_VERSION; \
-  info.libVersion = 0x000001;    \
+  info.libVersion = OPLIB_VERSION; \
   WRITE_COMPILER_INFO            \
   WRITE_BUILD_TYPE               \
   return info;                   \
@@ -117,6 +123,10 @@ RIGISTER_STATIC_OPLIB()
 BEGIN_JOYFLOW_NAMESPACE
 CORE_API bool   openOpLib(String const& dllpath);
 CORE_API bool   closeOpLib(String const& dllpath);
+/// symbol exported by a library loaded with `openOpLib`, nullptr if not found
+CORE_API void*  opLibSymbol(String const& dllpath, char const* name);
+/// `libVersion` of the library being opened by `openOpLib`, 0 otherwise
+CORE_API uint64_t openingOpLibVersion();
 CORE_API String defaultOpDir();
 END_JOYFLOW_NAMESPACE
 
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "def.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+/// Global budget of output data held by node contexts
+///
+/// After each top-level evaluation, if cached outputs take more memory than
+/// the budget, least recently used outputs are dropped - cheap-to-recompute
+/// ones first - and recalculated on demand.
+/// Outputs feeding dirty downstream nodes are never dropped.
+/// Nodes with `CachingPolicy::NonCaching` drop their outputs after every evaluation.
+///
+/// Memory is measured with `DataCollection::countMemory(counted)`: storage shared
+/// between outputs is counted once, for the first output holding it.
+/// Without a budget and NonCaching nodes, nothing is measured after evaluations.
+class CORE_API OutputCache
+{
+public:
+  /// budget in bytes, 0 means unlimited (the default)
+  static void   setBudget(size_t bytes);
+  static size_t budget();
+
+  /// outputs took less than this time to compute are considered cheap, in seconds
+  static void   setCheapThreshold(real seconds);
+  static real   cheapThreshold();
+
+  /// memory held by cached outputs, as of last collection
+  static size_t usage();
+
+  /// evict outputs until under budget, returns number of bytes released
+  /// no-op if some evaluation is still going on
+  static size_t collect();
+};
+
+END_JOYFLOW_NAMESPACE
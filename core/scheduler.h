@@ -0,0 +1,66 @@
+#pragma once
+
+#include "def.h"
+#include "vector.h"
+
+BEGIN_JOYFLOW_NAMESPACE
+
+/// Tasks waiting for a worker are taken interactive first
+enum class TaskPriority : uint8_t
+{
+  INTERACTIVE,
+  BACKGROUND,
+
+  COUNT
+};
+
+struct SchedulerConfig
+{
+  sint         workerThreads = 0; //< 0: one worker per logical core, or per cpu in `affinity`
+  Vector<sint> affinity;          //< cpus worker threads may run on, empty: any
+  /// work expected to take less than this is run inline instead of as a task,
+  /// 0: measured from scheduling round trips when the scheduler starts
+  real         inlineSeconds = 0;
+};
+
+/// Configuration of the task scheduler graph evaluation runs on
+///
+/// The scheduler starts with the first evaluation, configure it before that.
+/// Initial config comes from environment:
+///   JOYFLOW_WORKER_THREADS=<n>
+///   JOYFLOW_CPU_AFFINITY=<cpus>  e.g. "0-3,8"
+///   JOYFLOW_INLINE_US=<microseconds>
+class CORE_API Scheduler
+{
+public:
+  /// returns false if the scheduler is already running, config is left unchanged then
+  static bool            configure(SchedulerConfig const& config);
+  static SchedulerConfig config();
+  /// whether the scheduler has been started
+  static bool            running();
+
+  /// "0-3,8" -> {0,1,2,3,8}, throws CheckFailure on malformed list
+  static Vector<sint> parseCpuList(String const& list);
+
+  /// priority of tasks scheduled from calling thread, tasks pass it on to what they schedule
+  static TaskPriority threadPriority();
+  /// returns previous priority
+  static TaskPriority setThreadPriority(TaskPriority priority);
+  /// tasks waiting for a worker, per priority
+  static size_t       pendingTasks(TaskPriority priority);
+};
+
+/// evaluations started from calling thread during the scope are scheduled with `priority`
+class SchedulerPriorityScope
+{
+  TaskPriority prev_;
+
+public:
+  SchedulerPriorityScope(TaskPriority priority) : prev_(Scheduler::setThreadPriority(priority)) {}
+  ~SchedulerPriorityScope() { Scheduler::setThreadPriority(prev_); }
+
+  SchedulerPriorityScope(SchedulerPriorityScope const&) = delete;
+  SchedulerPriorityScope& operator=(SchedulerPriorityScope const&) = delete;
+};
+
+END_JOYFLOW_NAMESPACE
@@ -2,6 +2,7 @@
 
 #include "def.h"
 #include "stringview.h"
+#include <atomic>
 #include <cstdio>
 #include <type_traits>
 #include <typeindex>
@@ -17,13 +18,29 @@ struct ObjectInspector
   size_t (*sizeInBytesUnshared)(void const* obj) = 0;
 };
 
+/// Object bookkeeping
+///
+/// Counters are sharded per thread and merged on read, so tracking objects
+/// takes no locks. Addresses of living objects (shown with their inspectors
+/// by `dumpLiving`) are only recorded when `setTrackAddresses(true)`, which
+/// does take a global lock.
 class CORE_API Stats
 {
 public:
+  /// small integer id of a tracked class, stable during the process
+  static size_t typeSlot(std::type_index typeIndex);
+  static void   add(size_t slot, void const* address);
+  static void   remove(size_t slot, void const* address);
   static void   add(std::type_index typeIndex,
                     void const*     address,
                     size_t          size);
   static void   remove(std::type_index typeIndex, void const* address);
+
+  /// debug: record addresses of living objects, off by default
+  /// objects born before this is switched on are counted but not listed
+  static void   setTrackAddresses(bool track);
+  static bool   trackAddresses();
+
   static void   dumpLiving(FILE* file);
   static void   dumpLiving(void(*dumpf)(char const* msg, void* arg), void* arg=nullptr);
   static size_t totalAllocCount();
@@ -36,6 +53,18 @@ public:
   static size_t livingCount() { return livingCount(std::type_index(typeid(typename std::remove_cv<T>::type))); }
 
   static void setInspector(std::type_index typeIndex, ObjectInspector const& inspector);
+
+  /// bytes copied by copy-on-write (`makeUnique` of columns and tables)
+  static void   addCopiedBytes(size_t bytes);
+  static size_t totalCopiedBytes();
+  /// copied bytes on calling thread also go to `sink`, until it gets replaced
+  /// returns previous sink, restore it when done
+  static std::atomic<size_t>* setThreadCopySink(std::atomic<size_t>* sink);
+  static std::atomic<size_t>* threadCopySink();
+
+  /// an evaluation copying more than this is reported, 0 disables the warning
+  static void   setCopyWarningThreshold(size_t bytes);
+  static size_t copyWarningThreshold();
   template <class T>
   static void setInspector(ObjectInspector const& inspector)
   {
@@ -43,22 +72,39 @@ public:
   }
 };
 
+/// accounts copy-on-write on calling thread to `sink` during the scope
+/// code that may yield to other tasks (fiber switch) should clear the sink while waiting
+class CopySinkScope
+{
+  std::atomic<size_t>* prev_;
+
+public:
+  CopySinkScope(std::atomic<size_t>* sink) : prev_(Stats::setThreadCopySink(sink)) {}
+  ~CopySinkScope() { Stats::setThreadCopySink(prev_); }
+};
+
 template<class T>
 class ObjectTracker
 {
+  static size_t slot()
+  {
+    static size_t const s_slot = Stats::typeSlot(typeid(typename std::remove_cv<T>::type));
+    return s_slot;
+  }
+
 public:
   ObjectTracker()
   {
-    Stats::add(typeid(typename std::remove_cv<T>::type), static_cast<T*>(this), sizeof(T));
+    Stats::add(slot(), static_cast<T*>(this));
   }
   ObjectTracker(ObjectTracker const& oc)
   {
-    Stats::add(typeid(typename std::remove_cv<T>::type), static_cast<T*>(this), sizeof(T));
+    Stats::add(slot(), static_cast<T*>(this));
   }
   ObjectTracker(ObjectTracker&& oc)
   { }
 
-  ~ObjectTracker() { Stats::remove(typeid(typename std::remove_cv<T>::type), static_cast<T const*>(this)); }
+  ~ObjectTracker() { Stats::remove(slot(), static_cast<T const*>(this)); }
 };
 
 END_JOYFLOW_NAMESPACE
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "def.h"
+#include "stringview.h"
+
+#include <iosfwd>
+
+BEGIN_JOYFLOW_NAMESPACE
+
+/// Built-in evaluation timeline, available in every build, disabled by default
+///
+/// Unlike `PROFILER_SCOPE`, which needs a profiler linked in, trace scopes are
+/// recorded into per-thread ring buffers (the oldest events get overwritten)
+/// and can be dumped as Chrome trace JSON, to be opened in Perfetto or
+/// chrome://tracing.
+/// Recording is lock-free; dumping while evaluating is safe, but events being
+/// written at that moment may be missing.
+class CORE_API Tracer
+{
+public:
+  static void setEnabled(bool enabled);
+  static bool enabled();
+
+  /// drop all recorded events
+  static void   clear();
+  /// number of events currently held in the ring buffers
+  static size_t numEvents();
+
+  /// write recorded events as Chrome trace JSON
+  static void dump(std::ostream& os);
+  static bool dump(String const& path);
+};
+
+/// Records the enclosing scope as one trace event, if the tracer is enabled
+/// `name` must outlive the tracer (string literals), `detail` is copied
+class CORE_API TraceScope
+{
+  char const* name_;
+  uint64_t    start_ = 0; // 0: not recording
+  String      detail_;
+
+public:
+  TraceScope(char const* name, StringView const& detail = {});
+  ~TraceScope();
+
+  TraceScope(TraceScope const&) = delete;
+  TraceScope& operator=(TraceScope const&) = delete;
+};
+
+#define TRACE_SCOPE(...) ::joyflow::TraceScope CONCATENATE(traceScope_, __LINE__)(__VA_ARGS__)
+
+END_JOYFLOW_NAMESPACE
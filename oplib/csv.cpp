@@ -1,5 +1,8 @@
 #include <oplib.h>
 #include <csv.hpp>
+
+#include <algorithm>
+#include <filesystem>
 #ifdef ERROR
 #undef ERROR
 #endif
@@ -22,14 +25,63 @@ public:
       odt->createColumn<String>(col);
     }
     // auto c = odt->addRows(nrows);
+    // the reader does not expose its file position, approximate progress by bytes consumed
+    std::error_code ec;
+    real const filesize = real(std::filesystem::file_size(filename, ec));
+    real bytesread = 0;
+    OpStageScope stage(ctx, "read");
     for (auto const& row : csvrdr) {
       auto c = odt->addRow();
       for (auto const& col : cols) {
         auto sv = row[col].get<csv::string_view>();
         odt->set<StringView>(col, c, StringView(sv.data(), sv.size()));
+        bytesread += sv.size() + 1;
+      }
+      if ((c.value() & op::PROGRESS_REPORT_MASK) == 0 && !ec && filesize > 0)
+        ctx.reportProgress(std::min(bytesread / filesize, 0.99), fmt::format("{} rows read", c.value()));
+    }
+  }
+
+  // streaming {{{
+  struct ReaderState : public OpStateBlock
+  {
+    csv::CSVReader      reader;
+    std::vector<String> cols;
+    csv::CSVRow         next;    //< read ahead, so that no empty batch follows the last full one
+    bool                hasNext = false;
+    ReaderState(String const& filename) : reader(filename), cols(reader.get_col_names())
+    {
+      hasNext = reader.read_row(next);
+    }
+  };
+
+  void beginStream(OpContext& ctx) const override
+  {
+    ctx.setState(new ReaderState(ctx.arg("file").asString()));
+  }
+
+  bool evalBatch(OpContext& ctx) const override
+  {
+    auto*      state     = static_cast<ReaderState*>(ctx.getState());
+    sint const batchSize = std::max<sint>(1, ctx.env()->streamBatchSize);
+    auto odc = ctx.reallocOutput(0);
+    odc->addTable();
+    auto odt = odc->getTable(0);
+    for (auto const& col : state->cols)
+      odt->createColumn<String>(col);
+    for (sint n = 0; n < batchSize && state->hasNext; ++n) {
+      auto c = odt->addRow();
+      for (auto const& col : state->cols) {
+        auto sv = state->next[col].get<csv::string_view>();
+        odt->set<StringView>(col, c, StringView(sv.data(), sv.size()));
       }
+      state->hasNext = state->reader.read_row(state->next);
     }
+    return state->hasNext;
   }
+
+  void endStream(OpContext& ctx) const override { ctx.setState(nullptr); }
+  // }}}
 };
 
 OpDesc csvReaderDesc()
@@ -39,6 +91,7 @@ OpDesc csvReaderDesc()
     .numMaxInput(1)
     .numRequiredInput(0)
     .numOutputs(1)
+    .flags(OpFlag::DISK_CACHEABLE | OpFlag::STREAMABLE)
     .argDescs({ArgDescBuilder("file")
                    .label("CSV File")
                    .type(ArgType::FILEPATH_OPEN)
@@ -48,6 +101,24 @@ OpDesc csvReaderDesc()
 
 class OpCSVWriter : public OpKernel
 {
+  static void writeRows(csv::CSVWriter<std::ofstream>& csvwtr, DataTable const* dt, Vector<String> const& colnames)
+  {
+    sint const numcols = colnames.ssize();
+    std::vector<String> strrow(numcols);
+    std::vector<DataColumn const*> columns(numcols);
+    for (sint c = 0; c < numcols; ++c) {
+      columns[c] = dt->getColumn(colnames[c]);
+      RUNTIME_CHECK(columns[c], "column \"{}\" does not exist", colnames[c]);
+    }
+    for (sint row = 0, numrows = dt->numRows(); row < numrows; ++row) {
+      auto ci = dt->getIndex(row);
+      for (sint c = 0; c<numcols; ++c) {
+        strrow[c] = columns[c]->toString(ci);
+      }
+      csvwtr << strrow;
+    }
+  }
+
 public:
   void eval(OpContext& ctx) const override
   {
@@ -62,22 +133,48 @@ public:
     RUNTIME_CHECK(dt, "table {} does not exist", tid);
 
     auto colnames = dt->columnNames();
-    sint const numcols = colnames.ssize();
     csvwtr << colnames;
-    std::vector<String> strrow(numcols);
-    std::vector<DataColumn*> columns(numcols);
-    for (sint c = 0; c < numcols; ++c) {
-      columns[c] = dt->getColumn(colnames[c]);
-      DEBUG_ASSERT(columns[c] != nullptr);
-    }
-    for (sint row = 0, numrows = dt->numRows(); row < numrows; ++row) {
-      auto ci = dt->getIndex(row);
-      for (sint c = 0; c<numcols; ++c) {
-        strrow[c] = columns[c]->toString(ci);
-      }
-      csvwtr << strrow;
+    writeRows(csvwtr, dt, colnames);
+  }
+
+  // streaming {{{
+  struct WriterState : public OpStateBlock
+  {
+    std::ofstream                  outstream;
+    csv::CSVWriter<std::ofstream>  csvwtr;
+    Vector<String>                 colnames;
+    bool                           headerWritten = false;
+    WriterState(String const& filename) : outstream(filename), csvwtr(outstream) {}
+  };
+
+  void beginStream(OpContext& ctx) const override
+  {
+    auto filename = ctx.arg("file").asString();
+    auto* state = new WriterState(filename);
+    ctx.setState(state);
+    RUNTIME_CHECK(state->outstream, "cannot write to {}", filename);
+  }
+
+  bool evalBatch(OpContext& ctx) const override
+  {
+    auto* state = static_cast<WriterState*>(ctx.getState());
+    auto tid = ctx.arg("table").asInt();
+    // passed on as eval() does; only joined up at the end if somebody reads my output
+    auto* odc = ctx.copyInputToOutput(0, 0);
+    auto* dt = odc->getTable(tid);
+    RUNTIME_CHECK(dt, "table {} does not exist", tid);
+    // columns of the first batch decide the header
+    if (!state->headerWritten) {
+      state->colnames = dt->columnNames();
+      state->csvwtr << state->colnames;
+      state->headerWritten = true;
     }
+    writeRows(state->csvwtr, dt, state->colnames);
+    return false;
   }
+
+  void endStream(OpContext& ctx) const override { ctx.setState(nullptr); }
+  // }}}
 };
 
 OpDesc csvWriterDesc()
@@ -87,6 +184,7 @@ OpDesc csvWriterDesc()
     .numMaxInput(1)
     .numRequiredInput(1)
     .numOutputs(1)
+    .flags(OpFlag::STREAMABLE)
     .argDescs({
       op::tableSelectionArg("table", "Table", false),
       ArgDescBuilder("file")
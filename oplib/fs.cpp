@@ -1,6 +1,7 @@
 #include <oplib.h>
 #include <ophelper.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <chrono>
 
@@ -46,6 +47,12 @@ public:
       auto nameifc = namecolumn->asBlobData();
       for (auto entry : diriterator) {
         auto ci = odt->addRow();
+        // total count is unknown before hand: the fraction creeps towards 1 without reaching it,
+        // progress is only shown strictly between 0 and 1
+        if ((ci.value() & op::PROGRESS_REPORT_MASK) == 0) {
+          real const listed = real(ci.value() + 1);
+          ctx.reportProgress(std::min(listed / (listed + 4096), 0.99), fmt::format("{} entries listed", ci.value()));
+        }
         auto u8path = entry.path().u8string();
         nameifc->setBlob(ci, u8path.data(), u8path.size());
         if (stats) {
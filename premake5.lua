@@ -111,6 +111,8 @@ project('joyflow')
   if not _OPTIONS['static'] then
     defines({'JFCORE_EXPORT'})
   end
+  -- headers `cpp` script ops are compiled against
+  defines({'JOYFLOW_SOURCE_DIR="' .. _MAIN_SCRIPT_DIR .. '"'})
   links({'xxHash', 'mimalloc', 'lua', 'fmt', 'spdlog', 'marl'})
   filter({'action:vs*', 'files:core/luabinding.cpp'})
     buildoptions({'/bigobj'})
@@ -315,6 +317,62 @@ project('tests')
       links('optick')
     end
 
+project('bench')
+  kind('ConsoleApp')
+  cppdialect('C++17')
+  debugdir('.')
+  includedirs({
+    'deps/lua',
+    'deps/sol2/single/include',
+    'deps/hedley',
+  })
+  files({'bench/**'})
+  links({
+      'joyflow',
+      'mimalloc',
+      'lua',
+      'fmt',
+      'spdlog'
+  })
+  filter({'system:not windows'})
+    links({'pthread', 'dl'})
+  filter('sanitize')
+    linkoptions({'-fsanitize=address'})
+  filter('profile')
+    if _OPTIONS['profiler']=='tracy' then
+      links('tracy')
+    else
+      links('optick')
+    end
+
+project('joyflow-run')
+  kind('ConsoleApp')
+  cppdialect('C++17')
+  debugdir('.')
+  files({'cli/**'})
+  links({
+      'joyflow',
+      'mimalloc',
+      'lua',
+      'fmt',
+      'spdlog'
+  })
+  if _OPTIONS['static'] then
+    links({'oplib'})
+  end
+  filter({'system:not windows'})
+    links({'pthread', 'dl'})
+  filter({'system:windows'})
+    links({'psapi'})
+  filter('sanitize')
+    linkoptions({'-fsanitize=address'})
+  filter('profile')
+    if _OPTIONS['profiler']=='tracy' then
+      links('tracy')
+    else
+      links('optick')
+    end
+
 project('xxHash')
   kind('StaticLib')
   files({'deps/xxHash/xxhash.c', 'deps/xxHash/xxhash.h'})
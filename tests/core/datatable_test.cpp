@@ -10,6 +10,7 @@
 
 #include <cstdio>
 #include <cstring>
+#include <thread>
 
 namespace joyflow {
   doctest::String toString(CellIndex idx) {
@@ -171,6 +172,18 @@ TEST_CASE("DataTable.Sharing")
   weights->set<BoneWeights>(CellIndex(7), bw);
   CHECK(wcp->get<BoneWeights>(CellIndex(7)) == BoneWeights{});
   CHECK(weights->get<BoneWeights>(CellIndex(7)) == bw);
+
+  // storage shared between collections is counted once
+  collection.getTable(0)->addRows(1000);
+  HashSet<void const*> counted;
+  size_t const first  = collection.countMemory(counted);
+  auto         shared = collection.share();
+  size_t const second = shared->countMemory(counted);
+  CHECK(first > 1000 * sizeof(vec3));
+  CHECK(second < 1000 * sizeof(vec3));
+  shared->getTable(0)->makeUnique();
+  shared->getTable(0)->getColumn("position")->makeUnique();
+  CHECK(shared->getTable(0)->countMemory(counted) >= 1000 * sizeof(vec3)); // copied now
 }
 
 TEST_CASE("DataTable.Defragment")
@@ -339,6 +352,117 @@ TEST_CASE("DataTable.LuaBinding")
   CHECK(Stats::livingCount() == 0);
 }
 
+TEST_CASE("DataTable.LuaArray")
+{
+  using namespace joyflow;
+  {
+    sol::state lua;
+    bindLuaTypes(lua);
+
+    auto pcollection = newDataCollection();
+    pcollection->addTable();
+    auto* table = pcollection->getTable(0);
+    table->createColumn<real>("x", 0.0);
+    table->createColumn<int>("id", 0);
+    table->createColumn("pos", vec3(0,1,2));
+    table->addRows(10);
+    for (sint row = 0; row < 10; ++row) {
+      table->set<real>("x", row, real(row));
+      table->set<int>("id", row, int(row * 10));
+    }
+    lua["wd"] = table;
+
+    CHECK(lua.safe_script("return #wd:array('x')").get<int>() == 10);
+    CHECK(lua.safe_script("return wd:array('x')[3]").get<real>() == 3.0);
+    CHECK(lua.safe_script("return wd:array('x'):sum()").get<real>() == 45.0);
+    CHECK(lua.safe_script("return wd:array('id'):sum()").get<int>() == 450);
+    lua.safe_script("a,b,c = wd:array('pos'):sum()");
+    CHECK(double(lua["a"]) == 0);
+    CHECK(double(lua["b"]) == 10);
+    CHECK(double(lua["c"]) == 20);
+    CHECK(lua.safe_script("return wd:array('pos')[4].z").get<real>() == 2.0);
+    CHECK_THROWS(lua.safe_script("wd:array('x')[0] = 1", sol::script_throw_on_error)); // read-only
+    CHECK_THROWS(lua.safe_script("return wd:array('x')[10]", sol::script_throw_on_error));
+
+    lua.safe_script(R"(
+      local x = wd:mutArray('x')
+      x:mul(2):add(wd:array('id'))
+      x[0] = -1
+      wd:mutArray('id'):map('x + 1')
+      wd:mutArray('pos'):map(function(x, y, z) return x + 1, y end)
+    )");
+    CHECK(table->get<real>("x", 0) == -1.0);
+    CHECK(table->get<real>("x", 3) == 36.0);
+    CHECK(table->get<int>("id", 9) == 91);
+    CHECK(table->get<vec3>("pos", 5) == vec3(1,1,2));
+
+    lua.safe_script("wd:mutArray('pos'):fill(vec3.new(4,5,6))");
+    CHECK(table->get<vec3>("pos", 7) == vec3(4,5,6));
+
+    // rows are not indices after sorting
+    table->sort({9,8,7,6,5,4,3,2,1,0});
+    CHECK(lua.safe_script("return wd:array('id')[0]").get<int>() == 91);
+    CHECK_THROWS(lua.safe_script("wd:array('id'):mul(0)", sol::script_throw_on_error));
+    CHECK_THROWS(lua.safe_script("wd:mutArray('id'):div(0)", sol::script_throw_on_error));
+
+    // arrays kept across changes of their table are refused, instead of reading stale storage
+    lua.safe_script("kept, keptmut = wd:array('x'), wd:mutArray('x')");
+    CHECK(lua.safe_script("return #kept").get<int>() == 10);
+    table->addRows(5);
+    CHECK_THROWS(lua.safe_script("return kept[0]", sol::script_throw_on_error));
+    CHECK_THROWS(lua.safe_script("keptmut[0] = 1", sol::script_throw_on_error));
+    CHECK(lua.safe_script("return #wd:array('x')").get<int>() == 15);
+
+    // and so are arrays whose storage has been shared or copied since
+    lua.safe_script("kept, keptmut = wd:array('x'), wd:mutArray('x')");
+    real const x0   = table->get<real>("x", 0);
+    auto       copy = table->share();
+    CHECK_THROWS(lua.safe_script("keptmut[0] = 1", sol::script_throw_on_error));
+    lua.safe_script("kept = wd:array('x')");
+    lua.safe_script("wd:set('x', 0, 7.0)");
+    CHECK_THROWS(lua.safe_script("return kept[0]", sol::script_throw_on_error));
+    CHECK(lua.safe_script("return wd:array('x')[0]").get<real>() == 7.0);
+    CHECK(copy->get<real>("x", 0) == x0);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("DataTable.LuaParallelForeach")
+{
+  using namespace joyflow;
+  {
+    sol::state lua;
+    bindLuaTypes(lua);
+
+    auto pcollection = newDataCollection();
+    pcollection->addTable();
+    auto* table = pcollection->getTable(0);
+    table->createColumn<int>("id", 0);
+    table->createColumn<real>("out", 0.0);
+    table->addRows(1000);
+    for (sint row = 0; row < 1000; ++row)
+      table->set<int>("id", row, int(row));
+    lua["wd"] = table;
+
+    lua.safe_script(R"(
+      wd:parallel_foreach(function(row)
+        scale = 2 -- global of this range only
+        row.out = row.id * scale + 0.5
+      end, {'out'})
+    )", sol::script_throw_on_error);
+    for (sint row = 0; row < 1000; row += 37)
+      CHECK(table->get<real>("out", row) == row * 2 + 0.5);
+    CHECK(lua["scale"].get_type() == sol::type::lua_nil);
+
+    CHECK_THROWS(lua.safe_script(R"(
+      local k = 3
+      wd:parallel_foreach(function(row) row.out = k end, {'out'})
+    )", sol::script_throw_on_error));
+    CHECK_THROWS(lua.safe_script("wd:parallel_foreach(function(row) end, {'nothere'})", sol::script_throw_on_error));
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
 TEST_CASE("DataTable.LuaReadonly")
 {
   using namespace joyflow;
@@ -358,6 +482,8 @@ TEST_CASE("DataTable.LuaReadonly")
   CHECK(static_cast<real>(lua.safe_script("return wd:get('test', 3)")) == 3.0);
   CHECK(static_cast<real>(lua.safe_script("return wd:get('test', 7)")) == 7.0);
   CHECK_THROWS(lua.safe_script("wd:set('test', 11, 1021, 0)", sol::script_throw_on_error));
+  CHECK(static_cast<real>(lua.safe_script("return wd:array('test'):sum()")) == 4950.0);
+  CHECK_THROWS(lua.safe_script("wd:mutArray('test')", sol::script_throw_on_error));
 }
 
 TEST_CASE("DataTable.join.numeric")
@@ -426,6 +552,61 @@ TEST_CASE("DataTable.join.numeric")
   CHECK(Stats::livingCount() == 0);
 }
 
+TEST_CASE("DataTable.join.multiple")
+{
+  using namespace joyflow;
+  {
+    auto makePart = [](size_t rows, int seed, bool withNormal, bool floatIds) {
+      auto dc = newDataCollection();
+      dc->addTable();
+      auto* t = dc->getTable(0);
+      t->addRows(rows);
+      if (floatIds)
+        t->createColumn<float>("iii", 0.f);
+      else
+        t->createColumn<int>("iii", 0);
+      t->createColumn<vec3>("pos", vec3(0));
+      if (withNormal)
+        t->createColumn<vec3>("normal", vec3(0,1,0));
+      for (size_t i = 0; i < rows; ++i) {
+        if (floatIds)
+          t->set<float>("iii", i, float(seed + i));
+        else
+          t->set<int>("iii", i, int(seed + i));
+        t->set<vec3>("pos", i, vec3(real(seed), real(i), 0));
+      }
+      return dc;
+    };
+    Vector<DataCollectionPtr> parts = {makePart(100, 0, false, false), makePart(200, 1000, true, false),
+                                       makePart(50, 2000, false, true), makePart(300, 3000, true, false)};
+
+    auto sequential = parts[0]->share();
+    for (size_t i = 1; i < parts.size(); ++i)
+      sequential->join(parts[i].get());
+    auto together = parts[0]->share();
+    together->join(Vector<DataCollection const*>{parts[1].get(), parts[2].get(), parts[3].get()});
+
+    auto const* ts = sequential->getTable(0);
+    auto const* tt = together->getTable(0);
+    REQUIRE(tt->numRows() == 650);
+    REQUIRE(tt->numRows() == ts->numRows());
+    auto const names = tt->columnNames();
+    CHECK(std::vector<String>(names.begin(), names.end()) == std::vector<String>{"iii", "pos", "normal"});
+    CHECK(ts->columnNames().size() == names.size());
+    for (sint row = 0; row < 650; ++row) {
+      CHECK(together->get<int64_t>(0, "iii", row) == sequential->get<int64_t>(0, "iii", row));
+      CHECK(together->get<vec3>(0, "pos", row) == sequential->get<vec3>(0, "pos", row));
+      CHECK(together->get<vec3>(0, "normal", row) == sequential->get<vec3>(0, "normal", row));
+    }
+    CHECK(together->get<int64_t>(0, "iii", 649) == 3299);
+    CHECK(together->get<vec3>(0, "normal", 0) == vec3(0,1,0));
+    // parts stay untouched
+    CHECK(parts[0]->getTable(0)->numRows() == 100);
+    CHECK(parts[0]->get<int64_t>(0, "iii", 99) == 99);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
 struct Test
 {
   int x,y;
@@ -564,3 +745,39 @@ TEST_CASE("Datatable.Sort")
   }
 }
 
+
+TEST_CASE("Stats.CrossThread")
+{
+  using namespace joyflow;
+  auto const living = Stats::livingCount();
+  auto const allocs = Stats::totalAllocCount();
+  Vector<DataCollectionPtr> collections(8);
+  {
+    // born on other threads ..
+    Vector<std::thread> workers;
+    for (sint i = 0; i < collections.ssize(); ++i)
+      workers.push_back(std::thread([&collections, i] {
+        collections[i] = newDataCollection();
+        collections[i]->addTable();
+      }));
+    for (auto& w : workers)
+      w.join();
+  }
+  CHECK(Stats::livingCount() > living);
+  CHECK(Stats::totalAllocCount() >= allocs + 2 * collections.size()); // collection + table
+  // .. and die here
+  collections.clear();
+  CHECK(Stats::livingCount() == living);
+
+  Stats::setTrackAddresses(true);
+  CHECK(Stats::trackAddresses());
+  {
+    auto dc = newDataCollection();
+    dc->addTable();
+    String dump;
+    Stats::dumpLiving([](char const* msg, void* arg) { *static_cast<String*>(arg) += msg; }, &dump);
+    CHECK(dump.find("objects living") != String::npos);
+  }
+  Stats::setTrackAddresses(false);
+  CHECK(Stats::livingCount() == living);
+}
@@ -9,10 +9,21 @@
 #include <core/stats.h>
 #include <core/oparg.h>
 #include <core/oplib.h>
+#include <core/outputcache.h>
+#include <core/scheduler.h>
+#include <core/diskcache.h>
+#include <core/tracer.h>
+#include <core/cppscript.h>
 #include <glm/glm.hpp>
 
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <thread>
 
 TEST_CASE("OpGrpah.Eval")
 {
@@ -251,6 +262,11 @@ TEST_CASE("OpGraph.Builtin")
       CHECK(joinresult->get<StringView>(0, "name", i) == defragresult->get<StringView>(0, "name", i));
       CHECK(defragresult->get<int>(0, "Position", i, 1) == expectedY[i]);
     }
+    auto* sortctx = proot->node(sort)->context();
+    CHECK(sortctx->progress() == 1.0);
+    auto sortstages = sortctx->stageTimings();
+    CHECK(std::any_of(sortstages.begin(), sortstages.end(), [](OpStageTiming const& st) { return st.name == "sort"; }));
+
     size_t sharedMem = 0, unsharedMem = 0;
     joinresult->countMemory(sharedMem, unsharedMem);
     spdlog::info("memory usage of {} : {} bytes shared, {} bytes unshared", newjoin, sharedMem, unsharedMem);
@@ -287,6 +303,957 @@ TEST_CASE("OpGraph.Builtin")
   CHECK(Stats::livingCount() == 0);
 }
 
+TEST_CASE("OpGraph.OutputCache")
+{
+  using namespace joyflow;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+
+    auto init = proot->addNode("init", "init");
+    auto sort = proot->addNode("sort", "sort");
+    auto defrag = proot->addNode("defragment", "defrag");
+    proot->node(sort)->mutArg("key").setString("Position");
+    proot->node(sort)->mutArg("order").setMenu(1);
+    proot->link(init, 0, sort, 0);
+    proot->link(sort, 0, defrag, 0);
+
+    // cached upstreams keep their outputs, downstreams modify copies
+    auto unlimited = proot->evalNode(defrag);
+    CHECK(proot->node(init)->context()->hasOutputCache(0));
+    CHECK(proot->node(sort)->context()->hasOutputCache(0));
+    CHECK(proot->node(sort)->context()->metrics().back().bytesCopied > 0);
+    CHECK(unlimited->numRows(0) == unlimited->numIndices(0));
+    for (sint i = 0, n = unlimited->numRows(0); i < n; ++i)
+      CHECK(unlimited->get<int>(0, "Position", i, 1) == n - 1 - i);
+
+    // anything not pinned gets dropped with a tiny budget
+    OutputCache::setBudget(1);
+    CHECK(OutputCache::collect() > 0);
+    CHECK(!proot->node(defrag)->context()->hasOutputCache(0));
+
+    // and calculated again on demand, without bumping up versions
+    auto sortversion = proot->node(sort)->context()->outputVersion(0);
+    auto budgeted = proot->evalNode(defrag);
+    CHECK(proot->node(sort)->context()->outputVersion(0) == sortversion);
+    CHECK(budgeted->numRows(0) == unlimited->numRows(0));
+    for (sint i = 0, n = budgeted->numRows(0); i < n; ++i)
+      CHECK(budgeted->get<vec3>(0, "Position", i) == unlimited->get<vec3>(0, "Position", i));
+    CHECK(OutputCache::usage() <= 1);
+    OutputCache::setBudget(0);
+
+    // changing a downstream argument does not re-run upstreams
+    auto const initevals = proot->node(init)->context()->evalCount();
+    proot->node(sort)->mutArg("order").setMenu(0);
+    proot->evalNode(defrag);
+    CHECK(proot->node(init)->context()->evalCount() == initevals);
+    CHECK(proot->node(init)->context()->hasOutputCache(0));
+
+    // non-caching node drops its output after evaluation, retained one is never handed over
+    OpEnvironment noncaching;
+    noncaching.cachingPolicy = CachingPolicy::NonCaching;
+    OpEnvironment retained;
+    retained.cachingPolicy = CachingPolicy::Retained;
+    proot->node(init)->overrideEnv(noncaching);
+    proot->node(sort)->overrideEnv(retained);
+    proot->node(init)->mutArg("count").setInt(100);
+    auto result = proot->evalNode(defrag);
+    CHECK(result->numRows(0) == 100);
+    CHECK(!proot->node(init)->context()->hasOutputCache(0));
+    CHECK(proot->node(sort)->context()->hasOutputCache(0));
+    CHECK(proot->node(sort)->context()->metrics().back().bytesCopied == 0); // init handed over
+    CHECK(proot->node(defrag)->context()->metrics().back().bytesCopied > 0);
+
+    // opted in: handed over, then kept once it had to be calculated again
+    OpEnvironment handover;
+    handover.cachingPolicy = CachingPolicy::HandOver;
+    proot->node(init)->overrideEnv(handover);
+    proot->node(init)->mutArg("count").setInt(50);
+    proot->evalNode(defrag);
+    CHECK(!proot->node(init)->context()->hasOutputCache(0));
+    CHECK(proot->node(sort)->context()->metrics().back().bytesCopied == 0);
+    proot->node(sort)->mutArg("order").setMenu(1);
+    proot->evalNode(defrag);
+    proot->node(sort)->mutArg("order").setMenu(0);
+    proot->evalNode(defrag);
+    CHECK(proot->node(init)->context()->hasOutputCache(0));
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.InputConsumed")
+{
+  using namespace joyflow;
+  class ReadAfterMove : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      ctx.moveInputToOutput(0, 0);
+      ctx.fetchInputData(0); // too late
+    }
+    static OpDesc mkDesc() { return makeOpDesc<ReadAfterMove>("read_after_move").numMaxInput(1).numRequiredInput(1); }
+  };
+  OpRegistry::instance().add(ReadAfterMove::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto init = proot->addNode("init", "init");
+    auto bad  = proot->addNode("read_after_move", "bad");
+    proot->link(init, 0, bad, 0);
+    proot->evalNode(bad);
+    CHECK(proot->node(bad)->context()->lastError() >= OpErrorLevel::ERROR);
+    CHECK(proot->node(bad)->context()->errorMessage().find("consumed") != String::npos);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.GraphEnvironment")
+{
+  using namespace joyflow;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto a = proot->addNode("init", "a");
+    auto b = proot->addNode("init", "b");
+
+    OpEnvironment graphenv;
+    graphenv.frame = 7;
+    proot->overrideEnv(graphenv);
+    REQUIRE(proot->node(a)->env() != nullptr);
+    CHECK(proot->node(a)->env()->frame == 7);
+
+    // node's own environment wins
+    OpEnvironment nodeenv;
+    nodeenv.frame = 3;
+    proot->node(b)->overrideEnv(nodeenv);
+    CHECK(proot->node(b)->env()->frame == 3);
+    CHECK(proot->node(a)->env()->frame == 7);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.DiskCache")
+{
+  using namespace joyflow;
+  static int eval_cnt = 0;
+  class CachedInit : public OpKernel
+  {
+  public:
+    virtual void eval(OpContext& context) const override
+    {
+      ++eval_cnt;
+      DataCollection* output0 = context.reallocOutput(0);
+      output0->addTable();
+      auto* column  = output0->getTable(0)->createColumn("Position", vec3());
+      auto* scolumn = output0->getTable(0)->createColumn<String>("name");
+      auto  cnt     = context.arg("count").asInt();
+      for (auto index = output0->addRows(0, cnt); index < cnt; ++index) {
+        column->set(index, vec3(0, index.value(), 0));
+        scolumn->set(index, fmt::format("item{}", index.value()));
+      }
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<CachedInit>("cached_init")
+        .numRequiredInput(0)
+        .flags(OpFlag::DISK_CACHEABLE)
+        .argDescs({ArgDescBuilder("count").type(ArgType::INT).defaultExpression(0, "100")});
+    }
+  };
+  OpRegistry::instance().add(CachedInit::mkDesc());
+
+  auto const cachedir = (std::filesystem::temp_directory_path() / "joyflow_diskcache_test").string();
+  DiskCache::setDirectory(cachedir);
+  CHECK(DiskCache::enabled());
+  DiskCache::clear();
+
+  auto buildGraph = [](OpGraph* graph) {
+    auto init = graph->addNode("cached_init", "init");
+    auto sort = graph->addNode("sort", "sort");
+    graph->node(sort)->mutArg("key").setString("Position");
+    graph->node(sort)->mutArg("order").setMenu(1);
+    graph->link(init, 0, sort, 0);
+    return sort;
+  };
+
+  Vector<vec3>   expectedPositions;
+  Vector<String> expectedNames;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto sort   = buildGraph(proot.get());
+    auto result = proot->evalNode(sort);
+    CHECK(eval_cnt == 1);
+    for (sint i = 0, n = result->numRows(0); i < n; ++i) {
+      expectedPositions.push_back(result->get<vec3>(0, "Position", i));
+      expectedNames.push_back(result->get<String>(0, "name", i));
+    }
+  }
+  // "restart": fresh graph, same arguments - nothing gets evaluated
+  auto hits = DiskCache::hits();
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto sort   = buildGraph(proot.get());
+    auto result = proot->evalNode(sort);
+    CHECK(eval_cnt == 1);
+    CHECK(DiskCache::hits() > hits);
+    CHECK(result->numRows(0) == expectedPositions.size());
+    for (sint i = 0, n = result->numRows(0); i < n; ++i) {
+      CHECK(result->get<vec3>(0, "Position", i) == expectedPositions[i]);
+      CHECK(result->get<String>(0, "name", i) == expectedNames[i]);
+    }
+
+    // upstream argument changed, key changes as well
+    proot->node("init")->mutArg("count").setInt(10);
+    result = proot->evalNode(sort);
+    CHECK(eval_cnt == 2);
+    CHECK(result->numRows(0) == 10);
+    CHECK(result->get<int>(0, "Position", 0, 1) == 9);
+  }
+  CHECK(DiskCache::clear() > 0);
+  DiskCache::setDirectory("");
+  CHECK(!DiskCache::enabled());
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Streaming")
+{
+  using namespace joyflow;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+
+    auto init   = proot->addNode("init", "init");
+    auto split  = proot->addNode("split", "split");
+    auto rename = proot->addNode("rename_column", "rename");
+    proot->node(init)->mutArg("count").setInt(100);
+    proot->node(split)->mutArg("condition").setString("${Position.y}<50");
+    proot->node(rename)->mutArg("column").setString("Position");
+    proot->node(rename)->mutArg("newname").setString("P");
+    proot->link(init, 0, split, 0);
+    proot->link(split, 0, rename, 0);
+
+    OpEnvironment streaming;
+    streaming.executionPolicy = ExecutionPolicy::Streaming;
+    streaming.streamBatchSize = 7; // not a divisor of anything here
+    proot->overrideEnv(streaming);
+
+    auto result = proot->evalNode(rename);
+    REQUIRE(result);
+    CHECK(result->numRows(0) == 50);
+    for (sint i = 0, n = result->numRows(0); i < n; ++i)
+      CHECK(result->get<vec3>(0, "P", i) == vec3(0, i, 0));
+    // split was streamed through, its output was never kept
+    CHECK(!proot->node(split)->context()->hasOutputCache(0));
+    CHECK(!proot->node(split)->context()->isDirty());
+
+    // and gets re-calculated on demand, without bumping up the version
+    auto splitversion = proot->node(split)->context()->outputVersion(0);
+    auto splitresult  = proot->evalNode(split);
+    CHECK(splitresult->numRows(0) == 50);
+    CHECK(proot->node(split)->context()->outputVersion(0) == splitversion);
+
+    // argument change goes through the pipeline again
+    proot->node(split)->mutArg("condition").setString("${Position.y}>=90");
+    result = proot->evalNode(rename);
+    CHECK(result->numRows(0) == 10);
+    CHECK(result->get<vec3>(0, "P", 0) == vec3(0, 90, 0));
+
+    // input fitting in one batch is passed on as it is, without being sliced
+    streaming.streamBatchSize = 4096;
+    proot->overrideEnv(streaming);
+    proot->node(split)->mutArg("condition").setString("${Position.y}<50");
+    result = proot->evalNode(rename);
+    CHECK(result->numRows(0) == 50);
+    CHECK(result->get<vec3>(0, "P", 49) == vec3(0, 49, 0));
+    CHECK(proot->node(init)->context()->hasOutputCache(0));
+
+    // row() counts across batches
+    auto map = proot->addNode("map", "map");
+    proot->node(map)->mutArg("code").setString("n = row()");
+    proot->link(rename, 0, map, 0);
+    streaming.streamBatchSize = 7;
+    proot->overrideEnv(streaming);
+    proot->node(split)->mutArg("condition").setString("${Position.y}>=20");
+    result = proot->evalNode(map);
+    REQUIRE(result->numRows(0) == 80);
+    CHECK(!proot->node(split)->context()->hasOutputCache(0));
+    for (sint i = 0; i < 80; ++i)
+      CHECK(result->get<real>(0, "n", i) == real(i));
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Metrics")
+{
+  using namespace joyflow;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto init = proot->addNode("init", "init");
+    auto sort = proot->addNode("sort", "sort");
+    proot->node(init)->mutArg("count").setInt(100);
+    proot->node(sort)->mutArg("key").setString("Position");
+    proot->link(init, 0, sort, 0);
+
+    proot->evalNode(sort);
+    proot->node(sort)->mutArg("order").setMenu(1);
+    proot->evalNode(sort);
+
+    auto* sortctx = proot->node(sort)->context();
+    auto  history = sortctx->metrics();
+    REQUIRE(history.size() == 2);
+    CHECK(history[0].evalIndex < history[1].evalIndex);
+    for (auto const& m : history) {
+      CHECK(m.rowsIn == 100);
+      CHECK(m.rowsOut == 100);
+      CHECK(m.wallSeconds >= 0);
+      CHECK(!m.diskCacheHit);
+    }
+    CHECK(history[0].bytesCopied > 0); // sorting a shared copy of init's cached output
+    CHECK(history[1].bytesCopied > 0);
+    CHECK(sortctx->copyAmplification() > 0);
+    // init keeps its output, it's evaluated once
+    proot->node(sort)->mutArg("order").setMenu(0);
+    proot->evalNode(sort);
+    REQUIRE(proot->node(init)->context()->metrics().size() == 1);
+    CHECK(!proot->node(init)->context()->metrics()[0].refill);
+    CHECK(proot->node(init)->context()->metrics()[0].bytesAllocated > 0);
+    CHECK(proot->node(init)->context()->cacheHits() >= 1);
+
+    auto report = metricsReport(proot.get());
+    CHECK(report.find("/sort") != String::npos);
+    CHECK(report.find("/init") != String::npos);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Trace")
+{
+  using namespace joyflow;
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto init = proot->addNode("init", "init");
+    auto sort = proot->addNode("sort", "sort");
+    proot->node(sort)->mutArg("key").setString("Position");
+    proot->link(init, 0, sort, 0);
+
+    Tracer::clear();
+    proot->evalNode(sort);
+    CHECK(Tracer::numEvents() == 0); // disabled by default
+
+    Tracer::setEnabled(true);
+    proot->node(sort)->mutArg("order").setMenu(1);
+    proot->evalNode(sort);
+    Tracer::setEnabled(false);
+    CHECK(Tracer::numEvents() > 0);
+
+    std::stringstream ss;
+    Tracer::dump(ss);
+    auto trace = nlohmann::json::parse(ss.str());
+    bool sortEvaluated = false;
+    for (auto const& ev : trace["traceEvents"])
+      if (ev["ph"] == "X" && ev["name"] == "evaluate" && ev.contains("args") && ev["args"]["detail"] == "sort")
+        sortEvaluated = true;
+    CHECK(sortEvaluated);
+
+    Tracer::clear();
+    CHECK(Tracer::numEvents() == 0);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Scheduler")
+{
+  using namespace joyflow;
+  auto cpus = [](String const& list) {
+    auto parsed = Scheduler::parseCpuList(list);
+    return std::vector<sint>(parsed.begin(), parsed.end());
+  };
+  CHECK(cpus("0-3,8") == std::vector<sint>{0, 1, 2, 3, 8});
+  CHECK(cpus("2,2,1") == std::vector<sint>{2, 1});
+  CHECK_THROWS(Scheduler::parseCpuList("3-1"));
+  CHECK_THROWS(Scheduler::parseCpuList("0,x"));
+
+  CHECK(Scheduler::threadPriority() == TaskPriority::INTERACTIVE);
+  {
+    SchedulerPriorityScope background(TaskPriority::BACKGROUND);
+    CHECK(Scheduler::threadPriority() == TaskPriority::BACKGROUND);
+
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto init = proot->addNode("init", "init");
+    auto sort = proot->addNode("sort", "sort");
+    proot->node(sort)->mutArg("key").setString("Position");
+    proot->link(init, 0, sort, 0);
+    proot->evalNode(sort);
+    CHECK(proot->node(sort)->context()->lastError() < OpErrorLevel::ERROR);
+  }
+  CHECK(Scheduler::threadPriority() == TaskPriority::INTERACTIVE);
+  CHECK(Scheduler::running());
+  CHECK(!Scheduler::configure(SchedulerConfig{}));
+  CHECK(Scheduler::pendingTasks(TaskPriority::BACKGROUND) == 0);
+}
+
+TEST_CASE("OpGraph.InlineScheduling")
+{
+  using namespace joyflow;
+  // sleeps when it has `rows` rows of input or more, does nothing otherwise
+  class CostByRows : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      sint rows = 0;
+      if (ctx.hasInput(0))
+        if (auto* idc = ctx.fetchInputData(0); idc && idc->numTables() > 0)
+          rows = sint(idc->numRows(0));
+      if (rows >= ctx.arg("rows").asInt())
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<CostByRows>("cost_by_rows")
+        .numMaxInput(1).numRequiredInput(0)
+        .argDescs({
+          ArgDescBuilder("rows").type(ArgType::INT).defaultExpression(0, "0"),
+          ArgDescBuilder("tick").type(ArgType::INT).defaultExpression(0, "0")
+        });
+    }
+  };
+  OpRegistry::instance().add(CostByRows::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto init    = proot->addNode("init", "init");
+    auto heavy   = proot->addNode("cost_by_rows", "heavy");
+    auto trivial = proot->addNode("cost_by_rows", "trivial");
+    auto scaled  = proot->addNode("cost_by_rows", "scaled");
+    proot->node(trivial)->mutArg("rows").setInt(1 << 30);
+    proot->node(scaled)->mutArg("rows").setInt(1000);
+    proot->node(init)->mutArg("count").setInt(1);
+    proot->link(init, 0, scaled, 0);
+
+    // queue time is only measured for evaluations that went through the scheduler
+    auto queued = [&](String const& name) {
+      auto history = proot->node(name)->context()->metrics();
+      REQUIRE(!history.empty());
+      return history.back().queueSeconds > 0;
+    };
+    proot->evalNode(init);
+    for (sint tick = 1; tick <= 10; ++tick) {
+      for (auto const& name : {heavy, trivial, scaled}) {
+        proot->node(name)->mutArg("tick").setInt(tick);
+        proot->evalNode(name);
+      }
+    }
+    CHECK(queued(heavy));
+    CHECK(!queued(trivial));
+    CHECK(!queued(scaled));
+
+    // its own history was cheap, but with that many more rows coming in it's worth a task now
+    proot->node(init)->mutArg("count").setInt(100000);
+    proot->evalNode(init);
+    proot->node(scaled)->mutArg("tick").setInt(11);
+    proot->evalNode(scaled);
+    CHECK(queued(scaled));
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.ArgExprDeps")
+{
+  using namespace joyflow;
+  registerBuiltinOps();
+  std::unique_ptr<OpGraph> proot(newGraph("root"));
+  OpEnvironment env;
+  env.frame = 4;
+  proot->overrideEnv(env);
+  auto a = proot->addNode("add_table", "a");
+  auto b = proot->addNode("add_table", "b");
+  proot->node(a)->mutArg("count").setRawExpr("`frame % 3 + 1`");
+  proot->node(b)->mutArg("count").setRawExpr("`arg('a.count') + 1`");
+
+  CHECK(proot->evalNode(a)->numTables() == 2);
+  CHECK(proot->evalNode(b)->numTables() == 3);
+  auto const version = proot->node(b)->arg("count").version();
+  CHECK(proot->evalNode(b)->numTables() == 3);
+  CHECK(proot->node(b)->arg("count").version() == version);
+
+  env.frame = 5;
+  proot->overrideEnv(env);
+  CHECK(proot->evalNode(a)->numTables() == 3);
+  CHECK(proot->evalNode(b)->numTables() == 4);
+
+  // a is not upstream of b, it's evaluated when read
+  env.frame = 6;
+  proot->overrideEnv(env);
+  CHECK(proot->evalNode(b)->numTables() == 2);
+
+  proot->node(b)->mutArg("count").setRawExpr("`arg('nothere.count')`");
+  proot->evalNode(b);
+  CHECK(!proot->node(b)->arg("count").errorMessage().empty());
+  proot->node(b)->mutArg("count").setRawExpr("`arg('count')`");
+  proot->evalNode(b);
+  CHECK(!proot->node(b)->arg("count").errorMessage().empty());
+
+  // volatile expressions are expanded every time
+  auto r = proot->addNode("rename_column", "r");
+  proot->node(r)->mutArg("newname").setRawExpr("`volatile(math.random(1, 1000000000))`");
+  proot->node(r)->evalArgument("newname");
+  auto const first = proot->node(r)->arg("newname").asString();
+  proot->node(r)->evalArgument("newname");
+  CHECK(proot->node(r)->arg("newname").asString() != first);
+  // and so are those calling random functions, without being told
+  for (auto const* expr : {"`random(1, 1000000000)`", "`math.random(1, 1000000000)`"}) {
+    proot->node(r)->mutArg("newname").setRawExpr(expr);
+    proot->node(r)->evalArgument("newname");
+    auto const before = proot->node(r)->arg("newname").asString();
+    proot->node(r)->evalArgument("newname");
+    CHECK(proot->node(r)->arg("newname").asString() != before);
+  }
+  proot->node(r)->mutArg("newname").setRawExpr("`math.floor(math.pi)`");
+  proot->node(r)->evalArgument("newname");
+  CHECK(proot->node(r)->arg("newname").asString() == "3");
+}
+
+TEST_CASE("OpGraph.EvalFrames")
+{
+  using namespace joyflow;
+  registerBuiltinOps();
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto s = proot->addNode("add_table", "s");
+    auto a = proot->addNode("add_table", "a");
+    auto b = proot->addNode("add_table", "b");
+    proot->node(s)->mutArg("count").setInt(2);
+    proot->node(a)->mutArg("count").setRawExpr("`frame % 3 + 1`");
+    proot->node(b)->mutArg("count").setInt(1);
+    proot->link(s, 0, a, 0);
+    proot->link(a, 0, b, 0);
+
+    std::unique_ptr<RootContext> rootctx(newRootContext());
+    rootctx->bind(proot.get());
+    auto results = rootctx->evalFrames("/b", 10, 17);
+    REQUIRE(results.size() == 8);
+    for (sint i = 0; i < 8; ++i) {
+      REQUIRE(results[i]);
+      CHECK(results[i]->numTables() == 2 + (10 + i) % 3 + 1 + 1);
+    }
+    // frame-invariant, evaluated once for all frames
+    CHECK(proot->node(s)->context()->metrics().size() == 1);
+
+    CHECK_THROWS(rootctx->evalFrames("/nothere", 0, 1));
+    CHECK_THROWS(rootctx->evalFrames("/b", 1, 0));
+
+    // reading `frame` through another argument, b sees a's count of its own frame
+    proot->node(b)->mutArg("count").setRawExpr("`arg('a.count') * 2`");
+    results = rootctx->evalFrames("/b", 10, 17);
+    REQUIRE(results.size() == 8);
+    for (sint i = 0; i < 8; ++i) {
+      REQUIRE(results[i]);
+      CHECK(results[i]->numTables() == 2 + ((10 + i) % 3 + 1) * 3);
+    }
+
+    // iterate carries its state from one frame to the next, no fork of it can
+    auto it = proot->addNode("iterate", "it");
+    proot->link(b, 0, it, 0);
+    rootctx->bind(proot.get());
+    String error;
+    try {
+      rootctx->evalFrames("/it", 0, 3);
+    } catch (std::exception const& e) {
+      error = e.what();
+    }
+    CHECK(error.find("it (iterate)") != String::npos);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.CppScript")
+{
+  using namespace joyflow;
+  auto const source = CppScript::source("data->addTable();");
+  CHECK(source.find("#line 1 \"cpp\"\ndata->addTable();\n") != String::npos);
+  CHECK(source.find("newCppScriptKernel") != String::npos);
+  CHECK(!CppScript::config().compiler.empty());
+  CHECK(!CppScript::config().cacheDir.empty());
+
+  registerBuiltinOps();
+  CHECK(OpRegistry::instance().get("cpp") != nullptr);
+
+  auto const config = CppScript::config();
+#ifdef _WIN32
+  auto const probe = fmt::format("{} --version > NUL 2>&1", config.compiler);
+#else
+  auto const probe = fmt::format("{} --version > /dev/null 2>&1", config.compiler);
+#endif
+  if (config.sourceDir.empty() || !std::filesystem::exists(std::filesystem::path(config.sourceDir) / "core/oplib.h") ||
+      std::system(probe.c_str()) != 0) {
+    MESSAGE("no compiler or source tree, cpp evaluation skipped");
+    return;
+  }
+  class CppSource : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override { ctx.reallocOutput(0)->addTable(); }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<CppSource>("cpp_source").numRequiredInput(0).numMaxInput(0);
+    }
+  };
+  OpRegistry::instance().add(CppSource::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src = proot->addNode("cpp_source", "src");
+    auto cpp = proot->addNode("cpp", "cpp");
+    proot->link(src, 0, cpp, 0);
+    proot->node(cpp)->mutArg("code").setString("data->addTable();");
+    CHECK(proot->evalNode(src)->numTables() == 1);
+    CHECK(proot->evalNode(cpp)->numTables() == 2);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Map")
+{
+  using namespace joyflow;
+  class MapSource : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      auto* dc = ctx.reallocOutput(0);
+      auto* tb = dc->getTable(dc->addTable());
+      tb->createColumn<int>("id", 0);
+      tb->createColumn<vec3>("v", vec3());
+      tb->createColumn<String>("name");
+      tb->addRows(1000);
+      for (sint row = 0; row < 1000; ++row) {
+        tb->set<int>("id", row, int(row));
+        tb->set<vec3>("v", row, vec3(row, 1, 0));
+        tb->set<String>("name", row, fmt::format("n{}", row));
+      }
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<MapSource>("map_source").numRequiredInput(0).numMaxInput(0);
+    }
+  };
+  registerBuiltinOps();
+  OpRegistry::instance().add(MapSource::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src = proot->addNode("map_source", "src");
+    auto map = proot->addNode("map", "map");
+    proot->link(src, 0, map, 0);
+    proot->node(map)->mutArg("code").setString(R"(
+      speed = length(v)     # new real column
+      id    = id * 2 + 1    ; label = name .. ":" .. id
+      P     = vec3(v.xy,
+                   row()) * 0.5
+      big   = id > 100 ? 1 : 0
+    )");
+    auto result = proot->evalNode(map);
+    REQUIRE(result);
+    for (sint row : {0, 3, 255, 256, 999}) {
+      CHECK(result->get<real>(0, "speed", row) == doctest::Approx(std::sqrt(real(row * row + 1))));
+      CHECK(result->get<int>(0, "id", row) == row * 2 + 1);
+      CHECK(result->get<StringView>(0, "label", row) == fmt::format("n{}:{}", row, row * 2 + 1));
+      CHECK(result->get<vec3>(0, "P", row) == vec3(row, 1, row) * 0.5);
+      CHECK(result->get<real>(0, "big", row) == (row * 2 + 1 > 100 ? 1 : 0));
+    }
+
+    proot->node(map)->mutArg("code").setString("x = nothere + 1");
+    proot->evalNode(map);
+    CHECK(proot->node(map)->context()->lastError() == OpErrorLevel::ERROR);
+    proot->node(map)->mutArg("code").setString("id = \"not a number\"");
+    proot->evalNode(map);
+    CHECK(proot->node(map)->context()->lastError() == OpErrorLevel::ERROR);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Loop")
+{
+  using namespace joyflow;
+  class LoopSource : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      auto* dc = ctx.reallocOutput(0);
+      auto* tb = dc->getTable(dc->addTable());
+      tb->createColumn<int>("id", 0);
+      tb->createColumn<String>("name");
+      tb->addRows(1000);
+      for (sint row = 0; row < 1000; ++row) {
+        tb->set<int>("id", row, int(row));
+        tb->set<String>("name", row, fmt::format("n{}", row));
+      }
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<LoopSource>("loop_source").numRequiredInput(0).numMaxInput(0);
+    }
+  };
+  registerBuiltinOps();
+  OpRegistry::instance().add(LoopSource::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src  = proot->addNode("loop_source", "src");
+    auto fb   = proot->addNode("feedback", "fb");
+    auto body = proot->addNode("map", "body");
+    auto loop = proot->addNode("loop", "loop");
+    proot->node(body)->mutArg("code").setString("id = id + 1");
+    proot->node(loop)->mutArg("count").setInt(5);
+    proot->link(src, 0, fb, 0);
+    proot->link(fb, 0, body, 0);
+    proot->link(body, 0, loop, 0);
+    proot->link(loop, 0, fb, 1);
+
+    auto result = proot->evalNode(loop);
+    REQUIRE(result);
+    for (sint row : {0, 1, 500, 999}) {
+      CHECK(result->get<int>(0, "id", row) == row + 5);
+      CHECK(result->get<StringView>(0, "name", row) == fmt::format("n{}", row));
+    }
+    // outside of the body, evaluated once for all iterations
+    CHECK(proot->node(src)->context()->metrics().size() == 1);
+    // the first iteration copies what it modifies off the source, later ones modify it in place
+    auto history = proot->node(body)->context()->metrics();
+    REQUIRE(history.size() == 5);
+    CHECK(history[0].bytesCopied > 0);
+    for (sint i = 1; i < 5; ++i)
+      CHECK(history[i].bytesCopied == 0);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.Reduce")
+{
+  using namespace joyflow;
+  class ReduceSource : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      auto* dc = ctx.reallocOutput(0);
+      auto* tb = dc->getTable(dc->addTable());
+      tb->createColumn<int>("g", 0);
+      tb->createColumn<String>("cat");
+      tb->createColumn<real>("x", 0.0);
+      tb->addRows(10000);
+      for (sint row = 0; row < 10000; ++row) {
+        tb->set<int>("g", row, int(row % 7) - 3);
+        tb->set<String>("cat", row, row % 3 == 0 ? "a" : "b");
+        tb->set<real>("x", row, real(row));
+      }
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<ReduceSource>("reduce_source").numRequiredInput(0).numMaxInput(0);
+    }
+  };
+  registerBuiltinOps();
+  OpRegistry::instance().add(ReduceSource::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src    = proot->addNode("reduce_source", "src");
+    auto reduce = proot->addNode("reduce", "reduce");
+    proot->link(src, 0, reduce, 0);
+    proot->node(reduce)->mutArg("keys").setStringList({"g"});
+    proot->node(reduce)->mutArg("aggregates").setString(R"(
+      n = count()
+      sum(x)
+      lo = min(x)
+      hi = max(x)  # comment
+      mean(x)
+      var(x)
+      first(cat)
+      last(cat)
+    )");
+    auto result = proot->evalNode(reduce);
+    REQUIRE(result);
+    REQUIRE(result->numRows(0) == 7);
+    for (sint g = 0; g < 7; ++g) {
+      // rows g, g+7, ... below 10000
+      sint const n    = (10000 - g + 6) / 7;
+      real const mean = g + 7 * real(n - 1) / 2;
+      CHECK(result->get<int>(0, "g", g) == g - 3);
+      CHECK(result->get<int64_t>(0, "n", g) == n);
+      CHECK(result->get<real>(0, "x_sum", g) == doctest::Approx(mean * n));
+      CHECK(result->get<real>(0, "lo", g) == g);
+      CHECK(result->get<real>(0, "hi", g) == g + 7 * (n - 1));
+      CHECK(result->get<real>(0, "x_mean", g) == doctest::Approx(mean));
+      CHECK(result->get<real>(0, "x_var", g) == doctest::Approx(49 * real(n) * (n + 1) / 12));
+      CHECK(result->get<StringView>(0, "cat_first", g) == (g % 3 == 0 ? "a" : "b"));
+      CHECK(result->get<StringView>(0, "cat_last", g) == ((g + 7 * (n - 1)) % 3 == 0 ? "a" : "b"));
+    }
+
+    proot->node(reduce)->mutArg("keys").setStringList({"cat", "g"});
+    proot->node(reduce)->mutArg("aggregates").setString("n = count()");
+    result = proot->evalNode(reduce);
+    REQUIRE(result);
+    CHECK(result->numRows(0) == 14);
+    CHECK(result->get<StringView>(0, "cat", 1) == "b");
+    CHECK(result->get<int>(0, "g", 1) == -2);
+    CHECK(result->get<int64_t>(0, "n", 0) == (10000 + 20) / 21);
+
+    proot->node(reduce)->mutArg("keys").setStringList({});
+    result = proot->evalNode(reduce);
+    REQUIRE(result);
+    REQUIRE(result->numRows(0) == 1);
+    CHECK(result->get<int64_t>(0, "n", 0) == 10000);
+
+    proot->node(reduce)->mutArg("aggregates").setString("median(x)");
+    proot->evalNode(reduce);
+    CHECK(proot->node(reduce)->context()->lastError() == OpErrorLevel::ERROR);
+    proot->node(reduce)->mutArg("aggregates").setString("sum(cat)");
+    proot->evalNode(reduce);
+    CHECK(proot->node(reduce)->context()->lastError() == OpErrorLevel::ERROR);
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.ForEach")
+{
+  using namespace joyflow;
+  class ForEachSource : public OpKernel
+  {
+  public:
+    void eval(OpContext& ctx) const override
+    {
+      auto* dc = ctx.reallocOutput(0);
+      for (int t = 0; t < 20; ++t) {
+        auto* tb = dc->getTable(dc->addTable());
+        tb->createColumn<int>("g", 0);
+        tb->createColumn<real>("x", 0.0);
+        tb->addRows(100 + t);
+        for (sint row = 0; row < 100 + t; ++row) {
+          tb->set<int>("g", row, int(row % 5));
+          tb->set<real>("x", row, real(t));
+        }
+      }
+    }
+    static OpDesc mkDesc()
+    {
+      return makeOpDesc<ForEachSource>("foreach_source").numRequiredInput(0).numMaxInput(0);
+    }
+  };
+  registerBuiltinOps();
+  OpRegistry::instance().add(ForEachSource::mkDesc());
+  {
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src  = proot->addNode("foreach_source", "src");
+    auto each = proot->addNode("foreach", "each");
+    auto item = proot->addNode("foreach_item", "item");
+    auto body = proot->addNode("map", "body");
+    proot->link(src, 0, each, 0);
+    proot->link(item, 0, body, 0);
+    proot->link(body, 0, each, 1);
+    proot->node(item)->mutArg("controller").setString(each);
+    proot->node(body)->mutArg("code").setString("y = x * 2 + 1");
+
+    auto result = proot->evalNode(each);
+    REQUIRE(result);
+    REQUIRE(result->numTables() == 20);
+    for (sint t = 0; t < 20; ++t) {
+      CHECK(result->numRows(t) == 100 + t);
+      CHECK(result->get<real>(t, "y", 0) == t * 2 + 1);
+      CHECK(result->get<real>(t, "y", 99 + t) == t * 2 + 1);
+    }
+
+    // edits to the body are picked up
+    proot->node(body)->mutArg("code").setString("y = x * 3");
+    result = proot->evalNode(each);
+    REQUIRE(result);
+    CHECK(result->get<real>(7, "y", 0) == 21);
+
+    // per key, with a reduce as body
+    proot->removeNode(body);
+    auto reduce = proot->addNode("reduce", "body");
+    proot->link(item, 0, reduce, 0);
+    proot->link(reduce, 0, each, 1);
+    proot->node(reduce)->mutArg("keys").setStringList({"g"});
+    proot->node(reduce)->mutArg("aggregates").setString("n = count()");
+    proot->node(each)->mutArg("by").setMenu(1);
+    proot->node(each)->mutArg("table").setMenu(3);
+    proot->node(each)->mutArg("keys").setStringList({"g"});
+    result = proot->evalNode(each);
+    REQUIRE(result);
+    REQUIRE(result->numTables() == 5);
+    for (sint g = 0; g < 5; ++g) {
+      CHECK(result->numRows(g) == 1);
+      CHECK(result->get<int>(g, "g", 0) == g);
+      CHECK(result->get<int64_t>(g, "n", 0) == (g < 3 ? 21 : 20));
+    }
+
+    // a fork splits on its own, its body never reads pieces of the original
+    proot->node(each)->mutArg("by").setMenu(0);
+    {
+      OpEnvironment              env;
+      std::unique_ptr<OpContext> fork(proot->node(each)->context()->fork(&env));
+      auto*                      forked = fork->getOrCalculateOutputData(0);
+      REQUIRE(forked);
+      REQUIRE(forked->numTables() == 20);
+      for (sint t = 0; t < 20; ++t)
+        CHECK(forked->numRows(t) == 5);
+    }
+    proot->node(each)->mutArg("by").setMenu(1);
+
+    proot->node(reduce)->mutArg("keys").setStringList({"nothere"});
+    proot->evalNode(each);
+    CHECK(proot->node(each)->context()->lastError() == OpErrorLevel::ERROR);
+
+    // an item is only defined inside its controller's body
+    proot->evalNode(item);
+    CHECK(proot->node(item)->context()->lastError() == OpErrorLevel::ERROR);
+  }
+  {
+    // nested: each piece of the outer loop is split again, inner bodies read both items
+    std::unique_ptr<OpGraph> proot(newGraph("root"));
+    auto src   = proot->addNode("foreach_source", "src");
+    auto outer = proot->addNode("foreach", "outer");
+    auto oitem = proot->addNode("foreach_item", "oitem");
+    auto inner = proot->addNode("foreach", "inner");
+    auto iitem = proot->addNode("foreach_item", "iitem");
+    auto join  = proot->addNode("join", "join");
+    proot->node(oitem)->mutArg("controller").setString(outer);
+    proot->node(iitem)->mutArg("controller").setString(inner);
+    proot->node(inner)->mutArg("by").setMenu(1);
+    proot->node(inner)->mutArg("keys").setStringList({"g"});
+    proot->link(src, 0, outer, 0);
+    proot->link(oitem, 0, inner, 0);
+    proot->link(iitem, 0, join, 0);
+    proot->link(oitem, 0, join, 1);
+    proot->link(join, 0, inner, 1);
+    proot->link(inner, 0, outer, 1);
+
+    auto result = proot->evalNode(outer);
+    REQUIRE(result);
+    REQUIRE(result->numTables() == 20 * 5);
+    for (sint t = 0; t < 20; ++t) {
+      for (sint g = 0; g < 5; ++g) {
+        sint const rows = 100 + t;
+        CHECK(result->numRows(t * 5 + g) == (rows - g + 4) / 5 + rows);
+        CHECK(result->get<real>(t * 5 + g, "x", result->numRows(t * 5 + g) - 1) == real(t));
+      }
+    }
+  }
+  CHECK(Stats::livingCount() == 0);
+}
+
+TEST_CASE("OpGraph.LuaSandbox")
+{
+  using namespace joyflow;
+  std::unique_ptr<OpGraph> proot(newGraph("root"));
+  auto script = proot->addNode("lua", "script");
+  proot->node(script)->mutArg("code").setString("assert(leaked == nil, 'global leaked from last run') leaked = 1");
+  for (int run = 0; run < 3; ++run) {
+    proot->evalNode(script);
+    CHECK(proot->node(script)->context()->lastError() < OpErrorLevel::ERROR);
+    proot->node(script)->context()->markDirty(true);
+  }
+
+  proot->node(script)->mutArg("code").setString("this is not lua");
+  proot->evalNode(script);
+  CHECK(proot->node(script)->context()->lastError() == OpErrorLevel::ERROR);
+}
+
 TEST_CASE("OpGraph.FromUI")
 {
   using namespace joyflow;
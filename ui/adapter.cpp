@@ -13,6 +13,7 @@
 #include <core/luabinding.h>
 #include <core/stats.h>
 #include <core/profiler.h>
+#include <core/tracer.h>
 
 #include <nlohmann/json.hpp>
 #include <sol/sol.hpp>
@@ -335,6 +336,23 @@ public:
         ImGui::GetWindowDrawList()->AddCircle(iconcenter, fontsize*0.8f, 0xff318cff, 0, 2*gv.canvasScale);
         ImGui::GetWindowDrawList()->AddText(font, fontsize, textpos, 0xff318cff, bypassIcon);
       }
+
+      // progress of a running evaluation, polled every frame, as a bar under the node
+      if (auto* ctx = opnode->context()) {
+        auto const fraction = ctx->progress();
+        if (fraction > 0 && fraction < 1) {
+          auto const bottomleft  = gv.canvasToScreen * glm::vec3(node->pos() - node->size() * glm::vec2(0.5f, -0.5f), 1);
+          auto const bottomright = gv.canvasToScreen * glm::vec3(node->pos() + node->size() * 0.5f, 1);
+          float const height     = 4 * gv.canvasScale;
+          float const filled     = bottomleft.x + (bottomright.x - bottomleft.x) * float(fraction);
+          auto* drawList = ImGui::GetWindowDrawList();
+          drawList->AddRectFilled({ bottomleft.x, bottomleft.y }, { bottomright.x, bottomright.y + height }, 0x66000000);
+          drawList->AddRectFilled({ bottomleft.x, bottomleft.y }, { filled, bottomleft.y + height }, 0xff31c48c);
+          auto const message = ctx->progressMessage();
+          if (!message.empty())
+            drawList->AddText({ bottomleft.x, bottomleft.y + height }, 0xffcccccc, message.c_str());
+        }
+      }
     }
   }
 
@@ -574,6 +592,13 @@ public:
                 }
                 ImGui::TextColored(tcolor, "%s", context->errorMessage().c_str());
               }
+              if (auto stages = context->stageTimings(); !stages.empty()) {
+                ImGui::Separator();
+                ImGui::Text("Stages:");
+                for (auto const& stage : stages) {
+                  ImGui::Text("  %-16s %.3f ms", stage.name.c_str(), stage.seconds * 1000.0);
+                }
+              }
               ImGui::Separator();
               auto*  table       = dc->getTable(i);
               size_t sharedbytes = 0, unsharedbytes = 0;
@@ -642,11 +667,27 @@ public:
       // TODO: per-graph summary
       uint64_t lc = joyflow::Stats::livingCount();
       ImGui::Text("Number of tracked living objects : %" PRIu64, lc);
+      bool trackAddresses = joyflow::Stats::trackAddresses();
+      if (ImGui::Checkbox("Track object addresses (slow)", &trackAddresses))
+        joyflow::Stats::setTrackAddresses(trackAddresses);
       if (ImGui::TreeNode("Details:")) {
         joyflow::Stats::dumpLiving([](char const* msg, void* arg) { ImGui::Text("%s", msg); });
         ImGui::TreePop();
       }
       ImGui::Separator();
+      bool tracing = joyflow::Tracer::enabled();
+      if (ImGui::Checkbox("Record evaluation trace", &tracing))
+        joyflow::Tracer::setEnabled(tracing);
+      ImGui::SameLine();
+      if (ImGui::Button("Save Trace ...")) {
+        nfdchar_t* filepath = nullptr;
+        if (NFD_SaveDialog("json", nullptr, &filepath) == NFD_OKAY)
+          joyflow::Tracer::dump(joyflow::String(filepath));
+        if (filepath)
+          free(filepath);
+      }
+      ImGui::Text("%zu events recorded", joyflow::Tracer::numEvents());
+      ImGui::Separator();
       if (ImGui::TreeNode("mimalloc stats: ")) {
         mi_stats_print_out([](char const* msg, void* arg) { ImGui::Text("%s", msg); }, nullptr);
         ImGui::TreePop();